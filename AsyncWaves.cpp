@@ -0,0 +1,395 @@
+#include "AsyncWaves.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace DirectX;
+
+void WavesSnapshot::DirtyRows(unsigned long long since, std::vector<WavesRowRange>& rows) const
+{
+	rows.clear();
+
+	if (mRowStamps.empty())
+	{
+		WavesRowRange all;
+		all.Last = mNumRows;
+		rows.push_back(all);
+		return;
+	}
+
+	for (int i = 0; i < mNumRows; ++i)
+	{
+		if (mRowStamps[i] <= since)
+			continue;
+
+		if (!rows.empty() && rows.back().Last == i)
+		{
+			rows.back().Last = i + 1;
+		}
+		else
+		{
+			WavesRowRange range;
+			range.First = i;
+			range.Last = i + 1;
+			rows.push_back(range);
+		}
+	}
+}
+
+void WavesSnapshot::WriteVertices(void* dst, const WavesVertexLayout& layout, const std::vector<WavesRowRange>& rows) const
+{
+	unsigned char* base = static_cast<unsigned char*>(dst);
+	const float du = mNumCols > 1 ? 1.0f / (mNumCols - 1) : 0.0f;
+	const float dv = mNumRows > 1 ? 1.0f / (mNumRows - 1) : 0.0f;
+
+	for (const WavesRowRange& range : rows)
+	{
+		mPool->ParallelFor(range.First, range.Last, mRowGrain, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					WavesSimd::StreamVertexRow(
+						base + static_cast<std::size_t>(i) * mNumCols * layout.Stride, layout,
+						&mHeights[i * mNumCols], &mNormals[i * mNumCols].x, mNumCols,
+						-mHalfWidth, mSpatialStep, mHalfDepth - i * mSpatialStep,
+						du, i * dv);
+				}
+			});
+	}
+}
+
+void WavesSnapshot::WriteCompactVertices(WavesCompactVertex* dst, const std::vector<WavesRowRange>& rows) const
+{
+	for (const WavesRowRange& range : rows)
+	{
+		mPool->ParallelFor(range.First, range.Last, mRowGrain, [&](int first, int last)
+			{
+				WavesSimd::StreamCompactRow(mSimdLevel, dst + first * mNumCols,
+					&mHeights[first * mNumCols], &mNormals[first * mNumCols].x, (last - first) * mNumCols);
+			});
+	}
+}
+
+AsyncWaves::AsyncWaves(std::unique_ptr<Waves> waves)
+	: mWaves(std::move(waves))
+{
+	// Streaming vertices is bound by memory bandwidth, which a few threads
+	// already saturate.
+	mWritePool = std::make_unique<ThreadPool>(ThreadPool::Default().WorkerCount() / 2);
+
+	// The reader must have something to look at before the first publish.
+	Capture(mSlots[mFront]);
+	CaptureHeightField();
+
+	mWorker = std::thread(&AsyncWaves::WorkerMain, this);
+}
+
+AsyncWaves::~AsyncWaves()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWorkReady.notify_all();
+
+	mWorker.join();
+}
+
+void AsyncWaves::Update(float dt)
+{
+	if (!mAsync)
+	{
+		std::vector<float> frames(1, dt);
+		std::vector<PendingDisturb> disturbs;
+		std::vector<WavesImpulse> impulses;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			disturbs.swap(mPendingDisturbs);
+			impulses.swap(mPendingImpulses);
+		}
+
+		RunFrames(frames, disturbs, impulses);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	const int lag = static_cast<int>(mPendingFrames.size()) + mFramesInFlight;
+	if (lag >= mMaxPendingFrames)
+	{
+		if (mBackPressure == WavesBackPressure::Block)
+		{
+			mWorkDone.wait(lock, [this]()
+				{
+					return static_cast<int>(mPendingFrames.size()) + mFramesInFlight < mMaxPendingFrames;
+				});
+		}
+		else
+		{
+			if (!mPendingFrames.empty())
+				mPendingFrames.back() += dt;
+			else
+				mCoalescedTime += dt;
+
+			lock.unlock();
+			mWorkReady.notify_one();
+			return;
+		}
+	}
+
+	mPendingFrames.push_back(mCoalescedTime + dt);
+	mCoalescedTime = 0.0f;
+	lock.unlock();
+
+	mWorkReady.notify_one();
+}
+
+void AsyncWaves::Disturb(int i, int j, float magnitude)
+{
+	PendingDisturb disturb;
+	disturb.Row = i;
+	disturb.Column = j;
+	disturb.Magnitude = magnitude;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPendingDisturbs.push_back(disturb);
+}
+
+void AsyncWaves::QueueDisturbance(const WavesImpulse& impulse)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPendingImpulses.push_back(impulse);
+}
+
+const WavesSnapshot& AsyncWaves::AcquireLatest()
+{
+	if (mReady.load(std::memory_order_acquire) & FreshBit)
+	{
+		mFront = mReady.exchange(mFront, std::memory_order_acq_rel) & ~FreshBit;
+	}
+
+	return mSlots[mFront];
+}
+
+int AsyncWaves::PendingFrames() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return static_cast<int>(mPendingFrames.size()) + mFramesInFlight;
+}
+
+void AsyncWaves::SetMaxPendingFrames(int frames)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaxPendingFrames = std::max(frames, 1);
+}
+
+void AsyncWaves::SetAsynchronous(bool async)
+{
+	Flush();
+	mAsync = async;
+}
+
+void AsyncWaves::Flush()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [this]()
+		{
+			return mPendingFrames.empty() && mFramesInFlight == 0 && mCoalescedTime == 0.0f;
+		});
+}
+
+void AsyncWaves::WorkerMain()
+{
+	std::vector<float> frames;
+	std::vector<PendingDisturb> disturbs;
+	std::vector<WavesImpulse> impulses;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [this]()
+				{
+					return mStop || !mPendingFrames.empty() || mCoalescedTime > 0.0f;
+				});
+
+			if (mStop)
+				return;
+
+			// Take everything submitted so far in one go.
+			frames.swap(mPendingFrames);
+			if (mCoalescedTime > 0.0f)
+			{
+				if (frames.empty())
+					frames.push_back(mCoalescedTime);
+				else
+					frames.front() += mCoalescedTime;
+				mCoalescedTime = 0.0f;
+			}
+			disturbs.swap(mPendingDisturbs);
+			impulses.swap(mPendingImpulses);
+			mFramesInFlight = static_cast<int>(frames.size());
+		}
+
+		RunFrames(frames, disturbs, impulses);
+		frames.clear();
+		disturbs.clear();
+		impulses.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFramesInFlight = 0;
+		}
+		mWorkDone.notify_all();
+	}
+}
+
+void AsyncWaves::RunFrames(const std::vector<float>& frames, const std::vector<PendingDisturb>& disturbs,
+	const std::vector<WavesImpulse>& impulses)
+{
+	for (const PendingDisturb& disturb : disturbs)
+		mWaves->Disturb(disturb.Row, disturb.Column, disturb.Magnitude);
+
+	mWaves->QueueDisturbances(impulses.data(), static_cast<int>(impulses.size()));
+
+	for (float dt : frames)
+		mWaves->Update(dt);
+
+	Capture(mSlots[mBack]);
+	Publish();
+	CaptureHeightField();
+}
+
+void AsyncWaves::Capture(WavesSnapshot& snapshot)
+{
+	const Waves& waves = *mWaves;
+	const int m = waves.RowCount();
+	const int n = waves.ColumnCount();
+
+	snapshot.mNumRows = m;
+	snapshot.mNumCols = n;
+	snapshot.mSpatialStep = waves.SpatialStep();
+	snapshot.mHalfWidth = 0.5f * (n - 1) * waves.SpatialStep();
+	snapshot.mHalfDepth = 0.5f * (m - 1) * waves.SpatialStep();
+	snapshot.mRowGrain = std::max(1, (16 * 1024) / std::max(n, 1));
+	snapshot.mPool = mWritePool.get();
+	snapshot.mSimdLevel = waves.SimdLevel();
+	snapshot.mStepCount = waves.StepCount();
+	snapshot.mAlpha = waves.InterpolationFactor();
+
+	// The slot was last filled a couple of publishes ago.  With dirty
+	// tracking only the rows that changed since then need copying.
+	std::vector<WavesRowRange> rows;
+	const bool tracked = waves.DirtyTrackingEnabled();
+	const bool incremental = tracked &&
+		static_cast<int>(snapshot.mRowStamps.size()) == m &&
+		snapshot.mDirtyStamp <= waves.DirtyStamp();
+
+	if (incremental)
+	{
+		waves.DirtyRows(snapshot.mDirtyStamp, rows);
+	}
+	else
+	{
+		snapshot.mHeights.resize(static_cast<std::size_t>(m) * n);
+		snapshot.mNormals.resize(static_cast<std::size_t>(m) * n);
+		snapshot.mRowStamps.assign(tracked ? m : 0, 0);
+		rows.assign(1, WavesRowRange());
+		rows[0].Last = m;
+	}
+
+	for (const WavesRowRange& range : rows)
+	{
+		const std::size_t first = static_cast<std::size_t>(range.First) * n;
+		const std::size_t count = static_cast<std::size_t>(range.Last - range.First) * n;
+
+		std::memcpy(&snapshot.mHeights[first], waves.Heights() + first, count * sizeof(float));
+		std::memcpy(&snapshot.mNormals[first], waves.Normals() + first, count * sizeof(XMFLOAT3));
+
+		if (tracked)
+		{
+			for (int i = range.First; i < range.Last; ++i)
+				snapshot.mRowStamps[i] = waves.RowStamp(i);
+		}
+	}
+
+	snapshot.mDirtyStamp = tracked ? waves.DirtyStamp() : 0;
+}
+
+std::shared_ptr<const WavesHeightField> AsyncWaves::HeightField() const
+{
+	std::lock_guard<std::mutex> lock(mFieldMutex);
+	return mLatestField;
+}
+
+void AsyncWaves::CaptureHeightField()
+{
+	const Waves& waves = *mWaves;
+	const int m = waves.RowCount();
+	const int n = waves.ColumnCount();
+
+	// Readers only copy mLatestField, under the lock, so a field referenced by
+	// nothing but the pool cannot gain a reader behind our back.
+	std::shared_ptr<WavesHeightField> field;
+	{
+		std::lock_guard<std::mutex> lock(mFieldMutex);
+		for (const std::shared_ptr<WavesHeightField>& candidate : mFieldPool)
+		{
+			if (candidate.use_count() == 1)
+			{
+				field = candidate;
+				break;
+			}
+		}
+	}
+
+	// use_count is a relaxed read; pair it with the release in the last
+	// reader's decrement before overwriting what that reader looked at.
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (!field)
+	{
+		field = std::make_shared<WavesHeightField>();
+		mFieldPool.push_back(field);
+	}
+
+	field->mNumRows = m;
+	field->mNumCols = n;
+	field->mSpatialStep = waves.SpatialStep();
+	field->mStepCount = waves.StepCount();
+
+	// Same incremental copy as Capture.
+	std::vector<WavesRowRange> rows;
+	const bool tracked = waves.DirtyTrackingEnabled();
+	if (tracked && field->mDirtyStamp != 0 &&
+		field->mHeights.size() == static_cast<std::size_t>(m) * n &&
+		field->mDirtyStamp <= waves.DirtyStamp())
+	{
+		waves.DirtyRows(field->mDirtyStamp, rows);
+	}
+	else
+	{
+		field->mHeights.resize(static_cast<std::size_t>(m) * n);
+		rows.assign(1, WavesRowRange());
+		rows[0].Last = m;
+	}
+
+	for (const WavesRowRange& range : rows)
+	{
+		const std::size_t first = static_cast<std::size_t>(range.First) * n;
+		const std::size_t count = static_cast<std::size_t>(range.Last - range.First) * n;
+		std::memcpy(&field->mHeights[first], waves.Heights() + first, count * sizeof(float));
+	}
+
+	field->mDirtyStamp = tracked ? waves.DirtyStamp() : 0;
+
+	std::shared_ptr<const WavesHeightField> published = std::move(field);
+
+	std::lock_guard<std::mutex> lock(mFieldMutex);
+	mLatestField.swap(published);
+}
+
+void AsyncWaves::Publish()
+{
+	mBack = mReady.exchange(mBack | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+}
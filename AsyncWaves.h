@@ -0,0 +1,202 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Waves.h"
+
+// What the renderer needs from one completed simulation state: heights,
+// normals and the dirty-row stamps.  Owned by AsyncWaves and unchanged until
+// the next AcquireLatest, so it can be read while the next state is computed.
+class WavesSnapshot
+{
+public:
+	int RowCount() const { return mNumRows; }
+	int ColumnCount() const { return mNumCols; }
+
+	// Step count and interpolation factor of the simulation when captured.
+	unsigned long long StepCount() const { return mStepCount; }
+	float InterpolationFactor() const { return mAlpha; }
+
+	const float* Heights() const { return mHeights.data(); }
+	const DirectX::XMFLOAT3* Normals() const { return mNormals.data(); }
+
+	// Queries on the captured heights; valid until the next AcquireLatest.
+	WavesSampler Sampler() const { return WavesSampler(mHeights.data(), mNumRows, mNumCols, mSpatialStep); }
+
+	// Same contract as Waves::DirtyStamp/DirtyRows.  Without dirty tracking
+	// the stamp stays 0 and every row is reported.
+	unsigned long long DirtyStamp() const { return mDirtyStamp; }
+	void DirtyRows(unsigned long long since, std::vector<WavesRowRange>& rows) const;
+
+	// Same as Waves::WriteVertices, from the captured state.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout, const std::vector<WavesRowRange>& rows) const;
+
+	// Same as Waves::WriteCompactVertices, from the captured state.
+	void WriteCompactVertices(WavesCompactVertex* dst, const std::vector<WavesRowRange>& rows) const;
+
+private:
+	friend class AsyncWaves;
+
+	int mNumRows = 0;
+	int mNumCols = 0;
+	float mSpatialStep = 0.0f;
+	float mHalfWidth = 0.0f;
+	float mHalfDepth = 0.0f;
+	int mRowGrain = 1;
+	ThreadPool* mPool = nullptr;
+	WavesSimdLevel mSimdLevel = WavesSimdLevel::Scalar;
+
+	unsigned long long mStepCount = 0;
+	float mAlpha = 0.0f;
+	unsigned long long mDirtyStamp = 0;
+
+	std::vector<float> mHeights;
+	std::vector<DirectX::XMFLOAT3> mNormals;
+
+	// Empty when the simulation does not track dirty rows.
+	std::vector<unsigned long long> mRowStamps;
+};
+
+// What Update does when the worker has fallen MaxPendingFrames() behind.
+enum class WavesBackPressure : int
+{
+	// Wait for the worker to catch up, so the render thread never outruns
+	// the simulation by more than the limit.
+	Block = 0,
+
+	// Add the frame time to the newest pending frame and return right away.
+	// When every lagging frame is already running, the time is carried over
+	// to the worker's next batch instead.  Either way the lag stays within
+	// the limit and the time is not lost, but Waves' substep cap may drop
+	// some of it.
+	Coalesce
+};
+
+// Runs a Waves simulation on its own thread, pipelined with rendering.
+//
+// Update hands the frame time to the worker and returns; the worker steps
+// the simulation and publishes the result into one of three snapshots.
+// AcquireLatest swaps in the newest published snapshot without waiting, so
+// the frame reads a stable state while the next one is computed.  With the
+// default limit of one pending frame the picture trails the simulation by
+// one frame.
+//
+// Snapshots write their vertices on a pool of AsyncWaves' own.  The thread
+// that calls ParallelFor helps drain its pool, so writing on the
+// simulation's pool could leave the frame running simulation chunks.
+class AsyncWaves
+{
+public:
+	explicit AsyncWaves(std::unique_ptr<Waves> waves);
+	AsyncWaves(const AsyncWaves& rhs) = delete;
+	AsyncWaves& operator=(const AsyncWaves& rhs) = delete;
+	~AsyncWaves();
+
+	// Grid shape; constant, safe from any thread.
+	int RowCount() const { return mWaves->RowCount(); }
+	int ColumnCount() const { return mWaves->ColumnCount(); }
+	int VertexCount() const { return mWaves->VertexCount(); }
+	int TriangleCount() const { return mWaves->TriangleCount(); }
+	float Width() const { return mWaves->Width(); }
+	float Depth() const { return mWaves->Depth(); }
+	float SpatialStep() const { return mWaves->SpatialStep(); }
+
+	// Submits one frame of simulation time.  Only blocks under
+	// WavesBackPressure::Block when the worker is too far behind.
+	void Update(float dt);
+
+	// Queued for the simulation; applied with the next submitted frame.
+	void Disturb(int i, int j, float magnitude);
+	void QueueDisturbance(const WavesImpulse& impulse);
+
+	// Newest completed state.  Never blocks.  The returned snapshot stays
+	// valid and unchanged until the next call.
+	const WavesSnapshot& AcquireLatest();
+
+	// Heights of the newest completed state for height/normal queries, e.g.
+	// from physics or AI threads.  Safe from any thread, never waits for the
+	// simulation, and the field never changes while a reference to it is
+	// held.  Hold it only as long as needed: the worker reuses fields nobody
+	// holds anymore, and otherwise has to allocate a new one each publish.
+	std::shared_ptr<const WavesHeightField> HeightField() const;
+
+	// Frames submitted but not yet published.
+	int PendingFrames() const;
+
+	int MaxPendingFrames() const { return mMaxPendingFrames; }
+	void SetMaxPendingFrames(int frames);
+	WavesBackPressure BackPressure() const { return mBackPressure; }
+	void SetBackPressure(WavesBackPressure mode) { mBackPressure = mode; }
+
+	// Off runs each Update on the calling thread, for comparison and
+	// debugging.  Results are the same either way.
+	bool Asynchronous() const { return mAsync; }
+	void SetAsynchronous(bool async);
+
+	// Waits until every submitted frame is published.
+	void Flush();
+
+	// The wrapped simulation, for configuration.  Only touch it after Flush
+	// and before the next Update.
+	Waves& Simulation() { return *mWaves; }
+
+private:
+	void WorkerMain();
+	// Disturb calls waiting for the simulation, replayed as Waves::Disturb so
+	// a WavesRecorder sees them.
+	struct PendingDisturb
+	{
+		int Row = 0;
+		int Column = 0;
+		float Magnitude = 0.0f;
+	};
+
+	void RunFrames(const std::vector<float>& frames, const std::vector<PendingDisturb>& disturbs,
+		const std::vector<WavesImpulse>& impulses);
+	void Capture(WavesSnapshot& snapshot);
+	void CaptureHeightField();
+	void Publish();
+
+private:
+	std::unique_ptr<Waves> mWaves;
+
+	// Runs WavesSnapshot::WriteVertices/WriteCompactVertices.
+	std::unique_ptr<ThreadPool> mWritePool;
+
+	// Triple buffer: the reader owns mFront, the worker owns mBack, and
+	// mReady holds the newest published slot plus FreshBit until the reader
+	// takes it.
+	static const int FreshBit = 4;
+	WavesSnapshot mSlots[3];
+	int mFront = 0;
+	int mBack = 1;
+	std::atomic<int> mReady = { 2 };
+
+	// Newest height field, swapped under mFieldMutex.  mFieldPool holds every
+	// field the worker made; one only the pool still references is free.
+	mutable std::mutex mFieldMutex;
+	std::shared_ptr<const WavesHeightField> mLatestField;
+	std::vector<std::shared_ptr<WavesHeightField>> mFieldPool;
+
+	// Work handed from Update to the worker.
+	mutable std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+	std::vector<float> mPendingFrames;
+	std::vector<PendingDisturb> mPendingDisturbs;
+	std::vector<WavesImpulse> mPendingImpulses;
+	int mFramesInFlight = 0;
+
+	// Time coalesced while no frame was queued; the next batch runs it first.
+	float mCoalescedTime = 0.0f;
+	bool mStop = false;
+
+	int mMaxPendingFrames = 1;
+	WavesBackPressure mBackPressure = WavesBackPressure::Block;
+	bool mAsync = true;
+
+	std::thread mWorker;
+};
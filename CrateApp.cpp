@@ -3,6 +3,7 @@
 #include "UploadBuffer.h"
 #include "FrameResource.h"
 #include "GeometryGenerator.h"
+#include "GeometryCache.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -501,24 +502,25 @@ void CreateApp::BuildShadersAndInputLayout()
 
 void CreateApp::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
+	// 같은 매개변수의 기하구조는 한 번만 생성해서 공유한다.
+	GeometryCache& geoCache = GeometryCache::Default();
+	GeometryCache::MeshPtr box = geoCache.CreateBox(1.0f, 1.0f, 1.0f, 3);
 
 	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = static_cast<UINT>(box.Indices32.size());
+	boxSubmesh.IndexCount = static_cast<UINT>(box->Indices32.size());
 	boxSubmesh.StartIndexLocation = 0;
 	boxSubmesh.BaseVertexLocation = 0;
 
-	std::vector<Vertex> vertices(box.Vertices.size());
+	std::vector<Vertex> vertices(box->Vertices.size());
 
-	for (size_t i = 0; i < box.Vertices.size(); i++)
+	for (size_t i = 0; i < box->Vertices.size(); i++)
 	{
-		vertices[i].Pos = box.Vertices[i].Position;
-		vertices[i].Normal = box.Vertices[i].Normal;
-		vertices[i].TexC = box.Vertices[i].TexC;
+		vertices[i].Pos = box->Vertices[i].Position;
+		vertices[i].Normal = box->Vertices[i].Normal;
+		vertices[i].TexC = box->Vertices[i].TexC;
 	}
 
-	std::vector<std::uint16_t> indices = box.GetIndices16();
+	std::vector<std::uint16_t> indices = box->CachedIndices16();
 
 	const UINT vbByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
 	const UINT ibByteSize = static_cast<UINT>(indices.size() * sizeof(std::uint16_t));
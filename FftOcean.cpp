@@ -0,0 +1,418 @@
+#include "FftOcean.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const float Gravity = 9.81f;
+	const float Pi = 3.14159265358979f;
+
+	// Adjacent columns transformed together by FftColumns: 16 complex
+	// numbers, two cache lines per row.
+	const int ColumnStrip = 16;
+}
+
+FftOcean::FftOcean(const FftOceanDesc& desc)
+{
+	assert(desc.Size >= 2 && (desc.Size & (desc.Size - 1)) == 0);
+	assert(desc.PatchSize > 0.0f);
+
+	mSize = desc.Size;
+	while ((1 << mLogSize) < mSize)
+		++mLogSize;
+
+	mSpatialStep = desc.PatchSize / mSize;
+	mChoppiness = desc.Choppiness;
+
+	mPool = &ThreadPool::Default();
+
+	// Each row is an N log N transform, so a few rows per task are plenty.
+	mRowGrain = std::max(1, (4 * 1024) / mSize);
+
+	mBitReverse.resize(mSize);
+	for (int i = 0; i < mSize; ++i)
+	{
+		int r = 0;
+		for (int b = 0; b < mLogSize; ++b)
+			r |= ((i >> b) & 1) << (mLogSize - 1 - b);
+		mBitReverse[i] = r;
+	}
+
+	mTwiddles.resize(mSize / 2);
+	for (int k = 0; k < mSize / 2; ++k)
+	{
+		double a = 2.0 * 3.14159265358979323846 * k / mSize;
+		mTwiddles[k].Re = static_cast<float>(cos(a));
+		mTwiddles[k].Im = static_cast<float>(sin(a));
+	}
+
+	BuildSpectrum(desc);
+
+	const std::size_t count = static_cast<std::size_t>(mSize) * mSize;
+	mFields.resize(4 * count);
+	mPositions.resize(count);
+	mNormals.assign(count, XMFLOAT3(0.0f, 1.0f, 0.0f));
+	mTangentX.assign(count, XMFLOAT3(1.0f, 0.0f, 0.0f));
+
+	Update(0.0f);
+}
+
+FftOcean::~FftOcean()
+{
+}
+
+void FftOcean::SetThreadPool(ThreadPool* pool)
+{
+	mPool = pool != nullptr ? pool : &ThreadPool::Default();
+}
+
+void FftOcean::BuildSpectrum(const FftOceanDesc& desc)
+{
+	const int n = mSize;
+	const float dk = 2.0f * Pi / desc.PatchSize;
+
+	// The grid's row axis runs toward -z, so the wind is mirrored into
+	// (column, row) coordinates.
+	float wx = desc.WindDirection.x;
+	float wy = -desc.WindDirection.y;
+	float wl = sqrtf(wx * wx + wy * wy);
+	if (wl > 0.0f)
+	{
+		wx /= wl;
+		wy /= wl;
+	}
+	else
+	{
+		wx = 1.0f;
+		wy = 0.0f;
+	}
+
+	const float windAngle = atan2f(wy, wx);
+	const float u = std::max(desc.WindSpeed, 0.01f);
+
+	// Phillips: largest wave from the wind, and a cutoff for the tiny ones.
+	const float largest = u * u / Gravity;
+	const float smallest = largest * 0.001f;
+
+	// JONSWAP: Hasselmann et al. fit of the Phillips constant and peak.
+	const float fetch = std::max(desc.Fetch, 1.0f);
+	const float alpha = 0.076f * powf(u * u / (fetch * Gravity), 0.22f);
+	const float peak = 22.0f * powf(Gravity * Gravity / (u * fetch), 1.0f / 3.0f);
+
+	std::mt19937 rng(desc.Seed);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+	mH0.resize(static_cast<std::size_t>(n) * n);
+	mOmega.resize(static_cast<std::size_t>(n) * n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		for (int j = 0; j < n; ++j)
+		{
+			const int ki = i < n / 2 ? i : i - n;
+			const int kj = j < n / 2 ? j : j - n;
+			const float kx = kj * dk;
+			const float ky = ki * dk;
+			const float k = sqrtf(kx * kx + ky * ky);
+			const float omega = sqrtf(Gravity * k);
+
+			// Always draw, so the pattern only depends on the seed.
+			const float xr = gauss(rng);
+			const float xi = gauss(rng);
+
+			float amplitude = 0.0f;
+
+			// The Nyquist row/column has no mirrored partner; leaving it
+			// out keeps every field exactly real.
+			if (k > 0.0f && ki != -n / 2 && kj != -n / 2)
+			{
+				if (desc.Spectrum == OceanSpectrum::Phillips)
+				{
+					float cosine = (kx * wx + ky * wy) / k;
+					float k2 = k * k;
+					float p = desc.Amplitude * expf(-1.0f / (k2 * largest * largest)) / (k2 * k2) *
+						cosine * cosine * expf(-k2 * smallest * smallest);
+					amplitude = sqrtf(0.5f * p) * dk;
+				}
+				else
+				{
+					float sigma = omega <= peak ? 0.07f : 0.09f;
+					float d = (omega - peak) / (sigma * peak);
+					float r = expf(-0.5f * d * d);
+					float ratio = peak / omega;
+					float s = alpha * Gravity * Gravity / powf(omega, 5.0f) *
+						expf(-1.25f * ratio * ratio * ratio * ratio) * powf(desc.PeakEnhancement, r);
+
+					float theta = atan2f(ky, kx) - windAngle;
+					float spread = cosf(theta);
+					spread = spread > 0.0f ? (2.0f / Pi) * spread * spread : 0.0f;
+
+					// S(omega) d(omega)/dk / k: per unit area of k-space.
+					float sk = s * (Gravity / (2.0f * omega)) / k * spread;
+					amplitude = sqrtf(sk) * dk;
+				}
+			}
+
+			mH0[i * n + j].Re = xr * amplitude;
+			mH0[i * n + j].Im = xi * amplitude;
+			mOmega[i * n + j] = omega;
+		}
+	}
+}
+
+void FftOcean::Update(float dt)
+{
+	mTime += dt;
+
+	EvaluateSpectrum();
+
+	Complex* fields = mFields.data();
+	const int n = mSize;
+
+	// All four grids at once: rows first, then column strips.
+	mPool->ParallelFor(0, 4 * n, mRowGrain, [this, fields, n](int first, int last)
+		{
+			for (int r = first; r < last;)
+			{
+				int grid = r / n;
+				int end = std::min(last, (grid + 1) * n);
+				FftRows(fields + static_cast<std::size_t>(grid) * n * n, r - grid * n, end - grid * n);
+				r = end;
+			}
+		});
+
+	const int strips = (n + ColumnStrip - 1) / ColumnStrip;
+	mPool->ParallelFor(0, 4 * strips, 1, [this, fields, n, strips](int first, int last)
+		{
+			for (int s = first; s < last; ++s)
+			{
+				int grid = s / strips;
+				int c0 = (s % strips) * ColumnStrip;
+				FftColumns(fields + static_cast<std::size_t>(grid) * n * n, c0, std::min(c0 + ColumnStrip, n));
+			}
+		});
+
+	Assemble();
+}
+
+void FftOcean::EvaluateSpectrum()
+{
+	const int n = mSize;
+	const std::size_t count = static_cast<std::size_t>(n) * n;
+	const float dk = 2.0f * Pi / (n * mSpatialStep);
+
+	Complex* f0 = mFields.data();
+	Complex* f1 = f0 + count;
+	Complex* f2 = f1 + count;
+	Complex* f3 = f2 + count;
+
+	mPool->ParallelFor(0, n, mRowGrain, [=](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				const int ki = i < n / 2 ? i : i - n;
+				const float ky = ki * dk;
+				const int mi = (n - i) % n;
+
+				for (int j = 0; j < n; ++j)
+				{
+					const int idx = i * n + j;
+					const int kj = j < n / 2 ? j : j - n;
+					const float kx = kj * dk;
+					const float k = sqrtf(kx * kx + ky * ky);
+
+					if (k == 0.0f)
+					{
+						f0[idx] = f1[idx] = f2[idx] = f3[idx] = Complex{ 0.0f, 0.0f };
+						continue;
+					}
+
+					// h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t)
+					const Complex a = mH0[idx];
+					const Complex b = mH0[mi * n + (n - j) % n];
+					const float c = cosf(mOmega[idx] * mTime);
+					const float s = sinf(mOmega[idx] * mTime);
+					const float hr = (a.Re + b.Re) * c - (a.Im + b.Im) * s;
+					const float hi = (a.Re - b.Re) * s + (a.Im - b.Im) * c;
+
+					// Displacement -i k/|k| h, slope i k h and the displacement
+					// derivatives (k k^T / |k|) h.
+					const float invK = 1.0f / k;
+					const float dxr = kx * invK * hi, dxi = -kx * invK * hr;
+					const float dyr = ky * invK * hi, dyi = -ky * invK * hr;
+					const float sxr = -kx * hi, sxi = kx * hr;
+					const float syr = -ky * hi, syi = ky * hr;
+					const float xx = kx * kx * invK, yy = ky * ky * invK, xy = kx * ky * invK;
+
+					// Two real fields per grid: A + iB.
+					f0[idx] = Complex{ hr - dxi, hi + dxr };
+					f1[idx] = Complex{ dyr - sxi, dyi + sxr };
+					f2[idx] = Complex{ syr - xx * hi, syi + xx * hr };
+					f3[idx] = Complex{ yy * hr - xy * hi, yy * hi + xy * hr };
+				}
+			}
+		});
+}
+
+void FftOcean::Assemble()
+{
+	const int n = mSize;
+	const std::size_t count = static_cast<std::size_t>(n) * n;
+	const float halfSize = 0.5f * (n - 1) * mSpatialStep;
+	const float lambda = mChoppiness;
+
+	const Complex* f0 = mFields.data();
+	const Complex* f1 = f0 + count;
+	const Complex* f2 = f1 + count;
+	const Complex* f3 = f2 + count;
+
+	mPool->ParallelFor(0, n, mRowGrain, [=](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				for (int j = 0; j < n; ++j)
+				{
+					const int idx = i * n + j;
+					const float h = f0[idx].Re, dx = f0[idx].Im;
+					const float dy = f1[idx].Re, sx = f1[idx].Im;
+					const float sy = f2[idx].Re, dxx = f2[idx].Im;
+					const float dyy = f3[idx].Re, dxy = f3[idx].Im;
+
+					// Rows run toward -z, so the row-axis displacement and
+					// derivatives flip sign in world space.
+					mPositions[idx] = XMFLOAT3(
+						-halfSize + j * mSpatialStep + lambda * dx,
+						h,
+						halfSize - i * mSpatialStep - lambda * dy);
+
+					// Partial derivatives of the displaced surface along world x and z.
+					XMVECTOR px = XMVectorSet(1.0f + lambda * dxx, sx, -lambda * dxy, 0.0f);
+					XMVECTOR pz = XMVectorSet(-lambda * dxy, -sy, 1.0f + lambda * dyy, 0.0f);
+
+					XMStoreFloat3(&mNormals[idx], XMVector3Normalize(XMVector3Cross(pz, px)));
+					XMStoreFloat3(&mTangentX[idx], XMVector3Normalize(px));
+				}
+			}
+		});
+}
+
+void FftOcean::FftRows(Complex* grid, int first, int last) const
+{
+	const int n = mSize;
+
+	for (int r = first; r < last; ++r)
+	{
+		Complex* x = grid + static_cast<std::size_t>(r) * n;
+
+		for (int i = 0; i < n; ++i)
+		{
+			int j = mBitReverse[i];
+			if (j > i)
+				std::swap(x[i], x[j]);
+		}
+
+		for (int size = 2; size <= n; size *= 2)
+		{
+			const int half = size / 2;
+			const int step = n / size;
+			for (int start = 0; start < n; start += size)
+			{
+				for (int k = 0; k < half; ++k)
+				{
+					const Complex w = mTwiddles[k * step];
+					Complex& a = x[start + k];
+					Complex& b = x[start + k + half];
+					const float tr = b.Re * w.Re - b.Im * w.Im;
+					const float ti = b.Re * w.Im + b.Im * w.Re;
+					b.Re = a.Re - tr;
+					b.Im = a.Im - ti;
+					a.Re += tr;
+					a.Im += ti;
+				}
+			}
+		}
+	}
+}
+
+void FftOcean::FftColumns(Complex* grid, int c0, int c1) const
+{
+	// The same radix-2 passes as FftRows, but every "element" is a row of
+	// the strip [c0, c1), so each butterfly is a short contiguous loop.
+	// The strip is gathered first: in place, its rows are a power-of-two
+	// stride apart and would all fight over the same cache sets.
+	const int n = mSize;
+	const int width = c1 - c0;
+
+	thread_local std::vector<Complex> strip;
+	strip.resize(static_cast<std::size_t>(n) * ColumnStrip);
+
+	for (int i = 0; i < n; ++i)
+	{
+		const Complex* src = grid + static_cast<std::size_t>(i) * n + c0;
+		std::copy(src, src + width, &strip[static_cast<std::size_t>(mBitReverse[i]) * ColumnStrip]);
+	}
+
+	for (int size = 2; size <= n; size *= 2)
+	{
+		const int half = size / 2;
+		const int step = n / size;
+		for (int start = 0; start < n; start += size)
+		{
+			for (int k = 0; k < half; ++k)
+			{
+				const Complex w = mTwiddles[k * step];
+				Complex* a = &strip[static_cast<std::size_t>(start + k) * ColumnStrip];
+				Complex* b = &strip[static_cast<std::size_t>(start + k + half) * ColumnStrip];
+				for (int c = 0; c < width; ++c)
+				{
+					const float tr = b[c].Re * w.Re - b[c].Im * w.Im;
+					const float ti = b[c].Re * w.Im + b[c].Im * w.Re;
+					b[c].Re = a[c].Re - tr;
+					b[c].Im = a[c].Im - ti;
+					a[c].Re += tr;
+					a[c].Im += ti;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		const Complex* src = &strip[static_cast<std::size_t>(i) * ColumnStrip];
+		std::copy(src, src + width, grid + static_cast<std::size_t>(i) * n + c0);
+	}
+}
+
+void FftOcean::WriteVertices(void* dst, const WavesVertexLayout& layout) const
+{
+	unsigned char* base = static_cast<unsigned char*>(dst);
+	const int n = mSize;
+	const float dt = n > 1 ? 1.0f / (n - 1) : 0.0f;
+
+	mPool->ParallelFor(0, n, mRowGrain, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				for (int j = 0; j < n; ++j)
+				{
+					const int idx = i * n + j;
+					unsigned char* v = base + static_cast<std::size_t>(idx) * layout.Stride;
+
+					std::memcpy(v + layout.PositionOffset, &mPositions[idx], sizeof(XMFLOAT3));
+					if (layout.NormalOffset != WavesVertexLayout::NoAttribute)
+						std::memcpy(v + layout.NormalOffset, &mNormals[idx], sizeof(XMFLOAT3));
+					if (layout.TexCOffset != WavesVertexLayout::NoAttribute)
+					{
+						const float uv[2] = { j * dt, i * dt };
+						std::memcpy(v + layout.TexCOffset, uv, sizeof(uv));
+					}
+				}
+			}
+		});
+}
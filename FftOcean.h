@@ -0,0 +1,135 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "WavesSimd.h"
+
+class ThreadPool;
+
+enum class OceanSpectrum : int
+{
+	// Tessendorf's Phillips spectrum: fully developed sea, amplitude set by
+	// FftOceanDesc::Amplitude.
+	Phillips = 0,
+
+	// JONSWAP (fetch-limited) with cos^2 directional spreading.  Heights come
+	// out in world units, derived from wind speed and fetch.
+	Jonswap
+};
+
+struct FftOceanDesc
+{
+	// Grid points per side; a power of two.
+	int Size = 128;
+
+	// World size of one periodic tile.  The grid spacing is PatchSize / Size.
+	float PatchSize = 128.0f;
+
+	OceanSpectrum Spectrum = OceanSpectrum::Phillips;
+
+	// Wind direction (world x, z; need not be normalized) and speed in m/s.
+	DirectX::XMFLOAT2 WindDirection = { 1.0f, 0.0f };
+	float WindSpeed = 10.0f;
+
+	// Phillips only.  Scales the spectral density, so the wave heights do
+	// not depend on Size.
+	float Amplitude = 4e-4f;
+
+	// JONSWAP only: fetch in meters and peak enhancement (gamma).
+	float Fetch = 100000.0f;
+	float PeakEnhancement = 3.3f;
+
+	// Horizontal (choppy) displacement scale; 0 gives plain height waves.
+	float Choppiness = 1.0f;
+
+	unsigned Seed = 1;
+};
+
+// Spectral ocean after Tessendorf, "Simulating Ocean Water".
+//
+// Unlike Waves, nothing is integrated: every Update evaluates the spectrum
+// at the current time and inverse-transforms it, so the time step is free
+// and the result is unconditionally stable.  The surface repeats every
+// PatchSize.
+//
+// Heights, choppy displacement and the exact derivatives of both come from
+// eight real fields packed into four complex 2D FFTs, so the normals are
+// analytic rather than finite differences.
+//
+// Exposes the same surface as Waves (Position/Normal/TangentX/VertexCount,
+// WriteVertices) with the same row-major layout, so it can drive the same
+// grid index buffer.
+class FftOcean
+{
+public:
+	explicit FftOcean(const FftOceanDesc& desc);
+	FftOcean(const FftOcean& rhs) = delete;
+	FftOcean& operator=(const FftOcean& rhs) = delete;
+	~FftOcean();
+
+	int RowCount() const { return mSize; }
+	int ColumnCount() const { return mSize; }
+	int VertexCount() const { return mSize * mSize; }
+	int TriangleCount() const { return 2 * (mSize - 1) * (mSize - 1); }
+	float Width() const { return (mSize - 1) * mSpatialStep; }
+	float Depth() const { return (mSize - 1) * mSpatialStep; }
+	float SpatialStep() const { return mSpatialStep; }
+
+	DirectX::XMFLOAT3 Position(int i) const { return mPositions[i]; }
+	const DirectX::XMFLOAT3& Normal(int i) const { return mNormals[i]; }
+	const DirectX::XMFLOAT3& TangentX(int i) const { return mTangentX[i]; }
+
+	// Seconds of simulated time.
+	float Time() const { return mTime; }
+
+	// Advances the clock by dt and rebuilds the surface.
+	void Update(float dt);
+
+	// Same as Waves::WriteVertices.  The positions include the choppy
+	// displacement; the texture coordinates are the undisplaced grid UVs.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout) const;
+
+	// Pool that runs the spectrum, FFT and assembly loops.  Defaults to
+	// ThreadPool::Default().
+	ThreadPool* Pool() const { return mPool; }
+	void SetThreadPool(ThreadPool* pool);
+
+private:
+	struct Complex
+	{
+		float Re;
+		float Im;
+	};
+
+	void BuildSpectrum(const FftOceanDesc& desc);
+	void EvaluateSpectrum();
+	void Assemble();
+
+	void FftRows(Complex* grid, int first, int last) const;
+	void FftColumns(Complex* grid, int c0, int c1) const;
+
+private:
+	int mSize = 0;
+	int mLogSize = 0;
+	float mSpatialStep = 0.0f;
+	float mChoppiness = 0.0f;
+	float mTime = 0.0f;
+
+	ThreadPool* mPool = nullptr;
+	int mRowGrain = 1;
+
+	// Bit-reversal permutation and twiddles e^(+2 pi i k / size), k < size/2.
+	std::vector<int> mBitReverse;
+	std::vector<Complex> mTwiddles;
+
+	// Initial amplitudes h0(k) and angular frequencies, in FFT order.
+	std::vector<Complex> mH0;
+	std::vector<float> mOmega;
+
+	// The four packed spectra (h + i Dx, Dy + i Sx, Sy + i Dxx, Dyy + i Dxy),
+	// one size*size grid each, transformed in place.
+	std::vector<Complex> mFields;
+
+	std::vector<DirectX::XMFLOAT3> mPositions;
+	std::vector<DirectX::XMFLOAT3> mNormals;
+	std::vector<DirectX::XMFLOAT3> mTangentX;
+};
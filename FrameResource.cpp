@@ -22,6 +22,13 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 	//WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
 }
 
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+	: FrameResource(device, passCount, objectCount, materialCount)
+{
+	WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+	WavesCompactVB = std::make_unique<UploadBuffer<WavesCompactVertex>>(device, waveVertCount, false);
+}
+
 FrameResource::~FrameResource()
 {
 }
@@ -2,6 +2,7 @@
 #include "d3dUtil.h"
 #include "MathHelper.h"
 #include "UploadBuffer.h"
+#include "WavesSimd.h"
 
 struct ObjectConstants
 {
@@ -63,6 +64,7 @@ public:
 	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount);
 	//FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT waveVertCount);
 	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT MaterialCount);
+	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
 	FrameResource(const FrameResource& rhs) = delete;
 	FrameResource& operator=(const FrameResource& rhs) = delete;
 	~FrameResource();
@@ -79,6 +81,15 @@ public:
 
 	std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+	// WavesVB에 마지막으로 기록된 시점의 Waves::DirtyStamp() 값.
+	// 0이면 아직 한 번도 기록되지 않은 것이다.
+	UINT64 WavesStamp = 0;
+
+	// 압축 파도 정점(반정밀도 높이 + 팔면체 법선, 정점당 8바이트).
+	// x, z는 바뀌지 않으므로 별도의 정적 버퍼에 한 번만 올린다.
+	std::unique_ptr<UploadBuffer<WavesCompactVertex>> WavesCompactVB = nullptr;
+	UINT64 WavesCompactStamp = 0;
+
 	// Fence는 현재 울타리 지점까지의 명령들을 표시하는 값이다.
 	// 이 값은 GPU가 아직 이 프레임 자원들을 사용하고 있는지
 	// 판정하는 용도로 쓰인다.
@@ -0,0 +1,321 @@
+#include "GeometryCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	const char Magic[4] = { 'G', 'E', 'O', 'C' };
+	const std::uint32_t Version = 1;
+
+	// Bump whenever GeometryGenerator's output for the same parameters
+	// changes, so stale files on disk are regenerated.
+	const std::uint32_t GeneratorVersion = 1;
+
+	struct FileHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint32_t GeneratorVersion;
+		std::uint32_t VertexSize;
+		std::uint32_t Primitive;
+		std::uint32_t Params[5];
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+	};
+
+	std::uint32_t FloatBits(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	// The mesh as it is shared: with its 16-bit indices already built, which
+	// is the only part of a MeshData that changes after it is generated.
+	GeometryCache::MeshPtr Publish(GeometryGenerator::MeshData&& meshData)
+	{
+		auto shared = std::make_shared<GeometryGenerator::MeshData>(std::move(meshData));
+		if (shared->Vertices.size() <= 0x10000)
+			shared->GetIndices16();
+		return shared;
+	}
+
+	// A name next to path that no other writer, in this process or another,
+	// picks at the same time.
+	std::string TemporaryPath(const std::string& path)
+	{
+		static std::atomic<std::uint64_t> counter(0);
+
+		const std::uint64_t ticks = static_cast<std::uint64_t>(
+			std::chrono::high_resolution_clock::now().time_since_epoch().count());
+		const std::uint64_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+		char suffix[64];
+		std::snprintf(suffix, sizeof(suffix), ".%016llx-%llu.tmp",
+			static_cast<unsigned long long>(ticks ^ (thread * 0x9e3779b97f4a7c15ull)),
+			static_cast<unsigned long long>(counter++));
+		return path + suffix;
+	}
+}
+
+bool GeometryCache::Key::operator==(const Key& rhs) const
+{
+	return Type == rhs.Type && std::memcmp(Params, rhs.Params, sizeof(Params)) == 0;
+}
+
+std::size_t GeometryCache::KeyHash::operator()(const Key& key) const
+{
+	return static_cast<std::size_t>(Fingerprint(key));
+}
+
+// FNV-1a over the type and parameters; also names the files on disk.
+std::uint64_t GeometryCache::Fingerprint(const Key& key)
+{
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&hash](uint32 value)
+	{
+		for (int b = 0; b < 4; ++b)
+		{
+			hash ^= (value >> (8 * b)) & 0xff;
+			hash *= 0x100000001b3ull;
+		}
+	};
+
+	mix(static_cast<uint32>(key.Type));
+	for (uint32 param : key.Params)
+		mix(param);
+	return hash;
+}
+
+GeometryCache::Key GeometryCache::MakeKey(Primitive type, float p0, float p1, float p2, uint32 p3, uint32 p4)
+{
+	Key key;
+	key.Type = type;
+	key.Params[0] = FloatBits(p0);
+	key.Params[1] = FloatBits(p1);
+	key.Params[2] = FloatBits(p2);
+	key.Params[3] = p3;
+	key.Params[4] = p4;
+	return key;
+}
+
+GeometryCache::MeshPtr GeometryCache::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+{
+	return Get(MakeKey(Primitive::Box, width, height, depth, numSubdivisions, 0),
+		[&](GeometryGenerator& geoGen) { return geoGen.CreateBox(width, height, depth, numSubdivisions); });
+}
+
+GeometryCache::MeshPtr GeometryCache::CreateCylinder(float bottomRadius, float topRadius, float height,
+	uint32 sliceCount, uint32 stackCount)
+{
+	return Get(MakeKey(Primitive::Cylinder, bottomRadius, topRadius, height, sliceCount, stackCount),
+		[&](GeometryGenerator& geoGen)
+		{
+			return geoGen.CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount);
+		});
+}
+
+GeometryCache::MeshPtr GeometryCache::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+{
+	return Get(MakeKey(Primitive::Sphere, radius, 0.0f, 0.0f, sliceCount, stackCount),
+		[&](GeometryGenerator& geoGen) { return geoGen.CreateSphere(radius, sliceCount, stackCount); });
+}
+
+GeometryCache::MeshPtr GeometryCache::CreateGeosphere(float radius, uint32 numSubdivisions)
+{
+	return Get(MakeKey(Primitive::Geosphere, radius, 0.0f, 0.0f, numSubdivisions, 0),
+		[&](GeometryGenerator& geoGen) { return geoGen.CreateGeosphere(radius, numSubdivisions); });
+}
+
+GeometryCache::MeshPtr GeometryCache::CreateGrid(float width, float depth, uint32 m, uint32 n)
+{
+	return Get(MakeKey(Primitive::Grid, width, depth, 0.0f, m, n),
+		[&](GeometryGenerator& geoGen) { return geoGen.CreateGrid(width, depth, m, n); });
+}
+
+// Generating and reading happen outside the lock, so a large mesh does not
+// hold up requests for others.  Two threads asking for the same new mesh
+// may both build it; the first one stored is the one everybody gets.
+template <typename Generate>
+GeometryCache::MeshPtr GeometryCache::Get(const Key& key, const Generate& generate)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mMeshes.find(key);
+		if (it != mMeshes.end())
+		{
+			++mStats.Hits;
+			return it->second;
+		}
+	}
+
+	bool fromDisk = true;
+	MeshPtr meshData = LoadFromDisk(key);
+	if (meshData == nullptr)
+	{
+		fromDisk = false;
+
+		GeometryGenerator geoGen;
+		meshData = Publish(generate(geoGen));
+		SaveToDisk(key, *meshData);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (fromDisk)
+		++mStats.DiskHits;
+	else
+		++mStats.Misses;
+	return mMeshes.emplace(key, meshData).first->second;
+}
+
+// Empty for a mesh that never goes to disk.  A grid is only positions laid
+// out in rows, which is quicker to generate than to read back.
+std::string GeometryCache::DiskPath(const Key& key) const
+{
+	static const char* const Names[] = { "box", "cylinder", "sphere", "geosphere", "grid" };
+
+	if (key.Type == Primitive::Grid)
+		return std::string();
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "%s-%016llx.geo", Names[static_cast<uint32>(key.Type)],
+		static_cast<unsigned long long>(Fingerprint(key)));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mDiskDirectory.empty())
+		return std::string();
+
+	const char last = mDiskDirectory.back();
+	return mDiskDirectory + (last == '/' || last == '\\' ? "" : "/") + name;
+}
+
+GeometryCache::MeshPtr GeometryCache::LoadFromDisk(const Key& key) const
+{
+	const std::string path = DiskPath(key);
+	if (path.empty())
+		return nullptr;
+
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return nullptr;
+
+	const std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+
+	FileHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return nullptr;
+
+	if (std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0 || header.Version != Version ||
+		header.GeneratorVersion != GeneratorVersion || header.VertexSize != sizeof(GeometryGenerator::Vertex) ||
+		header.Primitive != static_cast<uint32>(key.Type) ||
+		std::memcmp(header.Params, key.Params, sizeof(key.Params)) != 0)
+		return nullptr;
+
+	// A truncated file, or one whose counts are garbage, is regenerated
+	// before anything is allocated for it.
+	const std::uint64_t expectedSize = sizeof(header) +
+		static_cast<std::uint64_t>(header.VertexCount) * sizeof(GeometryGenerator::Vertex) +
+		static_cast<std::uint64_t>(header.IndexCount) * sizeof(uint32);
+	if (fileSize < 0 || static_cast<std::uint64_t>(fileSize) != expectedSize)
+		return nullptr;
+
+	GeometryGenerator::MeshData meshData;
+	meshData.Vertices.resize(header.VertexCount);
+	meshData.Indices32.resize(header.IndexCount);
+	file.read(reinterpret_cast<char*>(meshData.Vertices.data()),
+		static_cast<std::streamsize>(meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex)));
+	file.read(reinterpret_cast<char*>(meshData.Indices32.data()),
+		static_cast<std::streamsize>(meshData.Indices32.size() * sizeof(uint32)));
+	if (!file)
+		return nullptr;
+
+	for (uint32 index : meshData.Indices32)
+	{
+		if (index >= header.VertexCount)
+			return nullptr;
+	}
+
+	return Publish(std::move(meshData));
+}
+
+// Written under a temporary name of its own and renamed into place, so a
+// reader never sees a half-written file and two writers never share one.
+void GeometryCache::SaveToDisk(const Key& key, const GeometryGenerator::MeshData& meshData) const
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (meshData.Vertices.size() < mDiskMinVertices)
+			return;
+	}
+
+	const std::string path = DiskPath(key);
+	if (path.empty())
+		return;
+
+	FileHeader header = {};
+	std::memcpy(header.Magic, Magic, sizeof(Magic));
+	header.Version = Version;
+	header.GeneratorVersion = GeneratorVersion;
+	header.VertexSize = sizeof(GeometryGenerator::Vertex);
+	header.Primitive = static_cast<uint32>(key.Type);
+	std::memcpy(header.Params, key.Params, sizeof(key.Params));
+	header.VertexCount = static_cast<uint32>(meshData.Vertices.size());
+	header.IndexCount = static_cast<uint32>(meshData.Indices32.size());
+
+	const std::string temporary = TemporaryPath(path);
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(meshData.Vertices.data()),
+			static_cast<std::streamsize>(meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex)));
+		file.write(reinterpret_cast<const char*>(meshData.Indices32.data()),
+			static_cast<std::streamsize>(meshData.Indices32.size() * sizeof(uint32)));
+		if (!file)
+		{
+			file.close();
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+
+	// rename does not replace an existing file on Windows.
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		std::remove(temporary.c_str());
+}
+
+void GeometryCache::SetDiskDirectory(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mDiskDirectory = directory;
+}
+
+void GeometryCache::SetDiskMinVertices(std::size_t vertexCount)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mDiskMinVertices = vertexCount;
+}
+
+void GeometryCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMeshes.clear();
+}
+
+GeometryCache::Stats GeometryCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+GeometryCache& GeometryCache::Default()
+{
+	static GeometryCache cache;
+	return cache;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "GeometryGenerator.h"
+
+// Generated primitives keyed by their type and parameters.  The first
+// request for a shape generates it; every later one with the same
+// parameters gets the same mesh back without copying it.  Meshes are shared
+// and immutable: callers copy what they need into their own buffers.
+//
+// Each mesh whose vertices fit in 16 bits has its 16-bit indices built
+// before it is shared; read them with CachedIndices16.  Larger meshes have
+// none.
+//
+// With a disk directory set, meshes of at least DiskMinVertices vertices
+// are also stored there and read back by later runs instead of being
+// generated again.  Smaller ones, and grids of any size, are faster to
+// generate than to read.
+// A file from another generator version or of another shape is ignored.
+//
+// All methods are thread-safe.
+class GeometryCache
+{
+public:
+	using MeshPtr = std::shared_ptr<const GeometryGenerator::MeshData>;
+	using uint32 = GeometryGenerator::uint32;
+
+	struct Stats
+	{
+		// Requests served from memory, from disk, and generated.
+		std::uint64_t Hits = 0;
+		std::uint64_t DiskHits = 0;
+		std::uint64_t Misses = 0;
+	};
+
+	// Same parameters as the GeometryGenerator functions.
+	MeshPtr CreateBox(float width, float height, float depth, uint32 numSubdivisions);
+	MeshPtr CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+	MeshPtr CreateSphere(float radius, uint32 sliceCount, uint32 stackCount);
+	MeshPtr CreateGeosphere(float radius, uint32 numSubdivisions);
+	MeshPtr CreateGrid(float width, float depth, uint32 m, uint32 n);
+
+	// Empty (the default) keeps the cache in memory only.  The directory
+	// must exist.
+	void SetDiskDirectory(const std::string& directory);
+	void SetDiskMinVertices(std::size_t vertexCount);
+
+	// Forgets the meshes in memory; ones still held elsewhere stay valid.
+	void Clear();
+
+	Stats GetStats() const;
+
+	// Shared cache used by the sample apps.
+	static GeometryCache& Default();
+
+private:
+	enum class Primitive : uint32
+	{
+		Box,
+		Cylinder,
+		Sphere,
+		Geosphere,
+		Grid
+	};
+
+	// Float parameters are stored by their bits, so only exactly equal
+	// parameters share a mesh.
+	struct Key
+	{
+		Primitive Type = Primitive::Box;
+		uint32 Params[5] = {};
+
+		bool operator==(const Key& rhs) const;
+	};
+
+	struct KeyHash
+	{
+		std::size_t operator()(const Key& key) const;
+	};
+
+	template <typename Generate>
+	MeshPtr Get(const Key& key, const Generate& generate);
+
+	std::string DiskPath(const Key& key) const;
+	MeshPtr LoadFromDisk(const Key& key) const;
+	void SaveToDisk(const Key& key, const GeometryGenerator::MeshData& meshData) const;
+
+	static Key MakeKey(Primitive type, float p0, float p1, float p2, uint32 p3, uint32 p4);
+	static std::uint64_t Fingerprint(const Key& key);
+
+	mutable std::mutex mMutex;
+	std::unordered_map<Key, MeshPtr, KeyHash> mMeshes;
+	std::string mDiskDirectory;
+	std::size_t mDiskMinVertices = 16 * 1024;
+	Stats mStats;
+};
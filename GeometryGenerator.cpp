@@ -1,7 +1,54 @@
 ﻿#include "GeometryGenerator.h"
+#include "ThreadPool.h"
 #include <algorithm>
+#include <cassert>
 using namespace DirectX;
 
+namespace
+{
+	// Below this many items (vertices or quads) a primitive is generated on
+	// the calling thread; handing out the work would cost more than it saves.
+	const size_t ParallelThreshold = 64 * 1024;
+
+	// Calls func(first, last) over row bands covering [0, rowCount), on the
+	// shared pool when rowCount * rowLength items are enough to be worth it.
+	// Every row is independent, so the result does not depend on the split.
+	template <typename Func>
+	void ForEachRow(GeometryGenerator::uint32 rowCount, GeometryGenerator::uint32 rowLength, const Func& func)
+	{
+		if (rowCount == 0)
+			return;
+
+		if (static_cast<size_t>(rowCount) * rowLength < ParallelThreshold)
+		{
+			func(0, rowCount);
+			return;
+		}
+
+		ThreadPool& pool = ThreadPool::Default();
+		const int rows = static_cast<int>(rowCount);
+		const int grain = std::max(1, rows / (4 * pool.ThreadCount()));
+		pool.ParallelFor(0, rows, grain, [&](int first, int last)
+		{
+			func(static_cast<GeometryGenerator::uint32>(first), static_cast<GeometryGenerator::uint32>(last));
+		});
+	}
+
+	// cosf(j * step) and sinf(j * step) for j = 0..count, the same values the
+	// per-vertex calls produced.
+	void BuildCircleTable(GeometryGenerator::uint32 count, float step, std::vector<float>& cosines, std::vector<float>& sines)
+	{
+		cosines.resize(count + 1);
+		sines.resize(count + 1);
+		for (GeometryGenerator::uint32 j = 0; j <= count; j++)
+		{
+			cosines[j] = cosf(j * step);
+			sines[j] = sinf(j * step);
+		}
+	}
+}
+
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
 	MeshData meshData;
@@ -99,6 +146,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 {
 	MeshData meshData;
 
+	// 아래의 개수 계산은 부호 없는 정수라서 조각이 3개, 더미가 1개보다 적으면
+	// 넘쳐 버린다. 그런 원기둥은 빈 메시로 돌려준다.
+	assert(sliceCount >= 3 && stackCount >= 1);
+	if (sliceCount < 3 || stackCount < 1)
+		return meshData;
+
 	/*
 		더미들을 만든다.
 	*/
@@ -110,82 +163,100 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 
 	uint32 ringCount = stackCount + 1;
 
-	// 최하단 고리에서 최상단 고리로 올라가면서 각 고리의 정점들을 계산한다.
-	for (uint32 i = 0; i < ringCount; i++)
-	{
-		float y = -0.5f * height + i * stackHeight;
-		float r = bottomRadius + i * radiusStep;
-
-		// 고리의 정점들.
-		float dTheta = 2.0f * DirectX::XM_PI / sliceCount;
-		for (uint32 j = 0; j <= sliceCount; j++)
-		{
-			Vertex vertex;
-
-			float c = cosf(j * dTheta);
-			float s = sinf(j * dTheta);
-
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
-			vertex.TexC.x = static_cast<float>(j) / sliceCount;
-			vertex.TexC.y = 1.0f - static_cast<float>(i) / stackCount;
-
-			/*
-				원기둥을 다음과 같이 매개변수화할 수 있다. 이를 위해
-				텍스처 좌표 v 성분과 동일한 방향으로 나아가는 매개변수 v를
-				도입했다. 이렇게 하면 종접선(bitangent)이 텍스처 좌표 v 성분과 동일한 방향이 된다.
-				밑면 반지름 r0, 윗면 반지름 r1이라고 할 때,
-				[0, 1] 구간의 v에 대해:
-				y(v) = h - hv
-				r(v) = r1 + (r0-r1)v
-
-				x(t, v) = r(v) * cos(t)
-				y(t, v) = h - hv;
-				z(t, v) = r(v) * sin(t)
-
-				dx/dt = -r(v) * sin(t)
-				dy/dt = 0
-				dz/dt = +r(v) * cos(t)
-
-				dx/dv = (r0-r1) * cos(t)
-				dy/dv = -h
-				dz/dv = (r0-r1) * sin(t)
-			*/
-
-			// TangentU는 단위 길이 벡터이다.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius - topRadius;
-			XMFLOAT3 bitanget(dr * c, -height, dr * s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitanget);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
-	}
-
 	/*
 		한 고리의 첫 정점과 마지막 정점은 위치가 같지만 텍스처 좌표들이 다르므로
 		서로 다른 정점으로 간주해야 한다. 이를 위해 고리의 정점 개수에 1을 더한다.
 	*/
 	uint32 ringVertexCount = sliceCount + 1;
 
-	// 각 더미의 색인들을 구한다.
-	for (uint32 i = 0; i < stackCount; i++)
+	// 옆면과 두 마개의 정점, 색인 개수를 미리 구해서 한 번에 할당한다.
+	meshData.Vertices.reserve(ringCount * ringVertexCount + 2 * (ringVertexCount + 1));
+	meshData.Indices32.reserve(6 * stackCount * sliceCount + 2 * 3 * sliceCount);
+	meshData.Vertices.resize(ringCount * ringVertexCount);
+
+	// 고리마다 같은 각도들을 쓰므로 cos, sin 값을 한 번만 계산한다.
+	float dTheta = 2.0f * DirectX::XM_PI / sliceCount;
+	std::vector<float> cosines, sines;
+	BuildCircleTable(sliceCount, dTheta, cosines, sines);
+
+	// 최하단 고리에서 최상단 고리로 올라가면서 각 고리의 정점들을 계산한다.
+	// 고리들은 서로 독립적이므로 큰 원기둥은 여러 스레드가 나누어 계산한다.
+	ForEachRow(ringCount, ringVertexCount, [&](uint32 first, uint32 last)
 	{
-		for (uint32 j = 0; j < sliceCount; j++)
+		for (uint32 i = first; i < last; i++)
 		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
+			float y = -0.5f * height + i * stackHeight;
+			float r = bottomRadius + i * radiusStep;
+
+			// 고리의 정점들.
+			for (uint32 j = 0; j <= sliceCount; j++)
+			{
+				Vertex& vertex = meshData.Vertices[i * ringVertexCount + j];
+
+				float c = cosines[j];
+				float s = sines[j];
+
+				vertex.Position = XMFLOAT3(r * c, y, r * s);
+				vertex.TexC.x = static_cast<float>(j) / sliceCount;
+				vertex.TexC.y = 1.0f - static_cast<float>(i) / stackCount;
+
+				/*
+					원기둥을 다음과 같이 매개변수화할 수 있다. 이를 위해
+					텍스처 좌표 v 성분과 동일한 방향으로 나아가는 매개변수 v를
+					도입했다. 이렇게 하면 종접선(bitangent)이 텍스처 좌표 v 성분과 동일한 방향이 된다.
+					밑면 반지름 r0, 윗면 반지름 r1이라고 할 때,
+					[0, 1] 구간의 v에 대해:
+					y(v) = h - hv
+					r(v) = r1 + (r0-r1)v
+
+					x(t, v) = r(v) * cos(t)
+					y(t, v) = h - hv;
+					z(t, v) = r(v) * sin(t)
+
+					dx/dt = -r(v) * sin(t)
+					dy/dt = 0
+					dz/dt = +r(v) * cos(t)
+
+					dx/dv = (r0-r1) * cos(t)
+					dy/dv = -h
+					dz/dv = (r0-r1) * sin(t)
+				*/
+
+				// TangentU는 단위 길이 벡터이다.
+				vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
+
+				float dr = bottomRadius - topRadius;
+				XMFLOAT3 bitanget(dr * c, -height, dr * s);
+
+				XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
+				XMVECTOR B = XMLoadFloat3(&bitanget);
+				XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+				XMStoreFloat3(&vertex.Normal, N);
+			}
+		}
+	});
 
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
+	// 각 더미의 색인들을 구한다.
+	meshData.Indices32.resize(6 * stackCount * sliceCount);
+	ForEachRow(stackCount, ringVertexCount, [&](uint32 first, uint32 last)
+	{
+		for (uint32 i = first; i < last; i++)
+		{
+			uint32* k = &meshData.Indices32[6 * i * sliceCount];
+			for (uint32 j = 0; j < sliceCount; j++)
+			{
+				k[0] = i * ringVertexCount + j;
+				k[1] = (i + 1) * ringVertexCount + j;
+				k[2] = (i + 1) * ringVertexCount + j + 1;
+
+				k[3] = i * ringVertexCount + j;
+				k[4] = (i + 1) * ringVertexCount + j + 1;
+				k[5] = i * ringVertexCount + j + 1;
+
+				k += 6;
+			}
 		}
-	}
+	});
 
 	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
 	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
@@ -197,72 +268,101 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 {
 	MeshData meshData;
 
+	// 극점 사이에 띠가 하나라도 있어야 stackCount - 1, stackCount - 2가
+	// 넘치지 않는다. 그보다 거친 구는 빈 메시로 돌려준다.
+	assert(sliceCount >= 3 && stackCount >= 2);
+	if (sliceCount < 3 || stackCount < 2)
+		return meshData;
+
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back(topVertex);
+	uint32 ringVertexCount = sliceCount + 1;
+	uint32 ringCount = stackCount - 1;
+
+	// 두 극점과 고리들의 정점, 두 극점의 부채꼴과 고리 사이 띠들의 색인 개수.
+	meshData.Vertices.resize(2 + ringCount * ringVertexCount);
+	meshData.Indices32.resize(6 * sliceCount * (stackCount - 1));
+
+	meshData.Vertices.front() = topVertex;
+	meshData.Vertices.back() = bottomVertex;
 
 	float phiStep = XM_PI / stackCount;
 	float thetaStep = 2.0f * XM_PI / sliceCount;
 
+	// 모든 고리가 같은 경도들을 쓰므로 cos, sin 값을 한 번만 계산한다.
+	std::vector<float> cosines, sines;
+	BuildCircleTable(sliceCount, thetaStep, cosines, sines);
+
 	// 각 더미의 고리에 대한 정점을 계산한다.
-	for (uint32 i = 1; i <= stackCount - 1; i++)
+	ForEachRow(ringCount, ringVertexCount, [&](uint32 first, uint32 last)
 	{
-		float phi = i * phiStep;
-
-		// 고리의 정점.
-		for (uint32 j = 0; j <= sliceCount; j++)
+		for (uint32 i = first + 1; i <= last; i++)
 		{
-			float theta = j * thetaStep;
+			float phi = i * phiStep;
+			float sinPhi = sinf(phi);
+			float cosPhi = cosf(phi);
 
-			Vertex v;
+			// 고리의 정점.
+			for (uint32 j = 0; j <= sliceCount; j++)
+			{
+				float theta = j * thetaStep;
 
-			v.Position.x = radius * sinf(phi) * cosf(theta);
-			v.Position.y = radius * cosf(phi);
-			v.Position.z = radius * sinf(phi) * sinf(theta);
+				Vertex& v = meshData.Vertices[1 + (i - 1) * ringVertexCount + j];
 
-			v.TangentU.x = -radius * sinf(phi) * sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius * sinf(phi) * cosf(theta);
+				v.Position.x = radius * sinPhi * cosines[j];
+				v.Position.y = radius * cosPhi;
+				v.Position.z = radius * sinPhi * sines[j];
 
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+				v.TangentU.x = -radius * sinPhi * sines[j];
+				v.TangentU.y = 0.0f;
+				v.TangentU.z = +radius * sinPhi * cosines[j];
 
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+				XMVECTOR T = XMLoadFloat3(&v.TangentU);
+				XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+				XMVECTOR p = XMLoadFloat3(&v.Position);
+				XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
 
-			meshData.Vertices.push_back(v);
+				v.TexC.x = theta / XM_2PI;
+				v.TexC.y = phi / XM_PI;
+			}
 		}
-	}
-
-	meshData.Vertices.push_back(bottomVertex);
+	});
 
+	uint32* dst = meshData.Indices32.data();
 	for (uint32 i = 1; i <= sliceCount; i++)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i + 1);
-		meshData.Indices32.push_back(i);
+		dst[0] = 0;
+		dst[1] = i + 1;
+		dst[2] = i;
+		dst += 3;
 	}
 
 	uint32 baseIndex = 1;
-	uint32 ringVertexCount = sliceCount + 1;
 
-	for (uint32 i = 0; i < sliceCount - 2; i++)
+	// 고리 사이의 띠들. 더미 수보다 두 개 적다.
+	uint32* bands = dst;
+	ForEachRow(stackCount - 2, ringVertexCount, [&](uint32 first, uint32 last)
 	{
-		for (uint32 j = 0; j < sliceCount; j++)
+		for (uint32 i = first; i < last; i++)
 		{
-			meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-
-			meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(baseIndex + (i + 1) * ringVertexCount + j + 1);
+			uint32* k = bands + 6 * i * sliceCount;
+			for (uint32 j = 0; j < sliceCount; j++)
+			{
+				k[0] = baseIndex + i * ringVertexCount + j;
+				k[1] = baseIndex + i * ringVertexCount + j + 1;
+				k[2] = baseIndex + (i + 1) * ringVertexCount + j;
+
+				k[3] = baseIndex + (i + 1) * ringVertexCount + j;
+				k[4] = baseIndex + i * ringVertexCount + j + 1;
+				k[5] = baseIndex + (i + 1) * ringVertexCount + j + 1;
+
+				k += 6;
+			}
 		}
-	}
+	});
+	dst += 6 * (stackCount - 2) * sliceCount;
 
 	uint32 southPoleIndex = static_cast<uint32>(meshData.Vertices.size() - 1);
 
@@ -270,9 +370,10 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
 	for (uint32 i = 0; i < sliceCount; i++)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i + 1);
+		dst[0] = southPoleIndex;
+		dst[1] = baseIndex + i;
+		dst[2] = baseIndex + i + 1;
+		dst += 3;
 	}
 
 	return meshData;
@@ -362,6 +463,12 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 {
 	MeshData meshData;
 
+	// 행과 열이 각각 둘은 있어야 칸이 생긴다. m - 1, n - 1이 넘치지 않도록
+	// 그보다 작은 격자는 빈 메시로 돌려준다.
+	assert(m >= 2 && n >= 2);
+	if (m < 2 || n < 2)
+		return meshData;
+
 	uint32 vertexCount = m * n;
 	uint32 faceCount = (m - 1) * (n - 1) * 2;
 
@@ -374,57 +481,111 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n - 1);
 	float dv = 1.0f / (m - 1);
 
+	// 행들은 서로 독립적이므로 큰 격자는 여러 스레드가 나누어 계산한다.
 	meshData.Vertices.resize(vertexCount);
-	for (uint32 i = 0; i < m; i++)
+	ForEachRow(m, n, [&](uint32 first, uint32 last)
 	{
-		float z = halfDepth - i * dz;
-		for (uint32 j = 0; j < n; j++)
+		for (uint32 i = first; i < last; i++)
 		{
-			float x = -halfWidth + j * dx;
-
-			meshData.Vertices[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-
-			// 텍스처가 격자 전체에 입혀지게 된다.
-			meshData.Vertices[i * n + j].TexC.x = j * du;
-			meshData.Vertices[i * n + j].TexC.y = i * dv;
+			float z = halfDepth - i * dz;
+			for (uint32 j = 0; j < n; j++)
+			{
+				float x = -halfWidth + j * dx;
+
+				meshData.Vertices[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
+				meshData.Vertices[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+				meshData.Vertices[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+
+				// 텍스처가 격자 전체에 입혀지게 된다.
+				meshData.Vertices[i * n + j].TexC.x = j * du;
+				meshData.Vertices[i * n + j].TexC.y = i * dv;
+			}
 		}
-	}
+	});
 
 	// 격자 색인 생성.
 	meshData.Indices32.resize(faceCount * 3);	// 면(삼각형)당 색인 3개
 
 	// 각 사각형을 훑으면서 색인들을 계산한다.
-	uint32 k = 0;
-	for (size_t i = 0; i < m-1; i++)
+	ForEachRow(m - 1, n, [&](uint32 first, uint32 last)
 	{
-		for (size_t j = 0; j < n-1; j++)
+		for (uint32 i = first; i < last; i++)
 		{
-			meshData.Indices32[k] = i * n + j;
-			meshData.Indices32[k + 1] = i * n + j + 1;
-			meshData.Indices32[k + 2] = (i + 1) * n + j;
-
-			meshData.Indices32[k + 3] = (i + 1) * n + j;
-			meshData.Indices32[k + 4] = i * n + j + 1;
-			meshData.Indices32[k + 5] = (i + 1) * n + j + 1;
-
-			k += 6;		// 다음 사각형
+			uint32 k = i * (n - 1) * 6;
+			for (uint32 j = 0; j < n - 1; j++)
+			{
+				meshData.Indices32[k] = i * n + j;
+				meshData.Indices32[k + 1] = i * n + j + 1;
+				meshData.Indices32[k + 2] = (i + 1) * n + j;
+
+				meshData.Indices32[k + 3] = (i + 1) * n + j;
+				meshData.Indices32[k + 4] = i * n + j + 1;
+				meshData.Indices32[k + 5] = (i + 1) * n + j + 1;
+
+				k += 6;		// 다음 사각형
+			}
 		}
-	}
+	});
 
 	return meshData;
 }
 
-void GeometryGenerator::Subdivide(MeshData& meshData)
+namespace
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+	const std::uint64_t EmptyEdge = ~0ull;
 
+	// Open-addressing table from an edge (its two vertex indices, smaller
+	// first) to the index of its midpoint vertex.  Sized up front for every
+	// edge the input can have, so it never grows or fills up.
+	class EdgeMidpointTable
+	{
+	public:
+		explicit EdgeMidpointTable(size_t maxEdges)
+		{
+			size_t capacity = 16;
+			while (capacity < 2 * maxEdges)
+				capacity *= 2;
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+			mShift = 64;
+			for (size_t c = capacity; c > 1; c /= 2)
+				--mShift;
+
+			mMask = capacity - 1;
+			mKeys.assign(capacity, EmptyEdge);
+			mValues.resize(capacity);
+		}
+
+		// Index of the midpoint of edge (a, b).  A new edge is given 'next'.
+		std::uint32_t Insert(std::uint32_t a, std::uint32_t b, std::uint32_t next)
+		{
+			const std::uint64_t key = a < b ?
+				(static_cast<std::uint64_t>(a) << 32) | b :
+				(static_cast<std::uint64_t>(b) << 32) | a;
+
+			size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> mShift);
+			while (mKeys[slot] != EmptyEdge)
+			{
+				if (mKeys[slot] == key)
+					return mValues[slot];
+
+				slot = (slot + 1) & mMask;
+			}
+
+			mKeys[slot] = key;
+			mValues[slot] = next;
+			return next;
+		}
 
+	private:
+		std::vector<std::uint64_t> mKeys;
+		std::vector<std::uint32_t> mValues;
+		size_t mMask = 0;
+		int mShift = 0;
+	};
+}
+
+void GeometryGenerator::Subdivide(MeshData& meshData)
+{
 	//       v1
 	//       *
 	//      / \
@@ -435,47 +596,54 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size() / 3;
+	// The input vertices keep their indices; each edge gets one midpoint,
+	// shared by the two triangles on either side of it.  A closed mesh of
+	// V vertices and F triangles grows to V + 3F/2 vertices instead of 6F.
+
+	std::vector<uint32> inputIndices;
+	inputIndices.swap(meshData.Indices32);
+
+	uint32 numTris = (uint32)inputIndices.size() / 3;
+
+	meshData.Vertices.reserve(meshData.Vertices.size() + 3 * (size_t)numTris);
+	meshData.Indices32.resize(inputIndices.size() * 4);
+
+	EdgeMidpointTable midpoints(3 * (size_t)numTris);
+
+	auto midpoint = [&](uint32 a, uint32 b)
+	{
+		uint32 next = (uint32)meshData.Vertices.size();
+		uint32 m = midpoints.Insert(a, b, next);
+		if (m == next)
+			meshData.Vertices.push_back(MidPoint(meshData.Vertices[a], meshData.Vertices[b]));
+
+		return m;
+	};
+
+	uint32* out = meshData.Indices32.data();
 	for (uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 0]];
-		Vertex v1 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 1]];
-		Vertex v2 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 2]];
+		uint32 v0 = inputIndices[i * 3 + 0];
+		uint32 v1 = inputIndices[i * 3 + 1];
+		uint32 v2 = inputIndices[i * 3 + 2];
 
 		//
-		// Generate the midpoints.
+		// Find or generate the midpoints.
 		//
 
-		Vertex m0 = MidPoint(v0, v1);
-		Vertex m1 = MidPoint(v1, v2);
-		Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = midpoint(v0, v1);
+		uint32 m1 = midpoint(v1, v2);
+		uint32 m2 = midpoint(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
-
-		meshData.Indices32.push_back(i * 6 + 0);
-		meshData.Indices32.push_back(i * 6 + 3);
-		meshData.Indices32.push_back(i * 6 + 5);
-
-		meshData.Indices32.push_back(i * 6 + 3);
-		meshData.Indices32.push_back(i * 6 + 4);
-		meshData.Indices32.push_back(i * 6 + 5);
-
-		meshData.Indices32.push_back(i * 6 + 5);
-		meshData.Indices32.push_back(i * 6 + 4);
-		meshData.Indices32.push_back(i * 6 + 2);
-
-		meshData.Indices32.push_back(i * 6 + 3);
-		meshData.Indices32.push_back(i * 6 + 1);
-		meshData.Indices32.push_back(i * 6 + 4);
+		out[0] = v0; out[1] = m0; out[2] = m2;
+		out[3] = m0; out[4] = m1; out[5] = m2;
+		out[6] = m2; out[7] = m1; out[8] = v2;
+		out[9] = m0; out[10] = v1; out[11] = m1;
+		out += 12;
 	}
 }
 
@@ -512,6 +680,11 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
 void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData)
 {
 	uint32 baseIndex = static_cast<uint32>(meshData.Vertices.size());
+	uint32 firstIndex = static_cast<uint32>(meshData.Indices32.size());
+
+	// 테두리 정점들과 중심 정점, 부채꼴 삼각형들.
+	meshData.Vertices.resize(baseIndex + sliceCount + 2);
+	meshData.Indices32.resize(firstIndex + 3 * sliceCount);
 
 	float y = 0.5f * height;
 	float dTheta = 2.0f * XM_PI / sliceCount;
@@ -528,26 +701,31 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		meshData.Vertices[baseIndex + i] = Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// 마개의 중심 정점.
-	meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
-
-	// 중심 정점의 색인.
-	uint32 centerIndex = static_cast<uint32>(meshData.Vertices.size() - 1);
+	uint32 centerIndex = baseIndex + sliceCount + 1;
+	meshData.Vertices[centerIndex] = Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
+	uint32* k = &meshData.Indices32[firstIndex];
 	for (uint32 i = 0; i < sliceCount; i++)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i + 1);
-		meshData.Indices32.push_back(baseIndex + i);
+		k[0] = centerIndex;
+		k[1] = baseIndex + i + 1;
+		k[2] = baseIndex + i;
+		k += 3;
 	}
 }
 
 void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData)
 {
 	uint32 baseIndex = static_cast<uint32>(meshData.Vertices.size());
+	uint32 firstIndex = static_cast<uint32>(meshData.Indices32.size());
+
+	// 테두리 정점들과 중심 정점, 부채꼴 삼각형들.
+	meshData.Vertices.resize(baseIndex + sliceCount + 2);
+	meshData.Indices32.resize(firstIndex + 3 * sliceCount);
 
 	float y = -0.5f * height;
 	float dTheta = 2.0f * XM_PI / sliceCount;
@@ -564,19 +742,19 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		meshData.Vertices[baseIndex + i] = Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// 마개의 중심 정점.
-	meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
-
-	// 중심 정점의 색인.
-	uint32 centerIndex = static_cast<uint32>(meshData.Vertices.size() - 1);
+	uint32 centerIndex = baseIndex + sliceCount + 1;
+	meshData.Vertices[centerIndex] = Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
+	uint32* k = &meshData.Indices32[firstIndex];
 	for (uint32 i = 0; i < sliceCount; i++)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i + 1);
+		k[0] = centerIndex;
+		k[1] = baseIndex + i;
+		k[2] = baseIndex + i + 1;
+		k += 3;
 	}
 }
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
@@ -47,6 +48,15 @@ public:
 			return mIndices16;
 		}
 
+		// The 16-bit indices built by an earlier GetIndices16, as for the
+		// shared meshes of GeometryCache.  A mesh whose vertices fit in 16
+		// bits must have them built first.
+		const std::vector<uint16>& CachedIndices16() const
+		{
+			assert(!mIndices16.empty() || Indices32.empty() || Vertices.size() > 0x10000);
+			return mIndices16;
+		}
+
 	private:
 		std::vector<uint16> mIndices16;
 	};
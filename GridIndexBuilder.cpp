@@ -0,0 +1,129 @@
+#include "GridIndexBuilder.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace
+{
+	template <typename Index>
+	void FillChunk(Index* dst, int n, int r0, int r1, int c0, int c1)
+	{
+		// Same winding as the original single-list builder, with every index
+		// relative to the chunk's top-left vertex.
+		int k = 0;
+		for (int i = 0; i < r1 - r0; ++i)
+		{
+			for (int j = 0; j < c1 - c0; ++j)
+			{
+				dst[k] = static_cast<Index>(i * n + j);
+				dst[k + 1] = static_cast<Index>(i * n + j + 1);
+				dst[k + 2] = static_cast<Index>((i + 1) * n + j);
+
+				dst[k + 3] = static_cast<Index>((i + 1) * n + j);
+				dst[k + 4] = static_cast<Index>(i * n + j + 1);
+				dst[k + 5] = static_cast<Index>((i + 1) * n + j + 1);
+
+				k += 6;
+			}
+		}
+	}
+}
+
+const void* GridIndexData::Data() const
+{
+	return Format == DXGI_FORMAT_R16_UINT ?
+		static_cast<const void*>(Indices16.data()) :
+		static_cast<const void*>(Indices32.data());
+}
+
+UINT GridIndexData::ByteSize() const
+{
+	return Format == DXGI_FORMAT_R16_UINT ?
+		static_cast<UINT>(Indices16.size() * sizeof(std::uint16_t)) :
+		static_cast<UINT>(Indices32.size() * sizeof(std::uint32_t));
+}
+
+GridIndexData GridIndexBuilder::Build(int m, int n, float dx, float minY, float maxY,
+	GridIndexFormat format, int maxChunkQuads, ThreadPool* pool)
+{
+	assert(m >= 2 && n >= 2);
+
+	if (pool == nullptr)
+		pool = &ThreadPool::Default();
+
+	const int quadRows = m - 1;
+	const int quadCols = n - 1;
+
+	int chunkCols = std::min(std::max(maxChunkQuads, 1), quadCols);
+	int chunkRows = std::min(std::max(maxChunkQuads, 1), quadRows);
+
+	// Tallest chunk whose largest local index, chunkRows * n + chunkCols,
+	// still fits in 16 bits.
+	const int rows16 = (0xffff - chunkCols) / n;
+
+	const bool use16 = format != GridIndexFormat::Index32 && rows16 >= 1;
+	if (use16)
+		chunkRows = std::min(chunkRows, rows16);
+
+	GridIndexData data;
+	data.Format = use16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	data.ChunkRows = (quadRows + chunkRows - 1) / chunkRows;
+	data.ChunkCols = (quadCols + chunkCols - 1) / chunkCols;
+
+	const float halfWidth = 0.5f * quadCols * dx;
+	const float halfDepth = 0.5f * quadRows * dx;
+
+	// Lay the chunks out one after another.
+	const int chunkCount = data.ChunkRows * data.ChunkCols;
+	data.Chunks.resize(chunkCount);
+
+	UINT start = 0;
+	for (int a = 0; a < data.ChunkRows; ++a)
+	{
+		for (int b = 0; b < data.ChunkCols; ++b)
+		{
+			const int r0 = a * chunkRows;
+			const int r1 = std::min(r0 + chunkRows, quadRows);
+			const int c0 = b * chunkCols;
+			const int c1 = std::min(c0 + chunkCols, quadCols);
+
+			SubmeshGeometry& chunk = data.Chunks[a * data.ChunkCols + b];
+			chunk.IndexCount = static_cast<UINT>(6 * (r1 - r0) * (c1 - c0));
+			chunk.StartIndexLocation = start;
+			chunk.BaseVertexLocation = r0 * n + c0;
+
+			// Row 0 is at +z.
+			XMFLOAT3 lo(-halfWidth + c0 * dx, minY, halfDepth - r1 * dx);
+			XMFLOAT3 hi(-halfWidth + c1 * dx, maxY, halfDepth - r0 * dx);
+			chunk.Bounds.Center = XMFLOAT3(0.5f * (lo.x + hi.x), 0.5f * (lo.y + hi.y), 0.5f * (lo.z + hi.z));
+			chunk.Bounds.Extents = XMFLOAT3(0.5f * (hi.x - lo.x), 0.5f * (hi.y - lo.y), 0.5f * (hi.z - lo.z));
+
+			start += chunk.IndexCount;
+		}
+	}
+
+	if (use16)
+		data.Indices16.resize(start);
+	else
+		data.Indices32.resize(start);
+
+	pool->ParallelFor(0, chunkCount, 1, [&](int first, int last)
+		{
+			for (int k = first; k < last; ++k)
+			{
+				const SubmeshGeometry& chunk = data.Chunks[k];
+				const int r0 = (k / data.ChunkCols) * chunkRows;
+				const int c0 = (k % data.ChunkCols) * chunkCols;
+				const int r1 = std::min(r0 + chunkRows, quadRows);
+				const int c1 = std::min(c0 + chunkCols, quadCols);
+
+				if (use16)
+					FillChunk(&data.Indices16[chunk.StartIndexLocation], n, r0, r1, c0, c1);
+				else
+					FillChunk(&data.Indices32[chunk.StartIndexLocation], n, r0, r1, c0, c1);
+			}
+		});
+
+	return data;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "d3dUtil.h"
+
+class ThreadPool;
+
+enum class GridIndexFormat : int
+{
+	// 16-bit whenever a chunk can address its vertices with 16 bits,
+	// otherwise 32-bit.
+	Auto = 0,
+
+	// Falls back to 32-bit when a row is too wide for 16 bits.
+	Index16,
+	Index32
+};
+
+// Triangle-list indices of a row-major m x n vertex grid (the layout Waves
+// and FftOcean write), cut into rectangular chunks.
+struct GridIndexData
+{
+	DXGI_FORMAT Format = DXGI_FORMAT_R16_UINT;
+
+	// Only the list matching Format is filled.
+	std::vector<std::uint16_t> Indices16;
+	std::vector<std::uint32_t> Indices32;
+
+	// One submesh per chunk, in row-major chunk order.  A chunk's indices are
+	// relative to its BaseVertexLocation (its top-left vertex), which is what
+	// keeps a 16-bit chunk addressable on any grid size.  Bounds cover the
+	// chunk's x/z footprint and the y range given to Build.
+	std::vector<SubmeshGeometry> Chunks;
+	int ChunkRows = 0;
+	int ChunkCols = 0;
+
+	const void* Data() const;
+	UINT ByteSize() const;
+};
+
+class GridIndexBuilder
+{
+public:
+	// Chunks are at most maxChunkQuads x maxChunkQuads quads.  With 16-bit
+	// indices the chunk height is further limited so that
+	// (rows * n + cols) stays below 65536; on a 2048-wide grid that means
+	// 31 x 128 quads.  The grid is centered at the origin with spacing dx,
+	// row 0 at +z.  Chunks are generated in parallel on the pool
+	// (ThreadPool::Default() if null).
+	static GridIndexData Build(int m, int n, float dx, float minY, float maxY,
+		GridIndexFormat format = GridIndexFormat::Auto, int maxChunkQuads = 128,
+		ThreadPool* pool = nullptr);
+};
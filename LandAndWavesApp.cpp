@@ -3,6 +3,7 @@
 #include "FrameResource.h"
 #include "GeometryGenerator.h"
 #include "Waves.h"
+#include "ShallowWater.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -110,6 +111,12 @@ private:
 
 	std::unique_ptr<Waves> mWaves;
 
+	// 'H' 키로 지형을 따라 흐르는 얕은 물 방정식 풀이기로 전환한다. 언덕 밑에
+	// 묻힌 칸은 시뮬레이션하지 않으며, 파도 격자와 같은 격자를 쓴다.
+	std::unique_ptr<ShallowWater> mShallowWater;
+	bool mUseShallowWater = false;
+	bool mShallowWaterKeyDown = false;
+
 	PassConstants mMainPassCB;
 
 	bool mIsWireFrame = false;
@@ -175,6 +182,11 @@ bool LandAndWavesApp::Initialize()
 
 	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
 
+	// 물의 바닥은 언덕 높이 함수에서 얻고, 높이 0까지 물을 채운다.
+	mShallowWater = std::make_unique<ShallowWater>(mWaves->RowCount(), mWaves->ColumnCount(),
+		mWaves->SpatialStep(), 0.02f, 0.2f);
+	mShallowWater->SetBathymetry([this](float x, float z) { return GetHillsHeight(x, z); }, 0.0f);
+
 	BuildRootSignature();
 	BuildShadersAndInputLayout();
 	BuildLandGeometry();
@@ -320,6 +332,13 @@ void LandAndWavesApp::OnKeyboardInput(const GameTimer& gt)
 	{
 		mIsWireFrame = false;
 	}
+
+	bool shallowWaterKeyDown = (GetAsyncKeyState('H') & 0x8000) != 0;
+	if (shallowWaterKeyDown && !mShallowWaterKeyDown)
+	{
+		mUseShallowWater = !mUseShallowWater;
+	}
+	mShallowWaterKeyDown = shallowWaterKeyDown;
 }
 
 void LandAndWavesApp::UpdateCamera(const GameTimer& gt)
@@ -395,20 +414,39 @@ void LandAndWavesApp::UpdateWaves(const GameTimer& gt)
 
 		float r = MathHelper::RandF(0.2f, 0.5f);
 
-		mWaves->Disturb(i, j, r);
+		if (mUseShallowWater)
+			mShallowWater->Disturb(i, j, r);
+		else
+			mWaves->Disturb(i, j, r);
 	}
 
-	mWaves->Update(gt.DeltaTime());
-
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for (int i = 0; i < mWaves->VertexCount(); i++)
+	if (mUseShallowWater)
+	{
+		// 마른 칸은 지형 바로 밑에 놓이므로 따로 거르지 않아도 가려진다.
+		mShallowWater->Update(gt.DeltaTime());
+		for (int i = 0; i < mShallowWater->VertexCount(); i++)
+		{
+			Vertex v;
+
+			v.Pos = mShallowWater->Position(i);
+			v.Color = XMFLOAT4(DirectX::Colors::Blue);
+
+			currWavesVB->CopyData(i, v);
+		}
+	}
+	else
 	{
-		Vertex v;
+		mWaves->Update(gt.DeltaTime());
+		for (int i = 0; i < mWaves->VertexCount(); i++)
+		{
+			Vertex v;
 
-		v.Pos = mWaves->Position(i);
-		v.Color = XMFLOAT4(DirectX::Colors::Blue);
+			v.Pos = mWaves->Position(i);
+			v.Color = XMFLOAT4(DirectX::Colors::Blue);
 
-		currWavesVB->CopyData(i, v);
+			currWavesVB->CopyData(i, v);
+		}
 	}
 
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
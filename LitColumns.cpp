@@ -2,6 +2,10 @@
 #include "MathHelper.h"
 #include "FrameResource.h"
 #include "GeometryGenerator.h"
+#include "GeometryCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include <cstdio>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -43,6 +47,14 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
+
+	/*
+		세밀도 수준(LOD)별 DrawIndexedInstanced 매개변수들. 비어 있지 않으면
+		카메라가 LodDistance보다 멀어질 때부터 거리가 두 배가 될 때마다
+		한 단계 덜 세밀한 것을 위의 매개변수들에 설정한다.
+	*/
+	std::vector<SubmeshGeometry> Lods;
+	float LodDistance = 0.0f;
 };
 
 class LitColumns : public D3DApp
@@ -67,6 +79,7 @@ private:
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) override;
 
 	void UpdateCamera(const GameTimer& gt);
+	void UpdateLods();
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	// Material 상수버퍼 업데이트
@@ -126,9 +139,135 @@ private:
 	POINT mLastMousePos = {};
 };
 
+// Models 폴더의 모형 파일(정점 위치와 법선, 삼각형 색인)을 읽는다.
+static bool LoadModel(const std::string& filename, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices)
+{
+	std::ifstream fin(filename);
+
+	if (!fin)
+		return false;
+
+	UINT vcount = 0;
+	UINT tcount = 0;
+	std::string ignore;
+
+	fin >> ignore >> vcount;
+	fin >> ignore >> tcount;
+	fin >> ignore >> ignore >> ignore >> ignore;
+
+	vertices.assign(vcount, Vertex());
+	for (UINT i = 0; i < vcount; i++)
+	{
+		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
+		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+	}
+
+	fin >> ignore;
+	fin >> ignore;
+	fin >> ignore;
+
+	indices.assign(3 * tcount, 0);
+	for (UINT i = 0; i < tcount; i++)
+	{
+		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+	}
+
+	return static_cast<bool>(fin);
+}
+
+// 해골의 세밀도 수준별 삼각형 비율. 각 수준은 앞 수준의 절반이다.
+static const std::vector<float> gSkullLodRatios = { 1.0f, 0.5f, 0.25f, 0.125f, 0.0625f };
+
+// 모형을 이차 오차 측정(QEM)으로 단순화해서 세밀도 수준들을 하나의 정점/색인 배열에 담는다.
+static std::vector<MeshLod> BuildModelLods(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices,
+	std::vector<Vertex>& lodVertices, std::vector<std::uint32_t>& lodIndices)
+{
+	GeometryGenerator::MeshData meshData;
+	meshData.Vertices.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		meshData.Vertices[i].Position = vertices[i].Pos;
+		meshData.Vertices[i].Normal = vertices[i].Normal;
+		meshData.Vertices[i].TexC = vertices[i].TexC;
+	}
+	meshData.Indices32 = indices;
+
+	GeometryGenerator::MeshData packed;
+	std::vector<MeshLod> lods = MeshSimplifier::BuildLodChain(meshData, gSkullLodRatios, packed);
+
+	lodVertices.resize(packed.Vertices.size());
+	for (size_t i = 0; i < packed.Vertices.size(); ++i)
+	{
+		lodVertices[i].Pos = packed.Vertices[i].Position;
+		lodVertices[i].Normal = packed.Vertices[i].Normal;
+		lodVertices[i].TexC = packed.Vertices[i].TexC;
+	}
+	lodIndices.swap(packed.Indices32);
+
+	return lods;
+}
+
+// 모형을 최적화하기 전과 후의 ACMR/ATVR, 그리고 세밀도 수준별 삼각형 수와 오차를 창 없이 출력한다.
+// "-meshstats Models/skull.txt"처럼 실행한다.
+static int ReportMeshCacheStats(const std::string& filename)
+{
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+	if (!LoadModel(filename, vertices, indices))
+	{
+		std::string message = "Could not load model " + filename + "\n";
+		::OutputDebugStringA(message.c_str());
+		fputs(message.c_str(), stderr);
+		return 2;
+	}
+
+	std::string report = filename + "\n";
+	auto append = [&](const char* label)
+	{
+		for (int cacheSize : { 16, 32 })
+		{
+			VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), cacheSize);
+
+			char line[160];
+			snprintf(line, sizeof(line), "  %-9s FIFO %2d: ACMR %.3f  ATVR %.3f  (%u triangles, %u vertices)\n",
+				label, cacheSize, stats.Acmr, stats.Atvr, stats.TriangleCount, stats.VertexCount);
+			report += line;
+		}
+	};
+
+	std::vector<Vertex> lodVertices;
+	std::vector<std::uint32_t> lodIndices;
+	std::vector<MeshLod> lods = BuildModelLods(vertices, indices, lodVertices, lodIndices);
+
+	append("original");
+	MeshOptimizer::Optimize(vertices, indices);
+	append("optimized");
+	for (size_t i = 0; i < lods.size(); ++i)
+	{
+		const MeshLod& lod = lods[i];
+		VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(lodIndices.data() + lod.StartIndexLocation,
+			lod.IndexCount, lod.VertexCount, 16);
+
+		char line[160];
+		snprintf(line, sizeof(line), "  lod %zu (%.4f): %6u triangles, %6u vertices, error %.5f, FIFO 16 ACMR %.3f\n",
+			i, lod.Ratio, lod.TriangleCount, lod.VertexCount, lod.Error, stats.Acmr);
+		report += line;
+	}
+
+	::OutputDebugStringA(report.c_str());
+	fputs(report.c_str(), stdout);
+	return 0;
+}
+
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE prevInstance,
 	_In_ PSTR cmdLine, _In_ int showCmd)
 {
+	const std::string args = cmdLine != nullptr ? cmdLine : "";
+	if (args.compare(0, 11, "-meshstats ") == 0)
+	{
+		return ReportMeshCacheStats(args.substr(11));
+	}
+
 	// 디버그 빌드에서는 실행시점 메모리 점검 기능을 켠다.
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -206,6 +345,7 @@ void LitColumns::OnResize()
 void LitColumns::Update(const GameTimer& gt)
 {
 	UpdateCamera(gt);
+	UpdateLods();
 
 	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1 ) % gNumFrameResources;
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
@@ -314,6 +454,28 @@ void LitColumns::UpdateCamera(const GameTimer& gt)
 	XMStoreFloat4x4(&mView, view);
 }
 
+void LitColumns::UpdateLods()
+{
+	XMVECTOR eye = XMLoadFloat3(&mEyePos);
+	for (auto& e : mAllRitems)
+	{
+		if (e->Lods.empty())
+			continue;
+
+		XMVECTOR center = XMVectorSet(e->World(3, 0), e->World(3, 1), e->World(3, 2), 1.0f);
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, eye)));
+
+		size_t level = 0;
+		for (float d = e->LodDistance; distance >= d && level + 1 < e->Lods.size(); d *= 2.0f)
+			++level;
+
+		const SubmeshGeometry& lod = e->Lods[level];
+		e->IndexCount = lod.IndexCount;
+		e->StartIndexLocation = lod.StartIndexLocation;
+		e->BaseVertexLocation = lod.BaseVertexLocation;
+	}
+}
+
 void LitColumns::UpdateObjectCBs(const GameTimer& gt)
 {
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
@@ -527,48 +689,49 @@ void LitColumns::BuildShadersAndInputLayout()
 
 void LitColumns::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
+	// 같은 매개변수의 기하구조는 한 번만 생성해서 공유한다.
+	GeometryCache& geoCache = GeometryCache::Default();
+	GeometryCache::MeshPtr box = geoCache.CreateBox(1.5f, 0.5f, 1.5f, 3);
+	GeometryCache::MeshPtr grid = geoCache.CreateGrid(20.0f, 30.0f, 60, 40);
+	GeometryCache::MeshPtr sphere = geoCache.CreateSphere(0.5f, 20, 20);
 	// 7장 연습문제 1번. CreateGeosphere를 사용하도록 수정. 세부수준 0, 1, 2, 3
-	//GeometryGenerator::MeshData sphere = geoGen.CreateGeosphere(0.5f, 3);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	//GeometryCache::MeshPtr sphere = geoCache.CreateGeosphere(0.5f, 3);
+	GeometryCache::MeshPtr cylinder = geoCache.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
 
 	// 이 예제는 모든 기하구조를 하나의 커다란 정점/색인 버퍼에 담는다.
 	// 따라서 버퍼에서 각 부분 메시가 차지하는 영역들을 정의할 필요가 있다.
 
 	// 연결된 정점 버퍼에서의 각 물체의 정점 오프셋을 적절한 변수들에 보관해 둔다.
 	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = static_cast<UINT>(box.Vertices.size());
-	UINT sphereVertexOffset = gridVertexOffset + static_cast<UINT>(grid.Vertices.size());
-	UINT cylinderVertexOffset = sphereVertexOffset + static_cast<UINT>(sphere.Vertices.size());
+	UINT gridVertexOffset = static_cast<UINT>(box->Vertices.size());
+	UINT sphereVertexOffset = gridVertexOffset + static_cast<UINT>(grid->Vertices.size());
+	UINT cylinderVertexOffset = sphereVertexOffset + static_cast<UINT>(sphere->Vertices.size());
 
 	// 연결된 정점 버퍼에서의 각 물체의 시작 색인을 적절한 변수들에 보관해 둔다.
 	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = static_cast<UINT>(box.Indices32.size());
-	UINT sphereIndexOffset = gridIndexOffset + static_cast<UINT>(grid.Indices32.size());
-	UINT cylinderIndexOffset = sphereIndexOffset + static_cast<UINT>(sphere.Indices32.size());
+	UINT gridIndexOffset = static_cast<UINT>(box->Indices32.size());
+	UINT sphereIndexOffset = gridIndexOffset + static_cast<UINT>(grid->Indices32.size());
+	UINT cylinderIndexOffset = sphereIndexOffset + static_cast<UINT>(sphere->Indices32.size());
 
 	// 정점/색인 버퍼에서 각 물체가 차지하는 영역을 나타내는 
 	// SubmeshGeometry 객체들을 정의한다.
 	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = static_cast<UINT>(box.Indices32.size());
+	boxSubmesh.IndexCount = static_cast<UINT>(box->Indices32.size());
 	boxSubmesh.StartIndexLocation = boxIndexOffset;
 	boxSubmesh.BaseVertexLocation = boxVertexOffset;
 
 	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = static_cast<UINT>(grid.Indices32.size());
+	gridSubmesh.IndexCount = static_cast<UINT>(grid->Indices32.size());
 	gridSubmesh.StartIndexLocation = gridIndexOffset;
 	gridSubmesh.BaseVertexLocation = gridVertexOffset;
 
 	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = static_cast<UINT>(sphere.Indices32.size());
+	sphereSubmesh.IndexCount = static_cast<UINT>(sphere->Indices32.size());
 	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
 	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
 
 	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = static_cast<UINT>(cylinder.Indices32.size());
+	cylinderSubmesh.IndexCount = static_cast<UINT>(cylinder->Indices32.size());
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
@@ -576,41 +739,41 @@ void LitColumns::BuildShapeGeometry()
 		필요한 정점 성분들을 추출하고, 모든 메시의 정점들을
 		하나의 정점 버퍼에 넣는다.
 	*/
-	auto totalVertexCount = box.Vertices.size() + grid.Vertices.size() + sphere.Vertices.size()
-		+ cylinder.Vertices.size();
+	auto totalVertexCount = box->Vertices.size() + grid->Vertices.size() + sphere->Vertices.size()
+		+ cylinder->Vertices.size();
 
 	std::vector<Vertex> vertices(totalVertexCount);
 
 	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < box->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
+		vertices[k].Pos = box->Vertices[i].Position;
 		//vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
 	}
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < grid->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
+		vertices[k].Pos = grid->Vertices[i].Position;
 		//vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
 	}
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < sphere->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
+		vertices[k].Pos = sphere->Vertices[i].Position;
 		//vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
 	}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < cylinder->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
+		vertices[k].Pos = cylinder->Vertices[i].Position;
 		//vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
 	}
 
 	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	indices.insert(indices.end(), std::begin(box->CachedIndices16()), std::end(box->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(grid->CachedIndices16()), std::end(grid->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(sphere->CachedIndices16()), std::end(sphere->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(cylinder->CachedIndices16()), std::end(cylinder->CachedIndices16()));
 
 	const UINT vbByteSize = static_cast<UINT>(vertices.size()) * sizeof(Vertex);
 	const UINT ibByteSize = static_cast<UINT>(indices.size()) * sizeof(std::uint16_t);
@@ -645,43 +808,21 @@ void LitColumns::BuildShapeGeometry()
 
 void LitColumns::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
-
-	if (!fin)
+	std::vector<Vertex> modelVertices;
+	std::vector<std::uint32_t> modelIndices;
+	if (!LoadModel("Models/skull.txt", modelVertices, modelIndices))
 	{
 		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-
-	std::vector<Vertex> vertices(vcount);
-	for (UINT i = 0; i < vcount; i++)
-	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-	}
-
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for (UINT i = 0; i < tcount; i++)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-	}
-
-	fin.close();
+	// 세밀도 수준들을 모두 하나의 정점 버퍼와 색인 버퍼에 담는다.
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+	std::vector<MeshLod> lods = BuildModelLods(modelVertices, modelIndices, vertices, indices);
 
 	const UINT vbByteSize = sizeof(Vertex) * vertices.size();
-	const UINT ibByteSize = sizeof(std::int32_t) * indices.size();
+	const UINT ibByteSize = sizeof(std::uint32_t) * indices.size();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "skullGeo";
@@ -703,11 +844,14 @@ void LitColumns::BuildSkullGeometry()
 	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-	geo->DrawArgs["skull"] = submesh;
+	for (size_t i = 0; i < lods.size(); ++i)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = lods[i].IndexCount;
+		submesh.StartIndexLocation = lods[i].StartIndexLocation;
+		submesh.BaseVertexLocation = lods[i].BaseVertexLocation;
+		geo->DrawArgs[i == 0 ? "skull" : "skullLod" + std::to_string(i)] = submesh;
+	}
 
 	mGeometries[geo->Name] = std::move(geo);
 }
@@ -791,6 +935,11 @@ void LitColumns::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	// 멀어지면 덜 세밀한 해골을 그린다.
+	skullRitem->Lods.push_back(skullRitem->Geo->DrawArgs["skull"]);
+	for (size_t i = 1; i < gSkullLodRatios.size(); ++i)
+		skullRitem->Lods.push_back(skullRitem->Geo->DrawArgs["skullLod" + std::to_string(i)]);
+	skullRitem->LodDistance = 20.0f;
 	mAllRitems.push_back(std::move(skullRitem));
 
 	// [그림 7.6]에 나온 것처럼 기둥들과 구들을 두 줄로 배치한다.
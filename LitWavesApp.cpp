@@ -2,7 +2,16 @@
 #include "MathHelper.h"
 #include "FrameResource.h"
 #include "GeometryGenerator.h"
-#include "Waves.h"
+#include "AsyncWaves.h"
+#include "FftOcean.h"
+#include "GridIndexBuilder.h"
+#include "WavesClipmap.h"
+#include "ShallowWater.h"
+#include "WavesRecording.h"
+#include "WavesState.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -49,6 +58,9 @@ struct RenderItem
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	Water,
+	WaterClipmap,
+	WaterCompact,
 	Count
 };
 
@@ -77,11 +89,15 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void ToggleWavesRecording();
+	void SaveWavesState();
+	void LoadWavesState();
 
 	void BuildRootSignature();
 	void BuildShadersAndInputLayout();
 	void BuildLandGeometry();
 	void BuildWavesGeometryBuffers();
+	void BuildClipmapGeometryBuffers();
 	// 머티리얼 초기화
 	void BuildMaterials();
 	void BuildPSOs();
@@ -108,6 +124,7 @@ private:
 	// 머티리얼 변수
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mCompactInputLayout;
 
 	RenderItem* mWavesRitem = nullptr;
 
@@ -115,7 +132,41 @@ private:
 
 	std::vector<RenderItem*> mRitemLayer[static_cast<int>(RenderLayer::Count)];
 
-	std::unique_ptr<Waves> mWaves;
+	std::unique_ptr<AsyncWaves> mWaves;
+	std::vector<WavesRowRange> mWavesDirtyRows;
+
+	// 'O' 키로 유한차분 파도와 FFT 바다를 전환한다. 둘은 같은 격자를 쓴다.
+	std::unique_ptr<FftOcean> mOcean;
+	bool mUseOcean = false;
+	bool mOceanKeyDown = false;
+
+	// 'C' 키로 카메라를 따라다니는 다중 해상도(클립맵) 물로 전환한다.
+	// 가까운 곳은 촘촘한 격자로, 먼 곳은 점점 성긴 고리로 시뮬레이션하고 그린다.
+	std::unique_ptr<WavesClipmap> mClipmap;
+	bool mUseClipmap = false;
+	bool mClipmapKeyDown = false;
+
+	// 'H' 키로 지형을 따라 흐르는 얕은 물 방정식 풀이기로 전환한다. 언덕 밑에
+	// 묻힌 칸은 시뮬레이션하지 않으며, 파도 격자와 같은 격자를 쓴다.
+	std::unique_ptr<ShallowWater> mShallowWater;
+	bool mUseShallowWater = false;
+	bool mShallowWaterKeyDown = false;
+
+	// 'R' 키로 파도 교란 녹화를 시작하고 멈춘다. 멈추면 WavesRecording.wvr에
+	// 저장하며, "-replay 파일"로 실행하면 창 없이 최대 속도로 재생한다.
+	WavesRecordingDesc mWavesDesc;
+	WavesRecorder mWavesRecorder;
+	bool mRecordKeyDown = false;
+
+	// F5로 파도 상태를 WavesState.wvs에 저장하고 F9로 되살린다. 시작할 때
+	// 파일이 있으면 그 상태에서 출발해, 물이 자리 잡는 시간을 건너뛴다.
+	bool mSaveStateKeyDown = false;
+	bool mLoadStateKeyDown = false;
+
+	// 'V' 키로 유한차분 파도를 압축 정점으로 그린다. 프레임마다 정점당
+	// 32바이트 대신 8바이트(반정밀도 높이, 팔면체 법선)만 올린다.
+	bool mUseCompactWaves = false;
+	bool mCompactWavesKeyDown = false;
 
 	PassConstants mMainPassCB;
 
@@ -136,9 +187,171 @@ private:
 	POINT mLastMousePos = {0, 0};
 };
 
+// 녹화된 파도 교란을 창 없이 최대 속도로 재생하고, 걸린 시간과 최종 높이의
+// 체크섬을 출력한다. 체크섬이 녹화 때와 같으면 0, 다르면 1, 파일을 읽지
+// 못하면 2를 돌려준다. memory로 큰 페이지와 첫 접근 배치를 켜고 끄며
+// 걸린 시간을 비교할 수 있다.
+static int ReplayWavesRecording(const std::string& filename, const WavesMemoryOptions& memory)
+{
+	WavesRecording recording;
+	if (!recording.Load(filename))
+	{
+		std::string message = "Could not load waves recording " + filename + "\n";
+		::OutputDebugStringA(message.c_str());
+		fputs(message.c_str(), stderr);
+		return 2;
+	}
+
+	auto waves = recording.CreateSimulation();
+	waves->SetMemoryOptions(memory);
+	WavesReplayResult result = recording.Replay(*waves);
+
+	char message[256];
+	snprintf(message, sizeof(message),
+		"%s%s%s: %llu steps in %.3f s (%.0f steps/s), checksum %016llx, %s\n",
+		filename.c_str(), memory.HugePages ? " [huge pages]" : "", memory.FirstTouch ? " [first touch]" : "",
+		result.Steps, result.Seconds,
+		result.Seconds > 0.0 ? result.Steps / result.Seconds : 0.0,
+		static_cast<unsigned long long>(result.Checksum),
+		result.Matches ? "matches the recording" : "DIFFERS from the recording");
+	::OutputDebugStringA(message);
+	fputs(message, stdout);
+
+	return result.Matches ? 0 : 1;
+}
+
+// 같은 파도를 명시적 적분기와 ADI 적분기로, 명시적 방법의 안정 한계(쿠랑 수
+// 약 0.7)를 훨씬 넘는 쿠랑 수 2로 진행하고 각각의 최대 높이를 창 없이 출력한다.
+// 명시적 방법은 발산하고 ADI는 처음 교란보다 낮게 남으면 0, 아니면 1을 돌려준다.
+static int CheckIntegratorStability()
+{
+	const float magnitude = 1.0f;
+	const unsigned long long steps = 200;
+
+	float peaks[2] = {};
+	const WavesIntegrator integrators[2] = { WavesIntegrator::Explicit, WavesIntegrator::ImplicitAdi };
+	for (int k = 0; k < 2; ++k)
+	{
+		Waves waves(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+		waves.SetIntegrator(integrators[k]);
+		waves.SetTimeStep(2.0f * waves.SpatialStep() / 4.0f);
+		waves.Disturb(64, 64, magnitude);
+
+		while (waves.StepCount() < steps)
+			waves.Update(waves.TimeStep());
+
+		// 무한대나 NaN이 된 높이는 발산으로 센다.
+		float peak = 0.0f;
+		for (int i = 0; i < waves.VertexCount(); ++i)
+		{
+			const float h = fabsf(waves.Height(i));
+			if (!std::isfinite(h))
+			{
+				peak = INFINITY;
+				break;
+			}
+			peak = std::max(peak, h);
+		}
+		peaks[k] = peak;
+	}
+
+	const bool explicitDiverged = peaks[0] > 1e3f * magnitude;
+	const bool implicitBounded = peaks[1] <= magnitude;
+
+	char message[256];
+	snprintf(message, sizeof(message),
+		"Courant 2, %llu steps: explicit peak %g (%s), ADI peak %g (%s)\n",
+		steps, peaks[0], explicitDiverged ? "diverged" : "DID NOT diverge",
+		peaks[1], implicitBounded ? "bounded" : "NOT bounded");
+	::OutputDebugStringA(message);
+	fputs(message, stdout);
+
+	return explicitDiverged && implicitBounded ? 0 : 1;
+}
+
+// FFT 바다의 Update 한 번과 같은 격자의 Waves 한 단계에 걸리는 시간을 창 없이
+// 출력한다. 두 엔진 모두 앱과 같은 간격(1m)과 스레드 풀을 쓴다.
+static int BenchmarkOcean()
+{
+	using Clock = std::chrono::steady_clock;
+	const int frames = 20;
+
+	std::string report;
+	for (int size : { 256, 512, 1024 })
+	{
+		FftOceanDesc oceanDesc;
+		oceanDesc.Size = size;
+		oceanDesc.PatchSize = size * 1.0f;
+		FftOcean ocean(oceanDesc);
+
+		Waves waves(size, size, 1.0f, 0.03f, 4.0f, 0.2f);
+		waves.Disturb(size / 2, size / 2, 1.0f);
+
+		// 첫 호출에서 페이지와 캐시를 데운다.
+		ocean.Update(0.03f);
+		waves.Update(0.03f);
+
+		auto start = Clock::now();
+		for (int k = 0; k < frames; ++k)
+			ocean.Update(0.03f);
+		const double oceanMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+		const unsigned long long firstStep = waves.StepCount();
+		start = Clock::now();
+		for (int k = 0; k < frames; ++k)
+			waves.Update(0.03f);
+		const double wavesMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+			std::max(1ull, waves.StepCount() - firstStep);
+
+		char line[160];
+		snprintf(line, sizeof(line), "%4d x %4d: FFT ocean %.1f ms per update, Waves %.1f ms per step\n",
+			size, size, oceanMs, wavesMs);
+		report += line;
+	}
+
+	::OutputDebugStringA(report.c_str());
+	fputs(report.c_str(), stdout);
+	return 0;
+}
+
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE prevInstance,
 	_In_ PSTR cmdLine, _In_ int showCmd)
 {
+	const std::string args = cmdLine != nullptr ? cmdLine : "";
+	if (args.compare(0, 8, "-replay ") == 0)
+	{
+		// "-replay [-hugepages] [-firsttouch] 파일" 형식이다.
+		std::string rest = args.substr(8);
+		WavesMemoryOptions memory;
+		for (;;)
+		{
+			if (rest.compare(0, 11, "-hugepages ") == 0)
+			{
+				memory.HugePages = true;
+				rest = rest.substr(11);
+			}
+			else if (rest.compare(0, 12, "-firsttouch ") == 0)
+			{
+				memory.FirstTouch = true;
+				rest = rest.substr(12);
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		return ReplayWavesRecording(rest, memory);
+	}
+	if (args == "-oceanbench")
+	{
+		return BenchmarkOcean();
+	}
+	if (args == "-stability")
+	{
+		return CheckIntegratorStability();
+	}
+
 	// 디버그 빌드에서는 실행시점 메모리 점검 기능을 켠다.
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -170,6 +383,12 @@ LitWavesApp::~LitWavesApp()
 	{
 		FlushCommandQueue();
 	}
+
+	// 녹화기가 소멸하며 시뮬레이션에서 떨어지기 전에 작업 스레드를 멈춰 둔다.
+	if (mWaves != nullptr)
+	{
+		mWaves->Flush();
+	}
 }
 
 bool LitWavesApp::Initialize()
@@ -181,12 +400,35 @@ bool LitWavesApp::Initialize()
 
 	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
-	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+	// 녹화 파일에 같은 설정이 기록되도록 설명 구조체로 파도를 만든다.
+	WavesRecording wavesSetup(mWavesDesc);
+	auto waves = wavesSetup.CreateSimulation();
+	waves->EnableDirtyTracking(true);
+
+	// 저장해 둔 상태가 있으면 거기서 시작한다. 격자가 다르면 무시된다.
+	WavesState::Load("WavesState.wvs", *waves);
+
+	// 파도 시뮬레이션은 별도의 스레드에서 돌린다.
+	mWaves = std::make_unique<AsyncWaves>(std::move(waves));
+
+	FftOceanDesc oceanDesc;
+	oceanDesc.Size = mWaves->RowCount();
+	oceanDesc.PatchSize = mWaves->RowCount() * 1.0f;
+	mOcean = std::make_unique<FftOcean>(oceanDesc);
+
+	// 129x129 격자 다섯 단계로 한 변이 약 2km인 물을 덮는다.
+	mClipmap = std::make_unique<WavesClipmap>(5, 129, 1.0f, 0.03f, 4.0f, 0.2f);
+
+	// 물의 바닥은 언덕 높이 함수에서 얻고, 높이 0까지 물을 채운다.
+	mShallowWater = std::make_unique<ShallowWater>(mWaves->RowCount(), mWaves->ColumnCount(),
+		mWaves->SpatialStep(), 0.02f, 0.2f);
+	mShallowWater->SetBathymetry([this](float x, float z) { return GetHillsHeight(x, z); }, 0.0f);
 
 	BuildRootSignature();
 	BuildShadersAndInputLayout();
 	BuildLandGeometry();
 	BuildWavesGeometryBuffers();
+	BuildClipmapGeometryBuffers();
 	BuildMaterials();
 	BuildRenderItems();
 	BuildFrameResources();
@@ -257,6 +499,18 @@ void LitWavesApp::Draw(const GameTimer& gt)
 
 	DrawRenderItems(mCommandList.Get(), mRitemLayer[static_cast<int>(RenderLayer::Opaque)]);
 
+	RenderLayer water = RenderLayer::Water;
+	if (mUseClipmap)
+	{
+		water = RenderLayer::WaterClipmap;
+	}
+	else if (mUseCompactWaves && !mUseOcean && !mUseShallowWater)
+	{
+		water = RenderLayer::WaterCompact;
+		mCommandList->SetPipelineState(mPSOs["wavesCompact"].Get());
+	}
+	DrawRenderItems(mCommandList.Get(), mRitemLayer[static_cast<int>(water)]);
+
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
@@ -338,6 +592,104 @@ void LitWavesApp::OnKeyboardInput(const GameTimer& gt)
 	}
 
 	mSunPhi = MathHelper::Clamp(mSunPhi, 0.1f, XM_PIDIV2);
+
+	bool oceanKeyDown = (GetAsyncKeyState('O') & 0x8000) != 0;
+	if (oceanKeyDown && !mOceanKeyDown)
+	{
+		mUseOcean = !mUseOcean;
+	}
+	mOceanKeyDown = oceanKeyDown;
+
+	bool clipmapKeyDown = (GetAsyncKeyState('C') & 0x8000) != 0;
+	if (clipmapKeyDown && !mClipmapKeyDown)
+	{
+		mUseClipmap = !mUseClipmap;
+	}
+	mClipmapKeyDown = clipmapKeyDown;
+
+	bool shallowWaterKeyDown = (GetAsyncKeyState('H') & 0x8000) != 0;
+	if (shallowWaterKeyDown && !mShallowWaterKeyDown)
+	{
+		mUseShallowWater = !mUseShallowWater;
+	}
+	mShallowWaterKeyDown = shallowWaterKeyDown;
+
+	bool recordKeyDown = (GetAsyncKeyState('R') & 0x8000) != 0;
+	if (recordKeyDown && !mRecordKeyDown)
+	{
+		ToggleWavesRecording();
+	}
+	mRecordKeyDown = recordKeyDown;
+
+	bool saveStateKeyDown = (GetAsyncKeyState(VK_F5) & 0x8000) != 0;
+	if (saveStateKeyDown && !mSaveStateKeyDown)
+	{
+		SaveWavesState();
+	}
+	mSaveStateKeyDown = saveStateKeyDown;
+
+	bool loadStateKeyDown = (GetAsyncKeyState(VK_F9) & 0x8000) != 0;
+	if (loadStateKeyDown && !mLoadStateKeyDown)
+	{
+		LoadWavesState();
+	}
+	mLoadStateKeyDown = loadStateKeyDown;
+
+	bool compactWavesKeyDown = (GetAsyncKeyState('V') & 0x8000) != 0;
+	if (compactWavesKeyDown && !mCompactWavesKeyDown)
+	{
+		mUseCompactWaves = !mUseCompactWaves;
+	}
+	mCompactWavesKeyDown = compactWavesKeyDown;
+}
+
+void LitWavesApp::SaveWavesState()
+{
+	mWaves->Flush();
+
+	// 저장은 손실 없이, 압축만 한다.
+	WavesStateOptions options;
+	const bool saved = WavesState::Save(mWaves->Simulation(), "WavesState.wvs", options);
+	::OutputDebugStringA(saved ? "Waves state saved to WavesState.wvs.\n" : "Waves state could not be saved.\n");
+}
+
+void LitWavesApp::LoadWavesState()
+{
+	// 녹화 중에 상태를 바꾸면 재생과 어긋나므로 녹화를 먼저 끝낸다.
+	if (mWavesRecorder.IsRecording())
+	{
+		ToggleWavesRecording();
+	}
+
+	mWaves->Flush();
+
+	const bool loaded = WavesState::Load("WavesState.wvs", mWaves->Simulation());
+	::OutputDebugStringA(loaded ? "Waves state loaded from WavesState.wvs.\n" : "Waves state could not be loaded.\n");
+}
+
+void LitWavesApp::ToggleWavesRecording()
+{
+	// 시뮬레이션은 작업 스레드에서 돌므로, 밀린 프레임을 모두 끝낸 뒤에만 건드린다.
+	mWaves->Flush();
+
+	if (!mWavesRecorder.IsRecording())
+	{
+		mWavesRecorder.Begin(mWavesDesc, mWaves->Simulation());
+		::OutputDebugStringA("Waves recording started.\n");
+		return;
+	}
+
+	mWavesRecorder.End();
+
+	const WavesRecording& recording = mWavesRecorder.Recording();
+	const bool saved = recording.Save("WavesRecording.wvr");
+
+	char message[256];
+	snprintf(message, sizeof(message), "Waves recording %s: %llu steps, %zu disturbances, checksum %016llx\n",
+		saved ? "saved to WavesRecording.wvr" : "could not be saved",
+		recording.StepCount(), recording.Disturbances().size(),
+		static_cast<unsigned long long>(recording.Checksum()));
+	::OutputDebugStringA(message);
 }
 
 void LitWavesApp::UpdateCamera(const GameTimer& gt)
@@ -352,6 +704,18 @@ void LitWavesApp::UpdateCamera(const GameTimer& gt)
 
 	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
 	XMStoreFloat4x4(&mView, view);
+
+	// 클립맵은 카메라 아래로 옮겨 간다. 정점은 클립맵 중심 기준이므로
+	// 물체 상수 버퍼를 갱신하기 전에 세계 행렬을 새 중심으로 옮겨 둔다.
+	if (mUseClipmap && mClipmap->SetFocus(mEyePos.x, mEyePos.z))
+	{
+		XMFLOAT2 center = mClipmap->Center();
+		for (auto& ri : mRitemLayer[static_cast<int>(RenderLayer::WaterClipmap)])
+		{
+			XMStoreFloat4x4(&ri->World, XMMatrixTranslation(center.x, 0.0f, center.y));
+			ri->NumFramesDirty = gNumFrameResources;
+		}
+	}
 }
 
 void LitWavesApp::UpdateObjectCBs(const GameTimer& gt)
@@ -446,23 +810,93 @@ void LitWavesApp::UpdateWaves(const GameTimer& gt)
 
 		float r = MathHelper::RandF(0.2f, 0.5f);
 
-		mWaves->Disturb(i, j, r);
+		if (mUseClipmap)
+		{
+			// 같은 격자 위치를 세계 공간 충격으로 바꿔 넣는다.
+			WavesImpulse impulse;
+			impulse.From.x = -0.5f * (mWaves->ColumnCount() - 1) * mWaves->SpatialStep() + j * mWaves->SpatialStep();
+			impulse.From.y = 0.5f * (mWaves->RowCount() - 1) * mWaves->SpatialStep() - i * mWaves->SpatialStep();
+			impulse.Magnitude = r;
+			mClipmap->QueueDisturbance(impulse);
+		}
+		else if (mUseShallowWater)
+			mShallowWater->Disturb(i, j, r);
+		else if (!mUseOcean)
+			mWaves->Disturb(i, j, r);
 	}
 
-	mWaves->Update(gt.DeltaTime());
-
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for (int i = 0; i < mWaves->VertexCount(); i++)
+
+	WavesVertexLayout layout;
+	layout.Stride = sizeof(Vertex);
+	layout.PositionOffset = offsetof(Vertex, Pos);
+	layout.NormalOffset = offsetof(Vertex, Normal);
+	layout.TexCOffset = offsetof(Vertex, TexC);
+
+	if (mUseClipmap)
 	{
-		Vertex v;
+		// 클립맵은 주 스레드에서 바로 진행한다. 파도 정점 버퍼를 함께 쓰므로
+		// 스탬프를 0으로 두어 격자 파도로 돌아왔을 때 전체가 다시 기록되게 한다.
+		mClipmap->Update(gt.DeltaTime());
+		mClipmap->WriteVertices(currWavesVB->MappedData(), layout);
+		mCurrFrameResource->WavesStamp = 0;
+
+		mGeometries["clipmapGeo"]->VertexBufferGPU = currWavesVB->Resource();
+		return;
+	}
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
+	if (mUseShallowWater)
+	{
+		mShallowWater->Update(gt.DeltaTime());
+		mShallowWater->WriteVertices(currWavesVB->MappedData(), layout);
+		mCurrFrameResource->WavesStamp = 0;
 
-		currWavesVB->CopyData(i, v);
+		mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+		return;
 	}
 
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	if (mUseOcean)
+	{
+		// FFT 바다는 매 프레임 모든 정점이 바뀐다. 스탬프를 0으로 두어
+		// 유한차분 파도로 돌아왔을 때 버퍼 전체가 다시 기록되게 한다.
+		mOcean->Update(gt.DeltaTime());
+		mOcean->WriteVertices(currWavesVB->MappedData(), layout);
+		mCurrFrameResource->WavesStamp = 0;
+
+		mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+		return;
+	}
+
+	// 가장 최근에 완료된 시뮬레이션 상태를 기다리지 않고 가져온다.
+	// 이 상태는 다음 AcquireLatest 호출 전까지 바뀌지 않는다.
+	const WavesSnapshot& waves = mWaves->AcquireLatest();
+
+	// 정점마다 Vertex를 만들어 CopyData로 복사하는 대신, 파도 정점들을
+	// 대응된 업로드 버퍼에 직접(병렬, 비시간적 저장으로) 기록한다.
+	// 프레임 자원마다 자신이 마지막으로 기록한 이후에 바뀐 행들만 다시 기록한다.
+	if (mUseCompactWaves)
+	{
+		// 압축 정점 버퍼는 자신의 스탬프를 따로 가지므로, 전환해도
+		// 그동안 바뀐 행들만 다시 기록하면 된다.
+		auto currCompactVB = mCurrFrameResource->WavesCompactVB.get();
+
+		waves.DirtyRows(mCurrFrameResource->WavesCompactStamp, mWavesDirtyRows);
+		waves.WriteCompactVertices(reinterpret_cast<WavesCompactVertex*>(currCompactVB->MappedData()), mWavesDirtyRows);
+		mCurrFrameResource->WavesCompactStamp = waves.DirtyStamp();
+
+		mGeometries["waterCompactGeo"]->VertexBufferGPU = currCompactVB->Resource();
+	}
+	else
+	{
+		waves.DirtyRows(mCurrFrameResource->WavesStamp, mWavesDirtyRows);
+		waves.WriteVertices(currWavesVB->MappedData(), layout, mWavesDirtyRows);
+		mCurrFrameResource->WavesStamp = waves.DirtyStamp();
+
+		mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	}
+
+	// 다음 상태는 이 프레임의 명령 목록을 기록하는 동안 작업 스레드에서 계산된다.
+	mWaves->Update(gt.DeltaTime());
 }
 
 void LitWavesApp::BuildRootSignature()
@@ -494,12 +928,21 @@ void LitWavesApp::BuildShadersAndInputLayout()
 {
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_0");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_0");
+	mShaders["wavesVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "WavesVS", "vs_5_0");
 
 	mInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
+
+	// 0번 슬롯: 정적인 x, z. 1번 슬롯: 프레임마다 올리는 WavesCompactVertex.
+	mCompactInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "HEIGHT", 0, DXGI_FORMAT_R16_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 1, 4, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
 }
 
 void LitWavesApp::BuildLandGeometry()
@@ -560,34 +1003,77 @@ void LitWavesApp::BuildLandGeometry()
 
 void LitWavesApp::BuildWavesGeometryBuffers()
 {
-	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount());
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	// 격자가 크면 16비트 색인으로 주소를 지정할 수 있는 조각들로 나눈다.
+	// 높이 범위는 파도가 넘지 않을 만큼 넉넉하게 잡는다.
+	GridIndexData indices = GridIndexBuilder::Build(mWaves->RowCount(), mWaves->ColumnCount(),
+		mWaves->SpatialStep(), -2.0f, 2.0f);
 
-	int m = mWaves->RowCount();
-	int n = mWaves->ColumnCount();
-	int k = 0;
-	for (int i = 0; i < m - 1; i++)
-	{
-		for (int j = 0; j < n - 1; j++)
-		{
-			indices[k] = i * n + j;
-			indices[k + 1] = i * n + j + 1;
-			indices[k + 2] = (i + 1) * n + j;
+	UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
+	UINT ibByteSize = indices.ByteSize();
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "waterGeo";
 
-			indices[k + 3] = (i + 1) * n + j;
-			indices[k + 4] = i * n + j + 1;
-			indices[k + 5] = (i + 1) * n + j + 1;
+	geo->VertexBufferCPU = nullptr;
+	geo->VertexBufferGPU = nullptr;
 
-			k += 6;
-		}
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.Data(), ibByteSize);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(), indices.Data(),
+		ibByteSize, geo->IndexBufferUploader);
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = indices.Format;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	for (size_t k = 0; k < indices.Chunks.size(); ++k)
+	{
+		geo->DrawArgs["chunk" + std::to_string(k)] = indices.Chunks[k];
 	}
+	
+	// 압축 정점으로 그릴 때 쓰는 기하구조. 색인 버퍼와 조각들은 위와 같고,
+	// 바뀌지 않는 x, z만 기본 버퍼에 한 번 올려 둔다.
+	std::vector<XMFLOAT2> gridPositions(mWaves->VertexCount());
+	mWaves->Simulation().WriteGridPositions(gridPositions.data());
+	UINT posByteSize = (UINT)gridPositions.size() * sizeof(XMFLOAT2);
+
+	auto compactGeo = std::make_unique<MeshGeometry>();
+	compactGeo->Name = "waterCompactGeo";
+
+	compactGeo->VPosBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(), mCommandList.Get(),
+		gridPositions.data(), posByteSize, compactGeo->VPosBufferUploader);
+	compactGeo->VPosByteStride = sizeof(XMFLOAT2);
+	compactGeo->VPosBufferByteSize = posByteSize;
+
+	// 정점 버퍼는 프레임마다 압축 파도 정점 버퍼로 설정된다.
+	compactGeo->VertexBufferGPU = nullptr;
+	compactGeo->VertexByteStride = sizeof(WavesCompactVertex);
+	compactGeo->VertexBufferByteSize = mWaves->VertexCount() * sizeof(WavesCompactVertex);
+
+	compactGeo->IndexBufferGPU = geo->IndexBufferGPU;
+	compactGeo->IndexFormat = geo->IndexFormat;
+	compactGeo->IndexBufferByteSize = geo->IndexBufferByteSize;
+	compactGeo->DrawArgs = geo->DrawArgs;
 
-	UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
-	UINT ibByteSize = static_cast<UINT>(indices.size()) * sizeof(std::uint16_t);
+	mGeometries["waterGeo"] = std::move(geo);
+	mGeometries["waterCompactGeo"] = std::move(compactGeo);
+}
+
+void LitWavesApp::BuildClipmapGeometryBuffers()
+{
+	std::vector<std::uint16_t> indices;
+	std::vector<WavesClipmapRange> levels;
+	mClipmap->BuildIndices(indices, levels);
+
+	UINT vbByteSize = mClipmap->VertexCount() * sizeof(Vertex);
+	UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "waterGeo";
+	geo->Name = "clipmapGeo";
 
+	// 정점 버퍼는 프레임마다 파도 정점 버퍼로 설정된다.
 	geo->VertexBufferCPU = nullptr;
 	geo->VertexBufferGPU = nullptr;
 
@@ -602,14 +1088,22 @@ void LitWavesApp::BuildWavesGeometryBuffers()
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = static_cast<UINT>(indices.size());
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	// 단계마다 고리 하나. 경계 상자는 클립맵 중심 기준이다.
+	for (size_t l = 0; l < levels.size(); ++l)
+	{
+		float half = 0.5f * (mClipmap->LevelSize() - 1) * mClipmap->LevelSpacing((int)l);
 
-	geo->DrawArgs["grid"] = submesh;
-	
-	mGeometries["waterGeo"] = std::move(geo);
+		SubmeshGeometry submesh;
+		submesh.IndexCount = levels[l].IndexCount;
+		submesh.StartIndexLocation = levels[l].StartIndex;
+		submesh.BaseVertexLocation = levels[l].BaseVertex;
+		submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		submesh.Bounds.Extents = XMFLOAT3(half, 2.0f, half);
+
+		geo->DrawArgs["level" + std::to_string(l)] = submesh;
+	}
+
+	mGeometries["clipmapGeo"] = std::move(geo);
 }
 
 void LitWavesApp::BuildMaterials()
@@ -662,6 +1156,15 @@ void LitWavesApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+
+	// 압축 파도 정점용 PSO. 입력 배치와 정점 셰이더만 다르다.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC compactPsoDesc = opaquePsoDesc;
+	compactPsoDesc.InputLayout = { mCompactInputLayout.data(), static_cast<UINT>(mCompactInputLayout.size()) };
+	compactPsoDesc.VS = {
+		reinterpret_cast<BYTE*>(mShaders["wavesVS"]->GetBufferPointer()),
+		mShaders["wavesVS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&compactPsoDesc, IID_PPV_ARGS(&mPSOs["wavesCompact"])));
 }
 
 void LitWavesApp::BuildFrameResources()
@@ -669,26 +1172,53 @@ void LitWavesApp::BuildFrameResources()
 	for (int i = 0; i < gNumFrameResources; i++)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(), 
-			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(),
+			(UINT)std::max(mWaves->VertexCount(), mClipmap->VertexCount())));
 	}
 }
 
 void LitWavesApp::BuildRenderItems()
 {
-	auto wavesRitem = std::make_unique<RenderItem>();
-	wavesRitem->World = MathHelper::Identity4x4();
-	wavesRitem->ObjCBIndex = 0;
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	// RenderItem에 Material 설정
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["gird"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["gird"].BaseVertexLocation;
-
-	mWavesRitem = wavesRitem.get();
+	// 파도 격자 조각마다 렌더 항목을 하나씩 만든다. 조각들은 같은 기하구조와
+	// 세계 행렬을 쓰므로 물체 상수 버퍼 색인도 공유한다.
+	auto wavesGeo = mGeometries["waterGeo"].get();
+	for (auto& chunk : wavesGeo->DrawArgs)
+	{
+		auto wavesRitem = std::make_unique<RenderItem>();
+		wavesRitem->World = MathHelper::Identity4x4();
+		wavesRitem->ObjCBIndex = 0;
+		wavesRitem->Geo = wavesGeo;
+		// RenderItem에 Material 설정
+		wavesRitem->Mat = mMaterials["water"].get();
+		wavesRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		wavesRitem->IndexCount = chunk.second.IndexCount;
+		wavesRitem->StartIndexLocation = chunk.second.StartIndexLocation;
+		wavesRitem->BaseVertexLocation = chunk.second.BaseVertexLocation;
+
+		mWavesRitem = wavesRitem.get();
+
+		mRitemLayer[static_cast<int>(RenderLayer::Water)].push_back(wavesRitem.get());
+		mAllRitems.push_back(std::move(wavesRitem));
+	}
 
-	mRitemLayer[static_cast<int>(RenderLayer::Opaque)].push_back(wavesRitem.get());
+	// 압축 정점으로 그리는 같은 조각들. 세계 행렬이 같으므로 물체 상수 버퍼
+	// 색인도 위의 파도 렌더 항목들과 공유한다.
+	auto compactGeo = mGeometries["waterCompactGeo"].get();
+	for (auto& chunk : compactGeo->DrawArgs)
+	{
+		auto compactRitem = std::make_unique<RenderItem>();
+		compactRitem->World = MathHelper::Identity4x4();
+		compactRitem->ObjCBIndex = 0;
+		compactRitem->Geo = compactGeo;
+		compactRitem->Mat = mMaterials["water"].get();
+		compactRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		compactRitem->IndexCount = chunk.second.IndexCount;
+		compactRitem->StartIndexLocation = chunk.second.StartIndexLocation;
+		compactRitem->BaseVertexLocation = chunk.second.BaseVertexLocation;
+
+		mRitemLayer[static_cast<int>(RenderLayer::WaterCompact)].push_back(compactRitem.get());
+		mAllRitems.push_back(std::move(compactRitem));
+	}
 
 	auto gridRitem = std::make_unique<RenderItem>();
 	gridRitem->World = MathHelper::Identity4x4();
@@ -703,8 +1233,28 @@ void LitWavesApp::BuildRenderItems()
 
 	mRitemLayer[static_cast<int>(RenderLayer::Opaque)].push_back(gridRitem.get());
 
-	mAllRitems.push_back(std::move(wavesRitem));
 	mAllRitems.push_back(std::move(gridRitem));
+
+	// 클립맵 단계마다 렌더 항목을 하나씩 만든다. 모두 클립맵 중심으로 옮기는
+	// 같은 세계 행렬을 쓰므로 물체 상수 버퍼 색인을 공유한다.
+	auto clipmapGeo = mGeometries["clipmapGeo"].get();
+	for (int l = 0; l < mClipmap->LevelCount(); ++l)
+	{
+		auto& level = clipmapGeo->DrawArgs["level" + std::to_string(l)];
+
+		auto clipmapRitem = std::make_unique<RenderItem>();
+		clipmapRitem->World = MathHelper::Identity4x4();
+		clipmapRitem->ObjCBIndex = 2;
+		clipmapRitem->Geo = clipmapGeo;
+		clipmapRitem->Mat = mMaterials["water"].get();
+		clipmapRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		clipmapRitem->IndexCount = level.IndexCount;
+		clipmapRitem->StartIndexLocation = level.StartIndexLocation;
+		clipmapRitem->BaseVertexLocation = level.BaseVertexLocation;
+
+		mRitemLayer[static_cast<int>(RenderLayer::WaterClipmap)].push_back(clipmapRitem.get());
+		mAllRitems.push_back(std::move(clipmapRitem));
+	}
 }
 
 void LitWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
@@ -720,7 +1270,16 @@ void LitWavesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std:
 	{
 		auto ri = ritems[i];
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+		// 위치를 별도의 정적 버퍼에 둔 기하구조는 두 슬롯에 나누어 묶는다.
+		if (ri->Geo->VPosBufferGPU != nullptr)
+		{
+			D3D12_VERTEX_BUFFER_VIEW vbvs[2] = { ri->Geo->VPosBufferView(), ri->Geo->VertexBufferView() };
+			cmdList->IASetVertexBuffers(0, 2, vbvs);
+		}
+		else
+		{
+			cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+		}
 		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
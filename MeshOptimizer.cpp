@@ -0,0 +1,259 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+const std::uint32_t MeshOptimizer::NoVertex;
+
+namespace
+{
+	// Forsyth's constants.  The cache positions of the last triangle get a
+	// fixed score (its order within the cache barely matters); further back
+	// the score decays to 0 at the end of the cache.  Vertices with few
+	// triangles left get a boost.
+	const int CacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// Valences above this all score like it; their boost is small anyway.
+	const int MaxValence = 64;
+
+	struct ScoreTables
+	{
+		float Cache[CacheSize];
+		float Valence[MaxValence + 1];
+
+		ScoreTables()
+		{
+			for (int p = 0; p < CacheSize; ++p)
+			{
+				Cache[p] = p < 3 ? LastTriangleScore :
+					powf(1.0f - (p - 3) * (1.0f / (CacheSize - 3)), CacheDecayPower);
+			}
+
+			Valence[0] = 0.0f;
+			for (int k = 1; k <= MaxValence; ++k)
+				Valence[k] = ValenceBoostScale * powf(static_cast<float>(k), -ValenceBoostPower);
+		}
+
+		// A vertex no triangle needs any more scores below everything else.
+		float Score(int cachePosition, std::uint32_t remaining) const
+		{
+			if (remaining == 0)
+				return -1.0f;
+
+			float score = Valence[std::min<std::uint32_t>(remaining, MaxValence)];
+			if (cachePosition >= 0)
+				score += Cache[cachePosition];
+			return score;
+		}
+	};
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount)
+{
+	static const ScoreTables tables;
+
+	const std::size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles of each vertex; the first Remaining[v] entries of its list
+	// are the ones not emitted yet.
+	std::vector<std::uint32_t> remaining(vertexCount, 0);
+	for (std::size_t k = 0; k < triangleCount * 3; ++k)
+		++remaining[indices[k]];
+
+	std::vector<std::uint32_t> offsets(vertexCount + 1, 0);
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<std::uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (std::size_t k = 0; k < triangleCount * 3; ++k)
+			adjacency[fill[indices[k]]++] = static_cast<std::uint32_t>(k / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = tables.Score(-1, remaining[v]);
+
+	std::vector<unsigned char> emitted(triangleCount, 0);
+
+	std::size_t best = 0;
+	float bestScore = -1.0f;
+	for (std::size_t t = 0; t < triangleCount; ++t)
+	{
+		const std::uint32_t* tri = indices + 3 * t;
+		const float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best = t;
+		}
+	}
+
+	std::vector<std::uint32_t> output(triangleCount * 3);
+
+	// The cache before and after emitting a triangle: its (up to) three
+	// vertices move to the front, pushing up to three out of the back.
+	std::uint32_t cache[CacheSize + 3];
+	std::uint32_t newCache[CacheSize + 3];
+	int cacheCount = 0;
+
+	std::size_t cursor = 0;
+	for (std::size_t k = 0; k < triangleCount; ++k)
+	{
+		// Nothing in the cache is worth continuing with: start over at the
+		// next triangle in input order.
+		if (best == triangleCount)
+		{
+			while (emitted[cursor])
+				++cursor;
+			best = cursor;
+		}
+
+		const std::uint32_t tri[3] = { indices[3 * best], indices[3 * best + 1], indices[3 * best + 2] };
+		output[3 * k + 0] = tri[0];
+		output[3 * k + 1] = tri[1];
+		output[3 * k + 2] = tri[2];
+		emitted[best] = 1;
+
+		int newCount = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			const std::uint32_t v = tri[c];
+
+			// Take the triangle off the vertex's live list.
+			std::uint32_t* list = &adjacency[offsets[v]];
+			const std::uint32_t live = remaining[v];
+			for (std::uint32_t a = 0; a < live; ++a)
+			{
+				if (list[a] == best)
+				{
+					list[a] = list[live - 1];
+					break;
+				}
+			}
+			--remaining[v];
+
+			if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+				newCache[newCount++] = v;
+		}
+
+		for (int c = 0; c < cacheCount; ++c)
+		{
+			const std::uint32_t v = cache[c];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore every vertex that was or is in the cache, then the
+		// triangles still waiting on them, and continue with the best one.
+		for (int c = 0; c < newCount; ++c)
+		{
+			const std::uint32_t v = newCache[c];
+			cachePosition[v] = c < CacheSize ? c : -1;
+			vertexScore[v] = tables.Score(cachePosition[v], remaining[v]);
+		}
+
+		best = triangleCount;
+		bestScore = -1.0f;
+		for (int c = 0; c < newCount; ++c)
+		{
+			const std::uint32_t v = newCache[c];
+			const std::uint32_t* list = &adjacency[offsets[v]];
+			for (std::uint32_t a = 0; a < remaining[v]; ++a)
+			{
+				const std::uint32_t t = list[a];
+				const std::uint32_t* other = indices + 3 * t;
+				const float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, CacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+std::size_t MeshOptimizer::OptimizeVertexFetch(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+	std::vector<std::uint32_t>& remap)
+{
+	remap.assign(vertexCount, NoVertex);
+
+	std::uint32_t next = 0;
+	for (std::size_t k = 0; k < indexCount; ++k)
+	{
+		std::uint32_t& index = indices[k];
+		if (remap[index] == NoVertex)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	return next;
+}
+
+bool MeshOptimizer::OptimizeVertexCacheIfBetter(std::vector<std::uint32_t>& indices, std::size_t vertexCount,
+	int cacheSize)
+{
+	std::vector<std::uint32_t> reordered(indices);
+	OptimizeVertexCache(reordered.data(), reordered.size(), vertexCount);
+
+	const VertexCacheStats before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+	const VertexCacheStats after = AnalyzeVertexCache(reordered.data(), reordered.size(), vertexCount, cacheSize);
+	if (after.Transforms >= before.Transforms)
+		return false;
+
+	indices.swap(reordered);
+	return true;
+}
+
+void MeshOptimizer::Optimize(GeometryGenerator::MeshData& meshData)
+{
+	Optimize(meshData.Vertices, meshData.Indices32);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+	std::size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.TriangleCount = static_cast<std::uint32_t>(indexCount / 3);
+
+	// A vertex is cached while fewer than cacheSize misses happened since it
+	// was last loaded.
+	std::vector<std::uint32_t> loadedAt(vertexCount, 0);
+	std::vector<unsigned char> seen(vertexCount, 0);
+
+	for (std::size_t k = 0; k < stats.TriangleCount * 3; ++k)
+	{
+		const std::uint32_t v = indices[k];
+		if (!seen[v])
+		{
+			seen[v] = 1;
+			++stats.VertexCount;
+		}
+		else if (stats.Transforms - loadedAt[v] < static_cast<std::uint32_t>(cacheSize))
+		{
+			continue;
+		}
+
+		++stats.Transforms;
+		loadedAt[v] = stats.Transforms;
+	}
+
+	if (stats.TriangleCount > 0)
+		stats.Acmr = static_cast<float>(stats.Transforms) / stats.TriangleCount;
+	if (stats.VertexCount > 0)
+		stats.Atvr = static_cast<float>(stats.Transforms) / stats.VertexCount;
+	return stats;
+}
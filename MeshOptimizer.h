@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+// Post-transform vertex cache behavior of one index order, simulated with a
+// FIFO cache of a given size.
+struct VertexCacheStats
+{
+	std::uint32_t TriangleCount = 0;
+
+	// Distinct vertices the indices reference.
+	std::uint32_t VertexCount = 0;
+
+	// Vertices the cache had to transform.
+	std::uint32_t Transforms = 0;
+
+	// Average cache miss ratio: transforms per triangle.  3 is no reuse at
+	// all; a large closed mesh cannot go below about 0.5.
+	float Acmr = 0.0f;
+
+	// Average transform to vertex ratio: transforms per referenced vertex.
+	// 1 means every vertex is transformed exactly once.
+	float Atvr = 0.0f;
+};
+
+// Reorders triangle lists for the GPU's post-transform vertex cache, and
+// vertices for fetch locality.
+//
+// Run OptimizeVertexCache first, then OptimizeVertexFetch (and
+// RemapVertices) on its result; Optimize does both, for a MeshData or any
+// vertex type.  The triangles stay the same, with the same winding, only
+// their order and the vertex numbering change.
+class MeshOptimizer
+{
+public:
+	// Triangle order after Tom Forsyth's "Linear-Speed Vertex Cache
+	// Optimisation": greedily emits the triangle whose vertices score best,
+	// scoring a vertex by its position in a simulated 32-entry LRU cache and
+	// by how few triangles still use it, so stragglers are finished off
+	// before they are evicted.
+	static void OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount);
+
+	// Renumbers the vertices in the order the indices first use them and
+	// rewrites the indices.  remap[old] is the new index, or NoVertex for a
+	// vertex no triangle uses.  Returns the number of vertices used.
+	static std::size_t OptimizeVertexFetch(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+		std::vector<std::uint32_t>& remap);
+
+	// Applies the remap of OptimizeVertexFetch to a vertex array, dropping
+	// unused vertices.
+	template <class V>
+	static void RemapVertices(std::vector<V>& vertices, const std::vector<std::uint32_t>& remap, std::size_t usedCount)
+	{
+		std::vector<V> remapped(usedCount);
+		for (std::size_t v = 0; v < vertices.size(); ++v)
+		{
+			if (remap[v] != NoVertex)
+				remapped[remap[v]] = vertices[v];
+		}
+		vertices.swap(remapped);
+	}
+
+	// Forsyth's order, kept only if it lowers the ACMR under a FIFO cache of
+	// cacheSize entries; a mesh that is already well ordered can come out
+	// slightly worse.  Returns whether the order changed.
+	static bool OptimizeVertexCacheIfBetter(std::vector<std::uint32_t>& indices, std::size_t vertexCount,
+		int cacheSize = 16);
+
+	// Both passes, the first through OptimizeVertexCacheIfBetter.  Vertices
+	// are renumbered in first-use order either way.
+	template <class V>
+	static void Optimize(std::vector<V>& vertices, std::vector<std::uint32_t>& indices)
+	{
+		OptimizeVertexCacheIfBetter(indices, vertices.size());
+
+		std::vector<std::uint32_t> remap;
+		const std::size_t used = OptimizeVertexFetch(indices.data(), indices.size(), vertices.size(), remap);
+		RemapVertices(vertices, remap, used);
+	}
+
+	// The same for a MeshData.  Call before GetIndices16, which caches its
+	// copy of the indices.
+	static void Optimize(GeometryGenerator::MeshData& meshData);
+
+	// Replays the indices through a FIFO cache of cacheSize entries, like
+	// the fixed-function caches the usual ACMR figures are quoted for.
+	static VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+		std::size_t vertexCount, int cacheSize = 16);
+
+	static const std::uint32_t NoVertex = ~0u;
+};
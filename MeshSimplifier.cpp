@@ -0,0 +1,705 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+const int MeshSimplifier::Dimension;
+
+namespace
+{
+	const int N = MeshSimplifier::Dimension;
+
+	// Weights below this count as 0.
+	const float MinAttributeWeight = 1e-4f;
+
+	// Position of A(i, j), i <= j, in the packed upper triangle.
+	int Packed(int i, int j)
+	{
+		return i * N - i * (i - 1) / 2 + (j - i);
+	}
+
+	double Dot(const double* a, const double* b, int count)
+	{
+		double sum = 0.0;
+		for (int k = 0; k < count; ++k)
+			sum += a[k] * b[k];
+		return sum;
+	}
+
+	void Cross(const double* a, const double* b, double* out)
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	// Unnormalized normal of the triangle p0 p1 p2 (positions only).
+	void TriangleNormal(const double* p0, const double* p1, const double* p2, double* out)
+	{
+		const double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		const double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		Cross(e0, e1, out);
+	}
+}
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& rhs)
+{
+	for (int k = 0; k < N * (N + 1) / 2; ++k)
+		A[k] += rhs.A[k];
+	for (int k = 0; k < N; ++k)
+		B[k] += rhs.B[k];
+	C += rhs.C;
+	Area += rhs.Area;
+	return *this;
+}
+
+double MeshSimplifier::Quadric::Evaluate(const double* v) const
+{
+	double error = C;
+	for (int i = 0; i < N; ++i)
+	{
+		double row = A[Packed(i, i)] * v[i];
+		for (int j = i + 1; j < N; ++j)
+			row += 2.0 * A[Packed(i, j)] * v[j];
+		error += v[i] * (row + 2.0 * B[i]);
+	}
+	return error;
+}
+
+// Solves A v = -b by Gaussian elimination with partial pivoting.  Fails when
+// A is (nearly) singular, as for a vertex on a flat patch, where any point
+// on the plane is as good as any other.
+bool MeshSimplifier::Quadric::Minimize(double* v) const
+{
+	double m[N][N + 1];
+	for (int i = 0; i < N; ++i)
+	{
+		for (int j = 0; j < N; ++j)
+			m[i][j] = A[i <= j ? Packed(i, j) : Packed(j, i)];
+		m[i][N] = -B[i];
+	}
+
+	double scale = 0.0;
+	for (int i = 0; i < N; ++i)
+		scale = std::max(scale, std::fabs(m[i][i]));
+	if (scale == 0.0)
+		return false;
+
+	for (int c = 0; c < N; ++c)
+	{
+		int pivot = c;
+		for (int r = c + 1; r < N; ++r)
+		{
+			if (std::fabs(m[r][c]) > std::fabs(m[pivot][c]))
+				pivot = r;
+		}
+		if (std::fabs(m[pivot][c]) < 1e-9 * scale)
+			return false;
+		if (pivot != c)
+		{
+			for (int j = c; j <= N; ++j)
+				std::swap(m[c][j], m[pivot][j]);
+		}
+
+		for (int r = c + 1; r < N; ++r)
+		{
+			const double f = m[r][c] / m[c][c];
+			for (int j = c; j <= N; ++j)
+				m[r][j] -= f * m[c][j];
+		}
+	}
+
+	for (int i = N - 1; i >= 0; --i)
+	{
+		double sum = m[i][N];
+		for (int j = i + 1; j < N; ++j)
+			sum -= m[i][j] * v[j];
+		v[i] = sum / m[i][i];
+	}
+	return true;
+}
+
+MeshSimplifier::MeshSimplifier(const GeometryGenerator::MeshData& meshData, const MeshSimplifyOptions& options) :
+	mOptions(options)
+{
+	// The attributes have to survive the scaling to come back out.
+	mOptions.NormalWeight = std::max(mOptions.NormalWeight, MinAttributeWeight);
+	mOptions.TexCoordWeight = std::max(mOptions.TexCoordWeight, MinAttributeWeight);
+
+	const std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+	const std::size_t vertexCount = vertices.size();
+
+	XMFLOAT3 lo = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+	XMFLOAT3 hi = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const GeometryGenerator::Vertex& v : vertices)
+	{
+		lo.x = std::min(lo.x, v.Position.x);
+		lo.y = std::min(lo.y, v.Position.y);
+		lo.z = std::min(lo.z, v.Position.z);
+		hi.x = std::max(hi.x, v.Position.x);
+		hi.y = std::max(hi.y, v.Position.y);
+		hi.z = std::max(hi.z, v.Position.z);
+	}
+	if (vertexCount > 0)
+	{
+		mCenter = XMFLOAT3(0.5f * (lo.x + hi.x), 0.5f * (lo.y + hi.y), 0.5f * (lo.z + hi.z));
+		mExtent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z);
+		if (mExtent <= 0.0f)
+			mExtent = 1.0f;
+	}
+
+	mPoints.resize(vertexCount * N);
+	mTangents.resize(vertexCount);
+	for (std::size_t v = 0; v < vertexCount; ++v)
+	{
+		const GeometryGenerator::Vertex& vertex = vertices[v];
+		double* p = &mPoints[v * N];
+		p[0] = (vertex.Position.x - mCenter.x) / mExtent;
+		p[1] = (vertex.Position.y - mCenter.y) / mExtent;
+		p[2] = (vertex.Position.z - mCenter.z) / mExtent;
+		p[3] = vertex.Normal.x * mOptions.NormalWeight;
+		p[4] = vertex.Normal.y * mOptions.NormalWeight;
+		p[5] = vertex.Normal.z * mOptions.NormalWeight;
+		p[6] = vertex.TexC.x * mOptions.TexCoordWeight;
+		p[7] = vertex.TexC.y * mOptions.TexCoordWeight;
+		mTangents[v] = vertex.TangentU;
+	}
+
+	// Vertices sharing a position with another are seam vertices; sorting
+	// by position puts each group next to each other.
+	mLocked.assign(vertexCount, 0);
+	{
+		std::vector<std::uint32_t> order(vertexCount);
+		for (std::size_t v = 0; v < vertexCount; ++v)
+			order[v] = static_cast<std::uint32_t>(v);
+
+		auto less = [&](std::uint32_t a, std::uint32_t b)
+		{
+			const XMFLOAT3& pa = vertices[a].Position;
+			const XMFLOAT3& pb = vertices[b].Position;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), less);
+
+		for (std::size_t k = 1; k < vertexCount; ++k)
+		{
+			if (!less(order[k - 1], order[k]))
+				mLocked[order[k - 1]] = mLocked[order[k]] = 1;
+		}
+	}
+
+	// Degenerate triangles would only get in the way.
+	const std::vector<std::uint32_t>& indices = meshData.Indices32;
+	mIndices.reserve(indices.size());
+	for (std::size_t k = 0; k + 2 < indices.size(); k += 3)
+	{
+		const std::uint32_t i0 = indices[k], i1 = indices[k + 1], i2 = indices[k + 2];
+		if (i0 != i1 && i1 != i2 && i2 != i0)
+		{
+			mIndices.push_back(i0);
+			mIndices.push_back(i1);
+			mIndices.push_back(i2);
+		}
+	}
+	mTriangleCount = mIndices.size() / 3;
+	mTriangleRemoved.assign(mTriangleCount, 0);
+
+	mVertexTriangles.resize(vertexCount);
+	for (std::size_t k = 0; k < mIndices.size(); ++k)
+		mVertexTriangles[mIndices[k]].push_back(static_cast<std::uint32_t>(k / 3));
+
+	mVersions.assign(vertexCount, 0);
+	mRemoved.assign(vertexCount, 0);
+
+	BuildQuadrics();
+
+	std::vector<std::uint64_t> edges;
+	edges.reserve(mIndices.size());
+	for (std::size_t t = 0; t < mTriangleCount; ++t)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			std::uint64_t a = mIndices[3 * t + c];
+			std::uint64_t b = mIndices[3 * t + (c + 1) % 3];
+			if (a > b)
+				std::swap(a, b);
+			edges.push_back(a << 32 | b);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	for (std::uint64_t edge : edges)
+		Push(static_cast<std::uint32_t>(edge >> 32), static_cast<std::uint32_t>(edge));
+}
+
+// Each triangle adds its plane in the 8D space, weighted by its area, to its
+// three vertices; each open edge (including the cut of a seam) adds a plane
+// through it at right angles to its triangle, so borders keep their shape.
+void MeshSimplifier::BuildQuadrics()
+{
+	mQuadrics.assign(mPoints.size() / N, Quadric());
+	mShapeQuadrics.assign(mPoints.size() / N, Quadric());
+
+	// How many triangles use each directed edge in the reverse direction;
+	// an edge without one is open.
+	std::vector<std::uint64_t> edges;
+	edges.reserve(mIndices.size());
+	for (std::size_t k = 0; k < mIndices.size(); ++k)
+	{
+		const std::uint64_t a = mIndices[k];
+		const std::uint64_t b = mIndices[k - k % 3 + (k + 1) % 3];
+		edges.push_back(a << 32 | b);
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (std::size_t t = 0; t < mTriangleCount; ++t)
+	{
+		const std::uint32_t* tri = &mIndices[3 * t];
+		const double* p = &mPoints[tri[0] * N];
+		const double* q = &mPoints[tri[1] * N];
+		const double* r = &mPoints[tri[2] * N];
+
+		double normal[3];
+		TriangleNormal(p, q, r, normal);
+		const double doubleArea = std::sqrt(Dot(normal, normal, 3));
+		if (doubleArea <= 0.0)
+			continue;
+
+		// Orthonormal basis e1, e2 of the triangle's plane in 8D.
+		double e1[N], e2[N];
+		for (int k = 0; k < N; ++k)
+			e1[k] = q[k] - p[k];
+		const double length1 = std::sqrt(Dot(e1, e1, N));
+		for (int k = 0; k < N; ++k)
+		{
+			e1[k] /= length1;
+			e2[k] = r[k] - p[k];
+		}
+		const double along = Dot(e2, e1, N);
+		for (int k = 0; k < N; ++k)
+			e2[k] -= along * e1[k];
+		const double length2 = std::sqrt(Dot(e2, e2, N));
+		if (length2 <= 0.0)
+			continue;
+		for (int k = 0; k < N; ++k)
+			e2[k] /= length2;
+
+		// Squared distance to the plane: |v - p|^2 - ((v - p).e1)^2 - ((v - p).e2)^2.
+		const double area = 0.5 * doubleArea;
+		const double pe1 = Dot(p, e1, N);
+		const double pe2 = Dot(p, e2, N);
+
+		Quadric quadric;
+		for (int i = 0; i < N; ++i)
+		{
+			for (int j = i; j < N; ++j)
+			{
+				const double identity = i == j ? 1.0 : 0.0;
+				quadric.A[Packed(i, j)] = area * (identity - e1[i] * e1[j] - e2[i] * e2[j]);
+			}
+			quadric.B[i] = area * (pe1 * e1[i] + pe2 * e2[i] - p[i]);
+		}
+		quadric.C = area * (Dot(p, p, N) - pe1 * pe1 - pe2 * pe2);
+		quadric.Area = area;
+
+		Quadric shape;
+		const double plane[3] = { normal[0] / doubleArea, normal[1] / doubleArea, normal[2] / doubleArea };
+		const double d = -Dot(plane, p, 3);
+		for (int i = 0; i < 3; ++i)
+		{
+			for (int j = i; j < 3; ++j)
+				shape.A[Packed(i, j)] = area * plane[i] * plane[j];
+			shape.B[i] = area * d * plane[i];
+		}
+		shape.C = area * d * d;
+		shape.Area = area;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			mQuadrics[tri[c]] += quadric;
+			mShapeQuadrics[tri[c]] += shape;
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const std::uint32_t a = tri[c];
+			const std::uint32_t b = tri[(c + 1) % 3];
+			const std::uint64_t reverse = static_cast<std::uint64_t>(b) << 32 | a;
+			if (std::binary_search(edges.begin(), edges.end(), reverse))
+				continue;
+
+			const double* pa = &mPoints[a * N];
+			const double* pb = &mPoints[b * N];
+			const double edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+			double side[3];
+			Cross(edge, normal, side);
+			const double sideLength = std::sqrt(Dot(side, side, 3));
+			if (sideLength <= 0.0)
+				continue;
+			for (int k = 0; k < 3; ++k)
+				side[k] /= sideLength;
+
+			const double weight = mOptions.BorderWeight * Dot(edge, edge, 3);
+			const double offset = -Dot(side, pa, 3);
+
+			Quadric border;
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = i; j < 3; ++j)
+					border.A[Packed(i, j)] = weight * side[i] * side[j];
+				border.B[i] = weight * offset * side[i];
+			}
+			border.C = weight * offset * offset;
+
+			mQuadrics[a] += border;
+			mQuadrics[b] += border;
+		}
+	}
+}
+
+void MeshSimplifier::Push(std::uint32_t v0, std::uint32_t v1)
+{
+	Collapse collapse;
+	if (!Evaluate(v0, v1, collapse))
+		return;
+
+	Candidate candidate;
+	candidate.Cost = collapse.Cost;
+	candidate.V0 = v0;
+	candidate.V1 = v1;
+	candidate.Version0 = mVersions[v0];
+	candidate.Version1 = mVersions[v1];
+	mQueue.push(candidate);
+}
+
+// Where the merged vertex of v0 and v1 goes and what that costs.  A seam
+// vertex keeps its place; otherwise the summed quadric's minimum is taken
+// unless it is ill-defined or far off the edge, in which case the best of
+// the two ends and the midpoint is.
+bool MeshSimplifier::Evaluate(std::uint32_t v0, std::uint32_t v1, Collapse& collapse) const
+{
+	if (mLocked[v0] && mLocked[v1])
+		return false;
+
+	Quadric quadric = mQuadrics[v0];
+	quadric += mQuadrics[v1];
+
+	const double* p0 = &mPoints[v0 * N];
+	const double* p1 = &mPoints[v1 * N];
+
+	collapse.Keep = mLocked[v1] ? v1 : v0;
+	collapse.Remove = mLocked[v1] ? v0 : v1;
+
+	if (mLocked[v0] || mLocked[v1])
+	{
+		std::copy(&mPoints[collapse.Keep * N], &mPoints[collapse.Keep * N] + N, collapse.Point);
+		collapse.Cost = quadric.Evaluate(collapse.Point);
+		return true;
+	}
+
+	double edgeLength2 = 0.0;
+	for (int k = 0; k < 3; ++k)
+		edgeLength2 += (p1[k] - p0[k]) * (p1[k] - p0[k]);
+
+	if (quadric.Minimize(collapse.Point))
+	{
+		double offset2 = 0.0;
+		for (int k = 0; k < 3; ++k)
+		{
+			const double mid = 0.5 * (p0[k] + p1[k]);
+			offset2 += (collapse.Point[k] - mid) * (collapse.Point[k] - mid);
+		}
+		if (offset2 <= edgeLength2)
+		{
+			collapse.Cost = quadric.Evaluate(collapse.Point);
+			return true;
+		}
+	}
+
+	double midpoint[N];
+	for (int k = 0; k < N; ++k)
+		midpoint[k] = 0.5 * (p0[k] + p1[k]);
+
+	const double* choices[3] = { p0, p1, midpoint };
+	collapse.Cost = DBL_MAX;
+	for (const double* choice : choices)
+	{
+		const double cost = quadric.Evaluate(choice);
+		if (cost < collapse.Cost)
+		{
+			collapse.Cost = cost;
+			std::copy(choice, choice + N, collapse.Point);
+		}
+	}
+	return true;
+}
+
+bool MeshSimplifier::HasVertex(std::uint32_t triangle, std::uint32_t v) const
+{
+	const std::uint32_t* tri = &mIndices[3 * triangle];
+	return tri[0] == v || tri[1] == v || tri[2] == v;
+}
+
+bool MeshSimplifier::IsValid(const Collapse& collapse) const
+{
+	const std::uint32_t keep = collapse.Keep;
+	const std::uint32_t remove = collapse.Remove;
+
+	// Link condition: the two vertices may share no neighbors other than the
+	// third corners of the triangles on their edge, or the collapse would
+	// pinch the surface into a non-manifold one.
+	std::vector<std::uint32_t> keepRing, removeRing;
+	int shared = 0;
+	for (std::uint32_t t : mVertexTriangles[keep])
+	{
+		const std::uint32_t* tri = &mIndices[3 * t];
+		keepRing.insert(keepRing.end(), tri, tri + 3);
+		if (HasVertex(t, remove))
+			++shared;
+	}
+	for (std::uint32_t t : mVertexTriangles[remove])
+	{
+		const std::uint32_t* tri = &mIndices[3 * t];
+		removeRing.insert(removeRing.end(), tri, tri + 3);
+	}
+	if (shared == 0)
+		return false;
+
+	std::sort(keepRing.begin(), keepRing.end());
+	keepRing.erase(std::unique(keepRing.begin(), keepRing.end()), keepRing.end());
+	std::sort(removeRing.begin(), removeRing.end());
+	removeRing.erase(std::unique(removeRing.begin(), removeRing.end()), removeRing.end());
+
+	int common = 0;
+	for (std::uint32_t v : removeRing)
+	{
+		if (v != keep && v != remove && std::binary_search(keepRing.begin(), keepRing.end(), v))
+			++common;
+	}
+	if (common != shared)
+		return false;
+
+	// No remaining triangle may flip or turn too far.
+	for (std::uint32_t v : { keep, remove })
+	{
+		for (std::uint32_t t : mVertexTriangles[v])
+		{
+			if (HasVertex(t, keep) && HasVertex(t, remove))
+				continue;
+
+			const std::uint32_t* tri = &mIndices[3 * t];
+			const double* before[3];
+			const double* after[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				before[c] = &mPoints[tri[c] * N];
+				after[c] = tri[c] == v ? collapse.Point : before[c];
+			}
+
+			double n0[3], n1[3];
+			TriangleNormal(before[0], before[1], before[2], n0);
+			TriangleNormal(after[0], after[1], after[2], n1);
+			const double length0 = std::sqrt(Dot(n0, n0, 3));
+			const double length1 = std::sqrt(Dot(n1, n1, 3));
+			if (length1 <= 1e-12 * length0 ||
+				Dot(n0, n1, 3) < mOptions.MinNormalDot * length0 * length1)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshSimplifier::Apply(const Collapse& collapse)
+{
+	const std::uint32_t keep = collapse.Keep;
+	const std::uint32_t remove = collapse.Remove;
+
+	// Tangents follow the position along the edge, then are made
+	// perpendicular to the new normal again.
+	{
+		const double* pk = &mPoints[keep * N];
+		const double* pr = &mPoints[remove * N];
+		double edge[3], offset[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			edge[k] = pr[k] - pk[k];
+			offset[k] = collapse.Point[k] - pk[k];
+		}
+		const double edgeLength2 = Dot(edge, edge, 3);
+		const float t = edgeLength2 > 0.0 ?
+			static_cast<float>(std::min(1.0, std::max(0.0, Dot(offset, edge, 3) / edgeLength2))) : 0.0f;
+
+		XMVECTOR tangent = XMVectorLerp(XMLoadFloat3(&mTangents[keep]), XMLoadFloat3(&mTangents[remove]), t);
+		const XMVECTOR normal = XMVector3Normalize(XMVectorSet(static_cast<float>(collapse.Point[3]),
+			static_cast<float>(collapse.Point[4]), static_cast<float>(collapse.Point[5]), 0.0f));
+		tangent = XMVectorSubtract(tangent, XMVectorMultiply(XMVector3Dot(tangent, normal), normal));
+		if (XMVectorGetX(XMVector3LengthSq(tangent)) > 1e-12f)
+			XMStoreFloat3(&mTangents[keep], XMVector3Normalize(tangent));
+	}
+
+	std::copy(collapse.Point, collapse.Point + N, &mPoints[keep * N]);
+	mQuadrics[keep] += mQuadrics[remove];
+	mShapeQuadrics[keep] += mShapeQuadrics[remove];
+	mRemoved[remove] = 1;
+	++mVersions[keep];
+	++mVersions[remove];
+
+	// Area-weighted mean squared distance to the planes the vertex stands for.
+	const Quadric& shape = mShapeQuadrics[keep];
+	if (shape.Area > 0.0)
+		mMaxError = std::max(mMaxError, std::max(0.0, shape.Evaluate(collapse.Point)) / shape.Area);
+
+	// Triangles on the edge disappear; the rest of remove's move to keep.
+	for (std::uint32_t t : mVertexTriangles[remove])
+	{
+		std::uint32_t* tri = &mIndices[3 * t];
+		if (HasVertex(t, keep))
+		{
+			mTriangleRemoved[t] = 1;
+			--mTriangleCount;
+			for (int c = 0; c < 3; ++c)
+			{
+				if (tri[c] == keep || tri[c] == remove)
+					continue;
+				std::vector<std::uint32_t>& list = mVertexTriangles[tri[c]];
+				list.erase(std::find(list.begin(), list.end(), t));
+			}
+		}
+		else
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				if (tri[c] == remove)
+					tri[c] = keep;
+			}
+			mVertexTriangles[keep].push_back(t);
+		}
+	}
+	mVertexTriangles[remove].clear();
+	mVertexTriangles[remove].shrink_to_fit();
+
+	std::vector<std::uint32_t>& list = mVertexTriangles[keep];
+	list.erase(std::remove_if(list.begin(), list.end(),
+		[&](std::uint32_t t) { return mTriangleRemoved[t] != 0; }), list.end());
+
+	// Requeue every edge of the merged vertex with its new quadric.
+	std::vector<std::uint32_t> ring;
+	for (std::uint32_t t : list)
+	{
+		const std::uint32_t* tri = &mIndices[3 * t];
+		for (int c = 0; c < 3; ++c)
+		{
+			if (tri[c] != keep)
+				ring.push_back(tri[c]);
+		}
+	}
+	std::sort(ring.begin(), ring.end());
+	ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+	for (std::uint32_t v : ring)
+		Push(keep, v);
+}
+
+void MeshSimplifier::Simplify(std::size_t targetTriangleCount)
+{
+	while (mTriangleCount > targetTriangleCount && !mQueue.empty())
+	{
+		const Candidate candidate = mQueue.top();
+		mQueue.pop();
+
+		if (mRemoved[candidate.V0] || mRemoved[candidate.V1] ||
+			mVersions[candidate.V0] != candidate.Version0 || mVersions[candidate.V1] != candidate.Version1)
+			continue;
+
+		// A refused collapse is dropped; it comes back if a neighboring
+		// collapse changes either vertex.
+		Collapse collapse;
+		if (Evaluate(candidate.V0, candidate.V1, collapse) && IsValid(collapse))
+			Apply(collapse);
+	}
+}
+
+float MeshSimplifier::Error() const
+{
+	return static_cast<float>(std::sqrt(mMaxError));
+}
+
+GeometryGenerator::MeshData MeshSimplifier::Extract() const
+{
+	GeometryGenerator::MeshData meshData;
+
+	std::vector<std::uint32_t> remap(mTangents.size(), MeshOptimizer::NoVertex);
+	meshData.Indices32.reserve(mTriangleCount * 3);
+	for (std::size_t t = 0; t < mTriangleRemoved.size(); ++t)
+	{
+		if (mTriangleRemoved[t])
+			continue;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const std::uint32_t v = mIndices[3 * t + c];
+			if (remap[v] == MeshOptimizer::NoVertex)
+			{
+				remap[v] = static_cast<std::uint32_t>(meshData.Vertices.size());
+
+				const double* p = &mPoints[v * N];
+				GeometryGenerator::Vertex vertex;
+				vertex.Position = XMFLOAT3(
+					static_cast<float>(p[0] * mExtent + mCenter.x),
+					static_cast<float>(p[1] * mExtent + mCenter.y),
+					static_cast<float>(p[2] * mExtent + mCenter.z));
+
+				XMVECTOR normal = XMVectorSet(static_cast<float>(p[3]), static_cast<float>(p[4]),
+					static_cast<float>(p[5]), 0.0f);
+				XMStoreFloat3(&vertex.Normal, XMVector3Normalize(normal));
+
+				vertex.TangentU = mTangents[v];
+				vertex.TexC = XMFLOAT2(static_cast<float>(p[6] / mOptions.TexCoordWeight),
+					static_cast<float>(p[7] / mOptions.TexCoordWeight));
+				meshData.Vertices.push_back(vertex);
+			}
+			meshData.Indices32.push_back(remap[v]);
+		}
+	}
+
+	return meshData;
+}
+
+std::vector<MeshLod> MeshSimplifier::BuildLodChain(const GeometryGenerator::MeshData& meshData,
+	const std::vector<float>& ratios, GeometryGenerator::MeshData& packed, const MeshSimplifyOptions& options)
+{
+	MeshSimplifier simplifier(meshData, options);
+	const std::size_t triangleCount = simplifier.TriangleCount();
+
+	std::vector<MeshLod> lods;
+	for (float ratio : ratios)
+	{
+		const std::size_t target = static_cast<std::size_t>(std::max(0.0f, ratio) * triangleCount);
+		if (ratio < 1.0f)
+			simplifier.Simplify(std::max<std::size_t>(target, 1));
+
+		GeometryGenerator::MeshData level = simplifier.Extract();
+		MeshOptimizer::Optimize(level);
+
+		MeshLod lod;
+		lod.Ratio = ratio;
+		lod.TriangleCount = static_cast<std::uint32_t>(level.Indices32.size() / 3);
+		lod.VertexCount = static_cast<std::uint32_t>(level.Vertices.size());
+		lod.IndexCount = static_cast<std::uint32_t>(level.Indices32.size());
+		lod.StartIndexLocation = static_cast<std::uint32_t>(packed.Indices32.size());
+		lod.BaseVertexLocation = static_cast<std::int32_t>(packed.Vertices.size());
+		lod.Error = simplifier.Error();
+		lods.push_back(lod);
+
+		packed.Vertices.insert(packed.Vertices.end(), level.Vertices.begin(), level.Vertices.end());
+		packed.Indices32.insert(packed.Indices32.end(), level.Indices32.begin(), level.Indices32.end());
+	}
+
+	return lods;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "GeometryGenerator.h"
+
+struct MeshSimplifyOptions
+{
+	// How much a change in the normal or texture coordinates costs next to
+	// moving the surface.  Positions are measured in units of the mesh's
+	// largest bounding box side, normals and texture coordinates as they
+	// are; 0 simplifies by shape alone.
+	float NormalWeight = 0.25f;
+	float TexCoordWeight = 0.5f;
+
+	// Cost of moving an open border edge off its line, relative to moving a
+	// triangle off its plane.
+	float BorderWeight = 10.0f;
+
+	// A collapse that turns a remaining triangle's normal further than this
+	// (as a cosine) is refused, which keeps the surface from folding over.
+	float MinNormalDot = 0.2f;
+};
+
+// One level of a chain built by MeshSimplifier::BuildLodChain, as the
+// arguments to draw it from the packed buffers.
+struct MeshLod
+{
+	// The fraction of the input's triangles asked for, and what came out.
+	// A mesh can run out of valid collapses before reaching its target.
+	float Ratio = 1.0f;
+	std::uint32_t TriangleCount = 0;
+	std::uint32_t VertexCount = 0;
+
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+
+	// Largest RMS distance of a merged vertex from the planes of the input
+	// triangles it replaced, as a fraction of the largest bounding box side.
+	// Normals and texture coordinates do not count here.
+	float Error = 0.0f;
+};
+
+// Edge-collapse simplifier after Garland and Heckbert's "Simplifying Surfaces
+// with Color and Texture using Quadric Error Metrics": every vertex is a
+// point (position, normal, texture coordinates) in 8D, every triangle
+// contributes the squared distance to its plane in that space, and the edge
+// whose merged vertex costs least is collapsed first, with the merged vertex
+// placed where its summed quadric is smallest.  So detail goes first where
+// the surface is flat and its shading smooth.
+//
+// Vertices whose position is shared with another vertex (the two sides of a
+// normal or texture seam) stay where they are, so seams never tear open.
+// Tangents are carried along but do not count toward the error.
+class MeshSimplifier
+{
+public:
+	explicit MeshSimplifier(const GeometryGenerator::MeshData& meshData,
+		const MeshSimplifyOptions& options = MeshSimplifyOptions());
+
+	// Collapses edges until at most targetTriangleCount triangles are left
+	// or no valid collapse remains.  Calls can continue from each other with
+	// ever smaller targets.
+	void Simplify(std::size_t targetTriangleCount);
+
+	std::size_t TriangleCount() const { return mTriangleCount; }
+
+	// Largest error of a collapse so far, as in MeshLod::Error.
+	float Error() const;
+
+	// The mesh as it is now, with only the vertices its triangles use.
+	GeometryGenerator::MeshData Extract() const;
+
+	// Simplifies the mesh to each ratio of its triangle count in turn
+	// (ratios must decrease; 1 keeps the input as it is), optimizes each
+	// level for the vertex cache and appends them all to one vertex and one
+	// index array, each level's indices relative to its first vertex.
+	static std::vector<MeshLod> BuildLodChain(const GeometryGenerator::MeshData& meshData,
+		const std::vector<float>& ratios, GeometryGenerator::MeshData& packed,
+		const MeshSimplifyOptions& options = MeshSimplifyOptions());
+
+	// Position, normal and texture coordinates, scaled by the options.
+	static const int Dimension = 8;
+
+private:
+	// Symmetric Dimension x Dimension matrix A (upper triangle), vector b and
+	// constant c of the error v^T A v + 2 b^T v + c, plus the area the error
+	// was summed over.
+	struct Quadric
+	{
+		double A[Dimension * (Dimension + 1) / 2] = {};
+		double B[Dimension] = {};
+		double C = 0.0;
+		double Area = 0.0;
+
+		Quadric& operator+=(const Quadric& rhs);
+		double Evaluate(const double* v) const;
+		bool Minimize(double* v) const;
+	};
+
+	struct Collapse
+	{
+		std::uint32_t Keep;
+		std::uint32_t Remove;
+		double Cost;
+		double Point[Dimension];
+	};
+
+	// A queued edge, valid while neither vertex has changed since.
+	struct Candidate
+	{
+		double Cost;
+		std::uint32_t V0;
+		std::uint32_t V1;
+		std::uint32_t Version0;
+		std::uint32_t Version1;
+
+		bool operator>(const Candidate& rhs) const { return Cost > rhs.Cost; }
+	};
+
+	void BuildQuadrics();
+	void Push(std::uint32_t v0, std::uint32_t v1);
+	bool Evaluate(std::uint32_t v0, std::uint32_t v1, Collapse& collapse) const;
+	bool IsValid(const Collapse& collapse) const;
+	void Apply(const Collapse& collapse);
+
+	bool HasVertex(std::uint32_t triangle, std::uint32_t v) const;
+
+	MeshSimplifyOptions mOptions;
+
+	// Undo the scaling into the error space.
+	DirectX::XMFLOAT3 mCenter = { 0.0f, 0.0f, 0.0f };
+	float mExtent = 1.0f;
+
+	std::vector<double> mPoints;
+	std::vector<DirectX::XMFLOAT3> mTangents;
+	std::vector<Quadric> mQuadrics;
+
+	// The triangles' planes in position alone, which MeshLod::Error is
+	// measured by.
+	std::vector<Quadric> mShapeQuadrics;
+	std::vector<std::uint32_t> mVersions;
+	std::vector<unsigned char> mLocked;
+	std::vector<unsigned char> mRemoved;
+
+	std::vector<std::uint32_t> mIndices;
+	std::vector<unsigned char> mTriangleRemoved;
+	std::vector<std::vector<std::uint32_t>> mVertexTriangles;
+	std::size_t mTriangleCount = 0;
+
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> mQueue;
+	double mMaxError = 0.0;
+};
@@ -94,6 +94,34 @@ VertexOut VS(VertexIn vin)
     return vout;
 }
 
+// 압축 파도 정점. x, z는 정적인 0번 슬롯에서, 높이와 팔면체 부호화된
+// 법선은 프레임마다 올리는 1번 슬롯에서 읽는다.
+struct WavesVertexIn
+{
+    float2 PosXZ : POSITION;
+    float Height : HEIGHT;
+    float2 NormalOct : NORMAL;
+};
+
+// 팔면체 부호화(+y 축)를 푼다. 아래쪽 반구는 대각선을 따라 접혀 있다.
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e.x, 1.0f - abs(e.x) - abs(e.y), e.y);
+    float t = saturate(-n.y);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.z += n.z >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+VertexOut WavesVS(WavesVertexIn vin)
+{
+    VertexIn full;
+    full.PosL = float3(vin.PosXZ.x, vin.Height, vin.PosXZ.y);
+    full.NormalL = DecodeOctahedral(vin.NormalOct);
+
+    return VS(full);
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
 	// 법선을 보간하면 단위 길이가 아니게 될 수 있으므로
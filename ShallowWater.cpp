@@ -0,0 +1,428 @@
+#include "ShallowWater.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+using namespace DirectX;
+
+const float ShallowWater::DryDepthThreshold = 1e-4f;
+const int ShallowWater::DisturbRingInner;
+const int ShallowWater::DisturbRingOuter;
+
+namespace
+{
+	// Face between cells a and b; a positive velocity moves water from a to b.
+	// 'open' is 1, or 0 to keep the face closed.  Branch-free so the loops
+	// over a run vectorize.
+	inline void UpdateFace(float bedA, float depthA, float bedB, float depthB, float open,
+		float slopeScale, float drag, float maxVelocity, float& velocity, float& flux)
+	{
+		const float surfaceA = bedA + depthA;
+		const float surfaceB = bedB + depthB;
+
+		// Water the face can carry: the higher surface above the higher bed.
+		const float faceDepth = std::max(surfaceA, surfaceB) - std::max(bedA, bedB);
+
+		float v = (velocity - slopeScale * (surfaceB - surfaceA)) * drag;
+		v = std::min(std::max(v, -maxVelocity), maxVelocity);
+		v = (faceDepth > ShallowWater::DryDepthThreshold ? v : 0.0f) * open;
+
+		velocity = v;
+		flux = std::max(v, 0.0f) * depthA + std::min(v, 0.0f) * depthB;
+	}
+
+	// 'count' consecutive faces.  The outputs never overlap the inputs.
+	void UpdateFaces(const float* bedA, const float* depthA, const float* bedB, const float* depthB,
+		const float* open, float slopeScale, float drag, float maxVelocity,
+		float* __restrict velocity, float* __restrict flux, int count)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			UpdateFace(bedA[j], depthA[j], bedB[j], depthB[j], open[j],
+				slopeScale, drag, maxVelocity, velocity[j], flux[j]);
+		}
+	}
+}
+
+ShallowWater::ShallowWater(int m, int n, float dx, float dt, float damping, float gravity)
+{
+	assert(m >= 2 && n >= 2);
+	assert(dt > 0.0f && dx > 0.0f);
+
+	mNumRows = m;
+	mNumCols = n;
+	mSpatialStep = dx;
+	mTimeStep = dt;
+	mGravity = gravity;
+	mDamping = damping;
+
+	mPool = &ThreadPool::Default();
+	mRowGrain = std::max(1, (16 * 1024) / std::max(n, 1));
+
+	mBed.assign(m * n, 0.0f);
+	mDepth.assign(m * n, 0.0f);
+	mSurface.assign(m * n, 0.0f);
+	mWettable.assign(m * n, 1.0f);
+	mNormals.assign(m * n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+
+	mVelocityX.assign(m * (n + 1), 0.0f);
+	mVelocityZ.assign((m + 1) * n, 0.0f);
+	mFluxX.assign(m * (n + 1), 0.0f);
+	mFluxZ.assign((m + 1) * n, 0.0f);
+
+	// Flat, dry bed at 0.
+	SetBathymetry([](float, float) { return 0.0f; }, 0.0f);
+}
+
+ShallowWater::~ShallowWater()
+{
+}
+
+void ShallowWater::SetBathymetry(const std::function<float(float, float)>& bed, float waterLevel, float floodMargin)
+{
+	const int m = mNumRows;
+	const int n = mNumCols;
+	const float halfWidth = 0.5f * Width();
+	const float halfDepth = 0.5f * Depth();
+
+	mRuns.clear();
+	mRowRuns.assign(m + 1, 0);
+	mSimulatedCount = 0;
+
+	for (int i = 0; i < m; ++i)
+	{
+		mRowRuns[i] = static_cast<int>(mRuns.size());
+
+		for (int j = 0; j < n; ++j)
+		{
+			const int k = i * n + j;
+			mBed[k] = bed(-halfWidth + j * mSpatialStep, halfDepth - i * mSpatialStep);
+
+			const bool wettable = mBed[k] < waterLevel + floodMargin;
+			mWettable[k] = wettable ? 1.0f : 0.0f;
+			mDepth[k] = wettable ? std::max(waterLevel - mBed[k], 0.0f) : 0.0f;
+
+			if (!wettable)
+				continue;
+
+			++mSimulatedCount;
+			if (j > 0 && mWettable[k - 1] != 0.0f)
+			{
+				mRuns.back().Last = j + 1;
+			}
+			else
+			{
+				Run run;
+				run.First = j;
+				run.Last = j + 1;
+				mRuns.push_back(run);
+			}
+		}
+	}
+	mRowRuns[m] = static_cast<int>(mRuns.size());
+
+	std::fill(mVelocityX.begin(), mVelocityX.end(), 0.0f);
+	std::fill(mVelocityZ.begin(), mVelocityZ.end(), 0.0f);
+	std::fill(mFluxX.begin(), mFluxX.end(), 0.0f);
+	std::fill(mFluxZ.begin(), mFluxZ.end(), 0.0f);
+	std::fill(mNormals.begin(), mNormals.end(), XMFLOAT3(0.0f, 1.0f, 0.0f));
+
+	for (int i = 0; i < m; ++i)
+		UpdateSurfaceRow(i);
+	for (int i = 1; i < m - 1; ++i)
+		UpdateNormalRow(i);
+}
+
+void ShallowWater::SetDryOffset(float offset)
+{
+	mDryOffset = offset;
+	for (int i = 0; i < mNumRows; ++i)
+		UpdateSurfaceRow(i);
+}
+
+void ShallowWater::SetThreadPool(ThreadPool* pool)
+{
+	mPool = pool != nullptr ? pool : &ThreadPool::Default();
+}
+
+void ShallowWater::SetMaxSubsteps(int count)
+{
+	mMaxSubsteps = std::max(count, 1);
+}
+
+int ShallowWater::WetCellCount() const
+{
+	int count = 0;
+	for (int i = 0; i < mNumCols * mNumRows; ++i)
+	{
+		if (IsWet(i))
+			++count;
+	}
+	return count;
+}
+
+double ShallowWater::Volume() const
+{
+	double volume = 0.0;
+	for (float depth : mDepth)
+		volume += depth;
+	return volume * mSpatialStep * mSpatialStep;
+}
+
+float ShallowWater::CourantNumber() const
+{
+	const float deepest = *std::max_element(mDepth.begin(), mDepth.end());
+	return sqrtf(mGravity * deepest) * mTimeStep / mSpatialStep;
+}
+
+int ShallowWater::Update(float dt)
+{
+	mAccumulator += dt;
+
+	int steps = 0;
+	while (mAccumulator >= mTimeStep && steps < mMaxSubsteps)
+	{
+		Step();
+		mAccumulator -= mTimeStep;
+		++steps;
+	}
+
+	if (mAccumulator >= mTimeStep)
+	{
+		mAccumulator = fmodf(mAccumulator, mTimeStep);
+	}
+
+	return steps;
+}
+
+void ShallowWater::Step()
+{
+	// Velocities read the old depths and depths read the new fluxes, so each
+	// pass is free to run its rows in any order.
+	mPool->ParallelFor(0, mNumRows, mRowGrain, [this](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+				UpdateVelocityRow(i);
+		});
+
+	mPool->ParallelFor(0, mNumRows, mRowGrain, [this](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+				UpdateDepthRow(i);
+		});
+
+	mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+				UpdateNormalRow(i);
+		});
+
+	++mStepCount;
+}
+
+void ShallowWater::UpdateVelocityRow(int i)
+{
+	const int n = mNumCols;
+	const float slopeScale = mGravity * mTimeStep / mSpatialStep;
+	const float drag = 1.0f / (1.0f + mDamping * mTimeStep);
+
+	// No face may drain more than a quarter of a cell per step, which keeps
+	// every depth non-negative with four faces draining at once.
+	const float maxVelocity = 0.25f * mSpatialStep / mTimeStep;
+
+	const float* bed = &mBed[i * n];
+	const float* depth = &mDepth[i * n];
+	const float* wettable = &mWettable[i * n];
+
+	for (int r = mRowRuns[i]; r < mRowRuns[i + 1]; ++r)
+	{
+		const int first = mRuns[r].First;
+		const int last = mRuns[r].Last;
+
+		// x faces inside the run, all open.  The faces at its ends border land
+		// or the grid edge and stay closed.
+		UpdateFaces(bed + first, depth + first, bed + first + 1, depth + first + 1,
+			wettable + first, slopeScale, drag, maxVelocity,
+			&mVelocityX[i * (n + 1) + first + 1], &mFluxX[i * (n + 1) + first + 1], last - first - 1);
+
+		if (i == 0)
+			continue;
+
+		// z faces to the row above; closed where that cell is land.
+		UpdateFaces(bed - n + first, depth - n + first, bed + first, depth + first,
+			wettable - n + first, slopeScale, drag, maxVelocity,
+			&mVelocityZ[i * n + first], &mFluxZ[i * n + first], last - first);
+	}
+}
+
+void ShallowWater::UpdateDepthRow(int i)
+{
+	const int n = mNumCols;
+	const float k = mTimeStep / mSpatialStep;
+	const float dryOffset = mDryOffset;
+
+	const float* bed = &mBed[i * n];
+	float* depth = &mDepth[i * n];
+	float* surface = &mSurface[i * n];
+	const float* fluxX = &mFluxX[i * (n + 1)];
+	const float* fluxAbove = &mFluxZ[i * n];
+	const float* fluxBelow = &mFluxZ[(i + 1) * n];
+
+	for (int r = mRowRuns[i]; r < mRowRuns[i + 1]; ++r)
+	{
+		const Run& run = mRuns[r];
+		for (int j = run.First; j < run.Last; ++j)
+		{
+			const float outflow = fluxX[j + 1] - fluxX[j] + fluxBelow[j] - fluxAbove[j];
+			const float h = std::max(depth[j] - k * outflow, 0.0f);
+
+			depth[j] = h;
+			surface[j] = bed[j] + (h > DryDepthThreshold ? h : -dryOffset);
+		}
+	}
+}
+
+void ShallowWater::UpdateSurfaceRow(int i)
+{
+	const int n = mNumCols;
+	for (int j = i * n; j < (i + 1) * n; ++j)
+	{
+		mSurface[j] = mBed[j] + (mDepth[j] > DryDepthThreshold ? mDepth[j] : -mDryOffset);
+	}
+}
+
+void ShallowWater::UpdateNormalRow(int i)
+{
+	const int n = mNumCols;
+	const float* h = mSurface.data();
+
+	for (int r = mRowRuns[i]; r < mRowRuns[i + 1]; ++r)
+	{
+		const Run& run = mRuns[r];
+		for (int j = std::max(run.First, 1); j < std::min(run.Last, n - 1); ++j)
+		{
+			float l = h[i * n + j - 1];
+			float rt = h[i * n + j + 1];
+			float t = h[(i - 1) * n + j];
+			float b = h[(i + 1) * n + j];
+
+			XMVECTOR normal = XMVector3Normalize(XMVectorSet(l - rt, 2.0f * mSpatialStep, b - t, 0.0f));
+			XMStoreFloat3(&mNormals[i * n + j], normal);
+		}
+	}
+}
+
+void ShallowWater::Disturb(int i, int j, float magnitude)
+{
+	const int maxRing = (2 * DisturbRingOuter + 1) * (2 * DisturbRingOuter + 1) -
+		(2 * DisturbRingInner - 1) * (2 * DisturbRingInner - 1);
+
+	int splat[5];
+	float share[5];
+	int splatCount = 0;
+	float shareSum = 0.0f;
+
+	const int di[5] = { 0, 0, 0, 1, -1 };
+	const int dj[5] = { 0, 1, -1, 0, 0 };
+	for (int k = 0; k < 5; ++k)
+	{
+		int r = i + di[k];
+		int c = j + dj[k];
+		if (r < 0 || r > mNumRows - 1 || c < 0 || c > mNumCols - 1)
+			continue;
+
+		const int cell = r * mNumCols + c;
+		if (IsLand(cell))
+			continue;
+
+		splat[splatCount] = cell;
+		share[splatCount] = k == 0 ? 1.0f : 0.5f;
+		shareSum += share[splatCount];
+		++splatCount;
+	}
+
+	int ring[maxRing];
+	int ringCount = 0;
+	double ringDepth = 0.0;
+	for (int r = std::max(i - DisturbRingOuter, 0); r <= std::min(i + DisturbRingOuter, mNumRows - 1); ++r)
+	{
+		for (int c = std::max(j - DisturbRingOuter, 0); c <= std::min(j + DisturbRingOuter, mNumCols - 1); ++c)
+		{
+			const int cell = r * mNumCols + c;
+			if (std::max(std::abs(r - i), std::abs(c - j)) < DisturbRingInner || IsLand(cell))
+				continue;
+
+			ring[ringCount++] = cell;
+			ringDepth += mDepth[cell];
+		}
+	}
+
+	if (splatCount == 0 || ringCount == 0)
+		return;
+
+	if (magnitude >= 0.0f)
+	{
+		// The ring gives up the water in proportion to its depths.  If it
+		// holds less than the splat asks for, the splat shrinks to match.
+		const double wanted = static_cast<double>(magnitude) * shareSum;
+		if (wanted <= 0.0 || ringDepth <= 0.0)
+			return;
+
+		const double taken = std::min(wanted, ringDepth);
+		const float scale = static_cast<float>(taken / wanted);
+		const float keep = static_cast<float>(1.0 - taken / ringDepth);
+
+		for (int k = 0; k < ringCount; ++k)
+			mDepth[ring[k]] *= keep;
+		for (int k = 0; k < splatCount; ++k)
+			mDepth[splat[k]] += share[k] * magnitude * scale;
+	}
+	else
+	{
+		// The splat gives up what it has, at most its share, and the ring
+		// takes it in equal parts.
+		double taken = 0.0;
+		for (int k = 0; k < splatCount; ++k)
+		{
+			const float removed = std::min(mDepth[splat[k]], -share[k] * magnitude);
+			mDepth[splat[k]] -= removed;
+			taken += removed;
+		}
+
+		const float added = static_cast<float>(taken / ringCount);
+		for (int k = 0; k < ringCount; ++k)
+			mDepth[ring[k]] += added;
+	}
+
+	auto updateSurface = [this](int cell)
+	{
+		mSurface[cell] = IsWet(cell) ? mBed[cell] + mDepth[cell] : mBed[cell] - mDryOffset;
+	};
+	for (int k = 0; k < splatCount; ++k)
+		updateSurface(splat[k]);
+	for (int k = 0; k < ringCount; ++k)
+		updateSurface(ring[k]);
+}
+
+void ShallowWater::WriteVertices(void* dst, const WavesVertexLayout& layout) const
+{
+	unsigned char* base = static_cast<unsigned char*>(dst);
+	const float du = 1.0f / (mNumCols - 1);
+	const float dv = 1.0f / (mNumRows - 1);
+	const float halfWidth = 0.5f * Width();
+	const float halfDepth = 0.5f * Depth();
+
+	mPool->ParallelFor(0, mNumRows, mRowGrain, [&](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				WavesSimd::StreamVertexRow(
+					base + static_cast<std::size_t>(i) * mNumCols * layout.Stride, layout,
+					&mSurface[i * mNumCols], &mNormals[i * mNumCols].x, mNumCols,
+					-halfWidth, mSpatialStep, halfDepth - i * mSpatialStep,
+					du, i * dv);
+			}
+		});
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+#include "WavesSimd.h"
+
+class ThreadPool;
+
+// Linearized-momentum shallow-water equations over a terrain bed, solved with
+// a staggered-grid finite-volume scheme.
+//
+// Each cell of the m x n grid (placed like Waves' vertices, row 0 at +z)
+// holds a bed elevation and a water depth; x and z velocities live on the
+// faces between cells.  A step first accelerates every face velocity by the
+// water-surface slope across it, then moves water through the faces with the
+// depth of the upwind cell (donor cell), so the total volume is conserved
+// exactly and depths never go negative.
+//
+// Wet and dry cells:
+//   - A face only carries water when the higher of the two surfaces is above
+//     the higher of the two beds.  Water at rest next to a hill stays at rest,
+//     and water can run up onto a dry slope or spill off a ledge.
+//   - Cells whose bed is more than floodMargin above the still water level
+//     (see SetBathymetry) are land.  They are never visited, so cells buried
+//     under hills cost nothing, and they act as walls.
+//   - The rest are visited as contiguous runs of columns with branch-free
+//     loops the compiler can vectorize; a dry cell in a run is zero work
+//     arithmetically, not a special case.
+//
+// The grid edges are closed walls.
+class ShallowWater
+{
+public:
+	// dt must keep sqrt(g * depth) * dt / dx below ~0.7 at the deepest water;
+	// see CourantNumber().  damping is a linear drag on the velocities, in 1/s.
+	ShallowWater(int m, int n, float dx, float dt, float damping, float gravity = 9.81f);
+	ShallowWater(const ShallowWater& rhs) = delete;
+	ShallowWater& operator=(const ShallowWater& rhs) = delete;
+	~ShallowWater();
+
+	int RowCount() const { return mNumRows; }
+	int ColumnCount() const { return mNumCols; }
+	int VertexCount() const { return mNumRows * mNumCols; }
+	int TriangleCount() const { return 2 * (mNumRows - 1) * (mNumCols - 1); }
+	float Width() const { return (mNumCols - 1) * mSpatialStep; }
+	float Depth() const { return (mNumRows - 1) * mSpatialStep; }
+	float SpatialStep() const { return mSpatialStep; }
+
+	// Samples bed(x, z) at every cell, fills the water to a flat waterLevel
+	// with zero velocity, and marks as land every cell whose bed is above
+	// waterLevel + floodMargin.  Water never rises onto land; floodMargin is
+	// how far above the still level it may still run up.
+	void SetBathymetry(const std::function<float(float, float)>& bed, float waterLevel, float floodMargin = 1.0f);
+
+	float Bed(int i) const { return mBed[i]; }
+	float WaterDepth(int i) const { return mDepth[i]; }
+	bool IsWet(int i) const { return mDepth[i] > DryDepthThreshold; }
+	bool IsLand(int i) const { return mWettable[i] == 0.0f; }
+
+	// Rendered height: the water surface where wet, DryOffset() below the bed
+	// elsewhere so the terrain hides it.
+	float Height(int i) const { return mSurface[i]; }
+	DirectX::XMFLOAT3 Position(int i) const
+	{
+		return DirectX::XMFLOAT3(
+			-0.5f * Width() + (i % mNumCols) * mSpatialStep,
+			mSurface[i],
+			0.5f * Depth() - (i / mNumCols) * mSpatialStep);
+	}
+	const DirectX::XMFLOAT3& Normal(int i) const { return mNormals[i]; }
+
+	float DryOffset() const { return mDryOffset; }
+	void SetDryOffset(float offset);
+
+	// Cells that are simulated (not land), and how many of them hold water.
+	int SimulatedCellCount() const { return mSimulatedCount; }
+	int WetCellCount() const;
+
+	// Sum of depth * cell area over the grid.
+	double Volume() const;
+
+	// Gravity-wave Courant number, sqrt(g * depth) * dt / dx, at the deepest
+	// cell.
+	float CourantNumber() const;
+
+	// Same fixed-step accumulator as Waves::Update.  Returns the steps taken.
+	int Update(float dt);
+	int MaxSubsteps() const { return mMaxSubsteps; }
+	void SetMaxSubsteps(int count);
+	unsigned long long StepCount() const { return mStepCount; }
+
+	// Raises the water around cell (i, j) by Waves::Disturb's five-point
+	// splat and lowers the ring of cells DisturbRingInner to DisturbRingOuter
+	// cells out by the same volume, so the basin's level stays where it is.
+	// Land cells are skipped.  A ring too shallow to pay for the splat
+	// shrinks it; a negative magnitude takes at most the water the splat's
+	// cells hold and spreads it over the ring.
+	void Disturb(int i, int j, float magnitude);
+
+	// Same as Waves::WriteVertices.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout) const;
+
+	ThreadPool* Pool() const { return mPool; }
+	void SetThreadPool(ThreadPool* pool);
+
+	// Depth below which a cell counts as dry.
+	static const float DryDepthThreshold;
+
+	// Ring that balances Disturb, in cells from its center along the
+	// farther of the two axes.
+	static const int DisturbRingInner = 2;
+	static const int DisturbRingOuter = 3;
+
+private:
+	void Step();
+
+	// Per row: face velocities and fluxes, then depths and surfaces, then
+	// normals.  Each pass only touches the row's runs of simulated cells.
+	void UpdateVelocityRow(int i);
+	void UpdateDepthRow(int i);
+	void UpdateNormalRow(int i);
+	void UpdateSurfaceRow(int i);
+
+private:
+	int mNumRows = 0;
+	int mNumCols = 0;
+	float mSpatialStep = 0.0f;
+	float mTimeStep = 0.0f;
+	float mGravity = 0.0f;
+	float mDamping = 0.0f;
+	float mDryOffset = 1.0f;
+
+	float mAccumulator = 0.0f;
+	int mMaxSubsteps = 4;
+	unsigned long long mStepCount = 0;
+
+	ThreadPool* mPool = nullptr;
+	int mRowGrain = 1;
+
+	// Per cell, row-major.  mWettable is 1 for simulated cells and 0 for
+	// land, as a float so it can scale velocities without a branch.
+	std::vector<float> mBed;
+	std::vector<float> mDepth;
+	std::vector<float> mSurface;
+	std::vector<float> mWettable;
+	std::vector<DirectX::XMFLOAT3> mNormals;
+
+	// x faces: m rows of n+1, face j between cells j-1 and j.  z faces: m+1
+	// rows of n, face row i between cell rows i-1 and i.  Edge faces are walls
+	// and stay 0, as do faces next to land.
+	std::vector<float> mVelocityX;
+	std::vector<float> mVelocityZ;
+	std::vector<float> mFluxX;
+	std::vector<float> mFluxZ;
+
+	// Runs [First, Last) of simulated columns; row i owns runs
+	// [mRowRuns[i], mRowRuns[i + 1]).
+	struct Run
+	{
+		int First = 0;
+		int Last = 0;
+	};
+	std::vector<Run> mRuns;
+	std::vector<int> mRowRuns;
+	int mSimulatedCount = 0;
+};
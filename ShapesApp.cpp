@@ -2,6 +2,8 @@
 #include "MathHelper.h"
 #include "FrameResource.h"
 #include "GeometryGenerator.h"
+#include "GeometryCache.h"
+#include "MeshOptimizer.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -514,48 +516,49 @@ void ShapesApp::BuildShadersAndInputLayout()
 
 void ShapesApp::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
+	// 같은 매개변수의 기하구조는 한 번만 생성해서 공유한다.
+	GeometryCache& geoCache = GeometryCache::Default();
+	GeometryCache::MeshPtr box = geoCache.CreateBox(1.5f, 0.5f, 1.5f, 3);
+	GeometryCache::MeshPtr grid = geoCache.CreateGrid(20.0f, 30.0f, 60, 40);
+	GeometryCache::MeshPtr sphere = geoCache.CreateSphere(0.5f, 20, 20);
 	// 7장 연습문제 1번. CreateGeosphere를 사용하도록 수정. 세부수준 0, 1, 2, 3
-	//GeometryGenerator::MeshData sphere = geoGen.CreateGeosphere(0.5f, 3);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	//GeometryCache::MeshPtr sphere = geoCache.CreateGeosphere(0.5f, 3);
+	GeometryCache::MeshPtr cylinder = geoCache.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
 
 	// 이 예제는 모든 기하구조를 하나의 커다란 정점/색인 버퍼에 담는다.
 	// 따라서 버퍼에서 각 부분 메시가 차지하는 영역들을 정의할 필요가 있다.
 
 	// 연결된 정점 버퍼에서의 각 물체의 정점 오프셋을 적절한 변수들에 보관해 둔다.
 	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = static_cast<UINT>(box.Vertices.size());
-	UINT sphereVertexOffset = gridVertexOffset + static_cast<UINT>(grid.Vertices.size());
-	UINT cylinderVertexOffset = sphereVertexOffset + static_cast<UINT>(sphere.Vertices.size());
+	UINT gridVertexOffset = static_cast<UINT>(box->Vertices.size());
+	UINT sphereVertexOffset = gridVertexOffset + static_cast<UINT>(grid->Vertices.size());
+	UINT cylinderVertexOffset = sphereVertexOffset + static_cast<UINT>(sphere->Vertices.size());
 
 	// 연결된 정점 버퍼에서의 각 물체의 시작 색인을 적절한 변수들에 보관해 둔다.
 	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = static_cast<UINT>(box.Indices32.size());
-	UINT sphereIndexOffset = gridIndexOffset + static_cast<UINT>(grid.Indices32.size());
-	UINT cylinderIndexOffset = sphereIndexOffset + static_cast<UINT>(sphere.Indices32.size());
+	UINT gridIndexOffset = static_cast<UINT>(box->Indices32.size());
+	UINT sphereIndexOffset = gridIndexOffset + static_cast<UINT>(grid->Indices32.size());
+	UINT cylinderIndexOffset = sphereIndexOffset + static_cast<UINT>(sphere->Indices32.size());
 
 	// 정점/색인 버퍼에서 각 물체가 차지하는 영역을 나타내는 
 	// SubmeshGeometry 객체들을 정의한다.
 	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = static_cast<UINT>(box.Indices32.size());
+	boxSubmesh.IndexCount = static_cast<UINT>(box->Indices32.size());
 	boxSubmesh.StartIndexLocation = boxIndexOffset;
 	boxSubmesh.BaseVertexLocation = boxVertexOffset;
 
 	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = static_cast<UINT>(grid.Indices32.size());
+	gridSubmesh.IndexCount = static_cast<UINT>(grid->Indices32.size());
 	gridSubmesh.StartIndexLocation = gridIndexOffset;
 	gridSubmesh.BaseVertexLocation = gridVertexOffset;
 
 	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = static_cast<UINT>(sphere.Indices32.size());
+	sphereSubmesh.IndexCount = static_cast<UINT>(sphere->Indices32.size());
 	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
 	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
 
 	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = static_cast<UINT>(cylinder.Indices32.size());
+	cylinderSubmesh.IndexCount = static_cast<UINT>(cylinder->Indices32.size());
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
@@ -563,41 +566,41 @@ void ShapesApp::BuildShapeGeometry()
 		필요한 정점 성분들을 추출하고, 모든 메시의 정점들을
 		하나의 정점 버퍼에 넣는다.
 	*/
-	auto totalVertexCount = box.Vertices.size() + grid.Vertices.size() + sphere.Vertices.size()
-		+ cylinder.Vertices.size();
+	auto totalVertexCount = box->Vertices.size() + grid->Vertices.size() + sphere->Vertices.size()
+		+ cylinder->Vertices.size();
 
 	std::vector<Vertex> vertices(totalVertexCount);
 
 	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < box->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
+		vertices[k].Pos = box->Vertices[i].Position;
 		vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
 	}
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < grid->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
+		vertices[k].Pos = grid->Vertices[i].Position;
 		vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
 	}
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < sphere->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
+		vertices[k].Pos = sphere->Vertices[i].Position;
 		vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
 	}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < cylinder->Vertices.size(); ++i, ++k)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
+		vertices[k].Pos = cylinder->Vertices[i].Position;
 		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
 	}
 
 	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	indices.insert(indices.end(), std::begin(box->CachedIndices16()), std::end(box->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(grid->CachedIndices16()), std::end(grid->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(sphere->CachedIndices16()), std::end(sphere->CachedIndices16()));
+	indices.insert(indices.end(), std::begin(cylinder->CachedIndices16()), std::end(cylinder->CachedIndices16()));
 
 	const UINT vbByteSize = static_cast<UINT>(vertices.size()) * sizeof(Vertex);
 	const UINT ibByteSize = static_cast<UINT>(indices.size()) * sizeof(std::uint16_t);
@@ -659,7 +662,7 @@ void ShapesApp::BuildSkullGeometry()
 	fin >> ignore;
 	fin >> ignore;
 
-	std::vector<std::int32_t> indices(3 * tcount);
+	std::vector<std::uint32_t> indices(3 * tcount);
 	for (UINT i = 0; i < tcount; i++)
 	{
 		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
@@ -667,8 +670,11 @@ void ShapesApp::BuildSkullGeometry()
 
 	fin.close();
 
+	// 삼각형 순서가 정점 캐시에 더 맞을 때만 바꾸고, 정점들은 처음 쓰이는 순서로 재배치한다.
+	MeshOptimizer::Optimize(vertices, indices);
+
 	const UINT vbByteSize = sizeof(Vertex) * vertices.size();
-	const UINT ibByteSize = sizeof(std::int32_t) * indices.size();
+	const UINT ibByteSize = sizeof(std::uint32_t) * indices.size();
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "skullGeo";
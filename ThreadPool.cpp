@@ -0,0 +1,197 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	// Identifies the pool worker running on this thread (if any), so nested
+	// loops push onto their own deque instead of someone else's.
+	thread_local const ThreadPool* tPool = nullptr;
+	thread_local int tWorkerIndex = -1;
+}
+
+ThreadPool::ThreadPool(int workerCount)
+{
+	if (workerCount < 0)
+	{
+		int hw = static_cast<int>(std::thread::hardware_concurrency());
+		workerCount = std::max(hw - 1, 0);
+	}
+
+	for (int i = 0; i < workerCount; ++i)
+	{
+		mQueues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	for (int i = 0; i < workerCount; ++i)
+	{
+		mThreads.emplace_back(&ThreadPool::WorkerMain, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	for (auto& t : mThreads)
+	{
+		t.join();
+	}
+}
+
+ThreadPool& ThreadPool::Default()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+int ThreadPool::CurrentWorker() const
+{
+	return tPool == this ? tWorkerIndex : -1;
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& func)
+{
+	if (end <= begin)
+		return;
+
+	grain = std::max(grain, 1);
+
+	// Nothing to share: run on the caller.
+	if (mThreads.empty() || end - begin <= grain)
+	{
+		func(begin, end);
+		return;
+	}
+
+	const int count = end - begin;
+	const int chunkCount = (count + grain - 1) / grain;
+
+	std::atomic<int> pending(chunkCount);
+
+	// Keep the first chunk for ourselves and hand out the rest.  A worker
+	// keeps everything on its own deque and lets idle threads steal; an
+	// outside caller deals the chunks round-robin.
+	const int self = CurrentWorker();
+	for (int c = 1; c < chunkCount; ++c)
+	{
+		Task task;
+		task.Func = &func;
+		task.Begin = begin + c * grain;
+		task.End = std::min(task.Begin + grain, end);
+		task.Pending = &pending;
+
+		int queue = self >= 0 ? self :
+			static_cast<int>(mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size());
+		Push(queue, task);
+	}
+
+	{
+		// Wake sleeping workers once, after all chunks are visible.
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+	}
+	mWake.notify_all();
+
+	func(begin, std::min(begin + grain, end));
+	pending.fetch_sub(1, std::memory_order_acq_rel);
+
+	// Help out (with any pending task, not only ours) until our loop is done.
+	while (pending.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		if (PopOrSteal(self, task))
+		{
+			Run(task);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::Push(int queue, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mQueues[queue]->Mutex);
+		mQueues[queue]->Tasks.push_back(task);
+	}
+	mQueuedTasks.fetch_add(1, std::memory_order_release);
+}
+
+bool ThreadPool::PopOrSteal(int self, Task& task)
+{
+	if (mQueuedTasks.load(std::memory_order_acquire) == 0)
+		return false;
+
+	// Own deque first, newest task.
+	if (self >= 0)
+	{
+		WorkerQueue& q = *mQueues[self];
+		std::lock_guard<std::mutex> lock(q.Mutex);
+		if (!q.Tasks.empty())
+		{
+			task = q.Tasks.back();
+			q.Tasks.pop_back();
+			mQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// Steal from the front of a victim's deque, the end its owner does not
+	// pop from, so thief and owner rarely contend for the same task.
+	const int queueCount = static_cast<int>(mQueues.size());
+	const int start = self >= 0 ? self + 1 : 0;
+	for (int k = 0; k < queueCount; ++k)
+	{
+		const int victim = (start + k) % queueCount;
+		if (victim == self)
+			continue;
+
+		WorkerQueue& q = *mQueues[victim];
+		std::unique_lock<std::mutex> lock(q.Mutex, std::try_to_lock);
+		if (!lock.owns_lock() || q.Tasks.empty())
+			continue;
+
+		task = q.Tasks.front();
+		q.Tasks.pop_front();
+		mQueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+void ThreadPool::Run(const Task& task)
+{
+	(*task.Func)(task.Begin, task.End);
+	task.Pending->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void ThreadPool::WorkerMain(int index)
+{
+	tPool = this;
+	tWorkerIndex = index;
+
+	for (;;)
+	{
+		Task task;
+		if (PopOrSteal(index, task))
+		{
+			Run(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		mWake.wait(lock, [this]()
+			{
+				return mStop || mQueuedTasks.load(std::memory_order_acquire) > 0;
+			});
+
+		if (mStop)
+			return;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Portable replacement for concurrency::parallel_for.
+//
+// Every worker owns a deque of tasks.  A worker pops its own deque from the
+// back (most recently split work, still warm in its cache) and, when it runs
+// dry, steals from the front of the other deques.  The thread calling
+// ParallelFor also executes tasks until its loop is done, so nested loops
+// issued from inside a task cannot deadlock the pool.
+class ThreadPool
+{
+public:
+	// workerCount < 0 sizes the pool to the machine: one worker per hardware
+	// thread minus the calling thread.  0 runs every loop on the caller.
+	explicit ThreadPool(int workerCount = -1);
+	ThreadPool(const ThreadPool& rhs) = delete;
+	ThreadPool& operator=(const ThreadPool& rhs) = delete;
+	~ThreadPool();
+
+	int WorkerCount() const { return static_cast<int>(mThreads.size()); }
+
+	// Workers plus the calling thread.
+	int ThreadCount() const { return WorkerCount() + 1; }
+
+	// Calls func(first, last) on disjoint chunks covering [begin, end), each
+	// at most 'grain' items long, and returns once every chunk has run.
+	// func must not throw.
+	void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& func);
+
+	// Shared pool used when a caller does not provide its own.
+	static ThreadPool& Default();
+
+private:
+	struct Task
+	{
+		const std::function<void(int, int)>* Func = nullptr;
+		int Begin = 0;
+		int End = 0;
+		std::atomic<int>* Pending = nullptr;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	void WorkerMain(int index);
+	void Push(int queue, const Task& task);
+	bool PopOrSteal(int self, Task& task);
+	void Run(const Task& task);
+	int CurrentWorker() const;
+
+private:
+	std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+	std::vector<std::thread> mThreads;
+
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	std::atomic<int> mQueuedTasks = { 0 };
+	std::atomic<unsigned> mNextQueue = { 0 };
+	bool mStop = false;
+};
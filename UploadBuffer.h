@@ -57,6 +57,18 @@ public:
 		memcpy(&mMappedData[elementIndex * mElementByteSize], &data, sizeof(T));
 	}
 
+	// 원소 단위 CopyData를 거치지 않고 대응된 메모리에 직접 기록하려는 경우에 쓰인다.
+	// 업로드 힙은 쓰기 결합(write-combined) 메모리이므로 읽지 말고 순차적으로 쓰기만 해야 한다.
+	BYTE* MappedData() const
+	{
+		return mMappedData;
+	}
+
+	UINT ElementByteSize() const
+	{
+		return mElementByteSize;
+	}
+
 private:
 	Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
 	BYTE* mMappedData = nullptr;
@@ -1,7 +1,10 @@
 #include "Waves.h"
-#include <ppl.h>
+#include "ThreadPool.h"
+#include "WavesRecording.h"
 #include <vector>
 #include <cassert>
+#include <algorithm>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -13,35 +16,89 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
 	mVertexCount = m * n;
 	mTriangleCount = (m - 1) * (n - 1) * 2;
 
+	assert(dt > 0.0f);
 	mTimeStep = dt;
 	mSpatialStep = dx;
 
+	mSimdLevel = WavesSimd::DetectLevel();
+	assert(WavesSimd::SelfCheck(mSimdLevel));
+
+	mPool = &ThreadPool::Default();
+
+	// Aim for ~16K cells per task: enough work to amortize the hand-off while
+	// still leaving several chunks per worker on mid-size grids.
+	mRowGrain = std::max(1, (16 * 1024) / std::max(n, 1));
+
 	float d = damping * dt + 2.0f;
 	float e = (speed * speed) * (dt * dt) / (dx * dt);
 	mK1 = (damping * dt - 2.0f) / d;
 	mK2 = (4.0f - 8.0f * e) / d;
 	mK3 = (2.0f * e) / d;
 
-	mPrevSolution.resize(m * n);
-	mCurrSolution.resize(m * n);
-	mNormals.resize(m * n);
-	mTangentX.resize(m * n);
+	// e is the squared Courant number; remember the speed it amounts to so
+	// SetTimeStep can keep it.
+	mWaveSpeed = sqrtf(e) * dx / dt;
+	mDamping = damping;
 
-	float halfWidth = (n - 1) * dx * 0.5f;
-	float halfDepth = (m - 1) * dx * 0.5f;
-	for (int i = 0; i < m; i++)
-	{
-		float z = halfDepth - i * dx;
-		for (int j = 0; j < n; j++)
+	mHalfWidth = (n - 1) * dx * 0.5f;
+	mHalfDepth = (m - 1) * dx * 0.5f;
+
+	AllocateArrays();
+
+	UpdateConstants();
+}
+
+void Waves::AllocateArrays()
+{
+	const std::size_t count = static_cast<std::size_t>(mNumRows) * mNumCols;
+	const bool keep = mCurrSolution.size() == count;
+
+	// resize() leaves the new elements unwritten, so the pages are faulted in
+	// by whoever fills the rows below.
+	const WavesAllocator<float> allocator(mMemory.HugePages);
+	WavesVector<float> prev(allocator);
+	WavesVector<float> curr(allocator);
+	WavesVector<XMFLOAT3> normals(allocator);
+	WavesVector<XMFLOAT3> tangents(allocator);
+	prev.resize(count);
+	curr.resize(count);
+	normals.resize(count);
+	tangents.resize(count);
+
+	auto fill = [&](int first, int last)
 		{
-			float x = -halfWidth + j * dx;
+			const std::size_t begin = static_cast<std::size_t>(first) * mNumCols;
+			const std::size_t end = static_cast<std::size_t>(last) * mNumCols;
 
-			mPrevSolution[i * n + j] = XMFLOAT3(x, 0.0f, z);
-			mCurrSolution[i * n + j] = XMFLOAT3(x, 0.0f, z);
-			mNormals[i * n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			mTangentX[i * n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-		}
-	}
+			if (keep)
+			{
+				std::copy(mPrevSolution.begin() + begin, mPrevSolution.begin() + end, prev.begin() + begin);
+				std::copy(mCurrSolution.begin() + begin, mCurrSolution.begin() + end, curr.begin() + begin);
+				std::copy(mNormals.begin() + begin, mNormals.begin() + end, normals.begin() + begin);
+				std::copy(mTangentX.begin() + begin, mTangentX.begin() + end, tangents.begin() + begin);
+			}
+			else
+			{
+				std::fill(prev.begin() + begin, prev.begin() + end, 0.0f);
+				std::fill(curr.begin() + begin, curr.begin() + end, 0.0f);
+				std::fill(normals.begin() + begin, normals.begin() + end, XMFLOAT3(0.0f, 1.0f, 0.0f));
+				std::fill(tangents.begin() + begin, tangents.begin() + end, XMFLOAT3(1.0f, 0.0f, 0.0f));
+			}
+		};
+
+	// Same bands as Update, so each tends to land near the worker that steps it.
+	if (mMemory.FirstTouch)
+		mPool->ParallelFor(0, mNumRows, mRowGrain, fill);
+	else
+		fill(0, mNumRows);
+
+	mPrevSolution.swap(prev);
+	mCurrSolution.swap(curr);
+	mNormals.swap(normals);
+	mTangentX.swap(tangents);
+
+	// Reallocated on the next implicit step.
+	mImplicitScratch = WavesVector<float>(allocator);
 }
 
 Waves::~Waves()
@@ -78,75 +135,955 @@ float Waves::Depth() const
 	return mNumRows * mSpatialStep;
 }
 
-void Waves::Update(float dt)
+void Waves::WriteVertices(void* dst, const WavesVertexLayout& layout) const
 {
-	static float t = 0;
-	t += dt;
+	std::vector<WavesRowRange> all(1);
+	all[0].First = 0;
+	all[0].Last = mNumRows;
 
-	if (t >= mTimeStep)
+	WriteVertices(dst, layout, all);
+}
+
+void Waves::WriteVertices(void* dst, const WavesVertexLayout& layout, const std::vector<WavesRowRange>& rows) const
+{
+	unsigned char* base = static_cast<unsigned char*>(dst);
+	const float du = mNumCols > 1 ? 1.0f / (mNumCols - 1) : 0.0f;
+	const float dv = mNumRows > 1 ? 1.0f / (mNumRows - 1) : 0.0f;
+
+	for (const WavesRowRange& range : rows)
 	{
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+		mPool->ParallelFor(range.First, range.Last, mRowGrain, [&](int first, int last)
 			{
-				for (int j = 1; j < mNumCols - 1; ++j)
+				for (int i = first; i < last; ++i)
 				{
-					// After this update we will be discarding the old previous
-					// buffer, so overwrite that buffer with the new update.
-					// Note how we can do this inplace (read/write to same element) 
-					// because we won't need prev_ij again and the assignment happens last.
-
-					// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-					// Moreover, our +z axis goes "down"; this is just to 
-					// keep consistent with our row indices going down.
-
-					mPrevSolution[i * mNumCols + j].y =
-						mK1 * mPrevSolution[i * mNumCols + j].y +
-						mK2 * mCurrSolution[i * mNumCols + j].y +
-						mK3 * (mCurrSolution[(i + 1) * mNumCols + j].y +
-							mCurrSolution[(i - 1) * mNumCols + j].y +
-							mCurrSolution[i * mNumCols + j + 1].y +
-							mCurrSolution[i * mNumCols + j - 1].y);
+					WavesSimd::StreamVertexRow(
+						base + static_cast<std::size_t>(i) * mNumCols * layout.Stride, layout,
+						&mCurrSolution[i * mNumCols], &mNormals[i * mNumCols].x, mNumCols,
+						-mHalfWidth, mSpatialStep, mHalfDepth - i * mSpatialStep,
+						du, i * dv);
 				}
 			});
+	}
+}
+
+void Waves::WriteCompactVertices(WavesCompactVertex* dst) const
+{
+	std::vector<WavesRowRange> all(1);
+	all[0].First = 0;
+	all[0].Last = mNumRows;
+
+	WriteCompactVertices(dst, all);
+}
+
+void Waves::WriteCompactVertices(WavesCompactVertex* dst, const std::vector<WavesRowRange>& rows) const
+{
+	for (const WavesRowRange& range : rows)
+	{
+		mPool->ParallelFor(range.First, range.Last, mRowGrain, [&](int first, int last)
+			{
+				WavesSimd::StreamCompactRow(mSimdLevel, dst + first * mNumCols,
+					&mCurrSolution[first * mNumCols], &mNormals[first * mNumCols].x, (last - first) * mNumCols);
+			});
+	}
+}
 
-		std::swap(mPrevSolution, mCurrSolution);
+void Waves::WriteGridPositions(XMFLOAT2* dst) const
+{
+	for (int i = 0; i < mNumRows; ++i)
+	{
+		for (int j = 0; j < mNumCols; ++j)
+		{
+			dst[i * mNumCols + j] = XMFLOAT2(-mHalfWidth + j * mSpatialStep, mHalfDepth - i * mSpatialStep);
+		}
+	}
+}
+
+void Waves::EnableDirtyTracking(bool enable, float tolerance)
+{
+	mDirtyTracking = enable;
+	mDirtyTolerance = tolerance;
+
+	if (!enable)
+	{
+		mReportedHeights.clear();
+		mRowMoved.clear();
+		mRowStamps.clear();
+		return;
+	}
+
+	// Stamp 1 for every row, so consumers at stamp 0 upload everything.
+	mDirtyStamp = 1;
+	mReportedHeights.assign(mCurrSolution.begin(), mCurrSolution.end());
+	mRowMoved.assign(mNumRows, 0);
+	mRowStamps.assign(mNumRows, mDirtyStamp);
+	mHeightsTouched = false;
+}
+
+void Waves::DirtyRows(unsigned long long since, std::vector<WavesRowRange>& rows) const
+{
+	rows.clear();
+
+	if (!mDirtyTracking)
+	{
+		// Nothing is tracked: everything may have changed.
+		WavesRowRange all;
+		all.Last = mNumRows;
+		rows.push_back(all);
+		return;
+	}
+
+	for (int i = 0; i < mNumRows; ++i)
+	{
+		if (mRowStamps[i] <= since)
+			continue;
+
+		if (!rows.empty() && rows.back().Last == i)
+		{
+			rows.back().Last = i + 1;
+		}
+		else
+		{
+			WavesRowRange range;
+			range.First = i;
+			range.Last = i + 1;
+			rows.push_back(range);
+		}
+	}
+}
+
+void Waves::TrackDirtyRows()
+{
+	mPool->ParallelFor(0, mNumRows, mRowGrain, [this](int first, int last)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				float* reported = &mReportedHeights[i * mNumCols];
+				const float* curr = &mCurrSolution[i * mNumCols];
+
+				float delta = 0.0f;
+				for (int j = 0; j < mNumCols; ++j)
+				{
+					float d = fabsf(curr[j] - reported[j]);
+					delta = delta > d ? delta : d;
+				}
+
+				// A tolerance of 0 still skips rows that did not change at all.
+				const bool moved = mDirtyTolerance > 0.0f ? delta > mDirtyTolerance : delta != 0.0f;
+				if (moved)
+					std::copy(curr, curr + mNumCols, reported);
+
+				mRowMoved[i] = moved ? 1 : 0;
+			}
+		});
+
+	++mDirtyStamp;
+	for (int i = 0; i < mNumRows; ++i)
+	{
+		if (!mRowMoved[i])
+			continue;
+
+		// The normals of the rows above and below read this row's heights.
+		for (int r = std::max(i - 1, 0); r <= std::min(i + 1, mNumRows - 1); ++r)
+			mRowStamps[r] = mDirtyStamp;
+	}
+
+	mHeightsTouched = false;
+}
+
+void Waves::SetSimdLevel(WavesSimdLevel level)
+{
+	mSimdLevel = std::min(level, WavesSimd::DetectLevel());
+	assert(WavesSimd::SelfCheck(mSimdLevel));
+}
+
+void Waves::SetThreadPool(ThreadPool* pool)
+{
+	mPool = pool != nullptr ? pool : &ThreadPool::Default();
+}
+
+void Waves::SetMemoryOptions(const WavesMemoryOptions& options)
+{
+	mMemory = options;
+	AllocateArrays();
+}
+
+std::size_t Waves::EstimatedStepBytes(WavesUpdateMode mode) const
+{
+	const std::size_t cells = static_cast<std::size_t>(mVertexCount);
+	const std::size_t h = sizeof(float);
+	const std::size_t v = sizeof(XMFLOAT3);
+
+	// Integration: read prev + curr, write prev (the line is already owned).
+	std::size_t bytes = cells * (h + h + h);
+
+	// Normals and tangents: write-allocate reads each line before writing it.
+	bytes += cells * 2 * (v + v);
 
-		t = 0.0f;
+	// Two-pass streams the new heights back in from memory; fused reads them
+	// while they are still cached.
+	if (mode == WavesUpdateMode::TwoPass)
+		bytes += cells * h;
 
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+	return bytes;
+}
+
+void Waves::SetTimeStep(float dt)
+{
+	assert(dt > 0.0f);
+	mTimeStep = dt;
+	mAccumulator = std::min(mAccumulator, dt);
+
+	float d = mDamping * dt + 2.0f;
+	float e = CourantNumber() * CourantNumber();
+	mK1 = (mDamping * dt - 2.0f) / d;
+	mK2 = (4.0f - 8.0f * e) / d;
+	mK3 = (2.0f * e) / d;
+
+	UpdateConstants();
+}
+
+float Waves::CourantNumber() const
+{
+	return mWaveSpeed * mTimeStep / mSpatialStep;
+}
+
+void Waves::UpdateConstants()
+{
+	// Implicit scheme, with r the squared Courant number and L the 5-point
+	// Laplacian:
+	//
+	//   (1 + mu dt/2) u+ - 2u + (1 - mu dt/2) u- = r L(u+/4 + u/2 + u-/4)
+	//
+	// The u+ operator, (1 + mu dt/2) - r/4 (Lx + Ly), is approximated by
+	// (1 + mu dt/2)^-1 (a - r/4 Lx)(a - r/4 Ly) with a = 1 + mu dt/2.  The
+	// extra term is positive semidefinite, so the factored scheme stays
+	// unconditionally stable.
+	mAdiR = CourantNumber() * CourantNumber();
+	mAdiNew = 1.0f + 0.5f * mDamping * mTimeStep;
+	mAdiOld = 1.0f - 0.5f * mDamping * mTimeStep;
+
+	const float diag = mAdiNew + 0.5f * mAdiR;
+	const float off = -0.25f * mAdiR;
+
+	auto factor = [diag, off](int count, std::vector<float>& ratio, std::vector<float>& pivot)
+		{
+			ratio.resize(std::max(count, 0));
+			pivot.resize(std::max(count, 0));
+			float prev = 0.0f;
+			for (int k = 0; k < count; ++k)
+			{
+				pivot[k] = 1.0f / (diag - off * prev);
+				ratio[k] = off * pivot[k];
+				prev = ratio[k];
+			}
+		};
+
+	factor(mNumCols - 2, mAdiRowRatio, mAdiRowPivot);
+	factor(mNumRows - 2, mAdiColRatio, mAdiColPivot);
+}
+
+void Waves::SetMaxSubsteps(int count)
+{
+	mMaxSubsteps = std::max(count, 1);
+}
+
+int Waves::Update(float dt)
+{
+	mAccumulator += dt;
+
+	int steps = 0;
+	while (mAccumulator >= mTimeStep && steps < mMaxSubsteps)
+	{
+		Step();
+		mAccumulator -= mTimeStep;
+		++steps;
+	}
+
+	// Out of catch-up budget: drop whole steps we could not afford.
+	if (mAccumulator >= mTimeStep)
+	{
+		mAccumulator = fmodf(mAccumulator, mTimeStep);
+	}
+
+	mAlpha = mAccumulator / mTimeStep;
+
+	if (mDirtyTracking && (steps > 0 || mHeightsTouched))
+		TrackDirtyRows();
+
+	return steps;
+}
+
+void Waves::Step()
+{
+	if (!mImpulses.empty())
+		ApplyDisturbances();
+
+	if (mIntegrator == WavesIntegrator::ImplicitAdi)
+	{
+		StepImplicit();
+	}
+	else if (ActiveTilesEnabled())
+	{
+		StepActiveTiles();
+	}
+	else if (mUpdateMode == WavesUpdateMode::Fused)
+	{
+		// Bands of at least two rows keep the seam rows of neighboring
+		// bands distinct.
+		const int bandRows = std::max(mRowGrain, 2);
+		const int bandCount = (mNumRows - 2 + bandRows - 1) / bandRows;
+
+		mPool->ParallelFor(0, bandCount, 1, [this, bandRows](int first, int last)
 			{
-				for (int j = 1; j < mNumCols - 1; ++j)
+				for (int b = first; b < last; ++b)
 				{
-					float l = mCurrSolution[i * mNumCols + j - 1].y;
-					float r = mCurrSolution[i * mNumCols + j + 1].y;
-					float t = mCurrSolution[(i - 1) * mNumCols + j].y;
-					float b = mCurrSolution[(i + 1) * mNumCols + j].y;
-					mNormals[i * mNumCols + j].x = -r + l;
-					mNormals[i * mNumCols + j].y = 2.0f * mSpatialStep;
-					mNormals[i * mNumCols + j].z = b - t;
-
-					XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i * mNumCols + j]));
-					XMStoreFloat3(&mNormals[i * mNumCols + j], n);
-
-					mTangentX[i * mNumCols + j] = XMFLOAT3(2.0f * mSpatialStep, r - l, 0.0f);
-					XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i * mNumCols + j]));
-					XMStoreFloat3(&mTangentX[i * mNumCols + j], T);
+					int r0 = 1 + b * bandRows;
+					UpdateBand(r0, std::min(r0 + bandRows, mNumRows - 1));
 				}
 			});
+
+		// Seams: the last row of band b-1 and the first row of band b
+		// each needed a row the other band wrote.
+		mPool->ParallelFor(1, bandCount, 16, [this, bandRows](int first, int last)
+			{
+				for (int b = first; b < last; ++b)
+				{
+					int r0 = 1 + b * bandRows;
+					UpdateNormalRows(mPrevSolution.data(), r0 - 1, r0 + 1);
+				}
+			});
+
+		std::swap(mPrevSolution, mCurrSolution);
 	}
+	else
+	{
+		mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this](int first, int last)
+			{
+				UpdateHeightRows(first, last);
+			});
+
+		std::swap(mPrevSolution, mCurrSolution);
+
+		mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this](int first, int last)
+			{
+				UpdateNormalRows(mCurrSolution.data(), first, last);
+			});
+	}
+
+	++mStepCount;
 }
 
-void Waves::Disturb(int i, int j, float magnitude)
+void Waves::UpdateNormals(int first, int last)
+{
+	mPool->ParallelFor(first, last, mRowGrain, [this](int r0, int r1)
+		{
+			UpdateNormalRows(mCurrSolution.data(), r0, r1);
+		});
+}
+
+void Waves::UpdateNormals(int i, int j0, int j1)
+{
+	UpdateNormalSpan(mCurrSolution.data(), i, j0, j1);
+}
+
+void Waves::UpdateBand(int first, int last)
 {
-	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows - 2);
-	assert(j > 1 && j < mNumCols - 2);
+	// The new heights land in mPrevSolution.  Boundary rows 0 and m-1 are
+	// never integrated and hold the same values in both buffers, so they
+	// count as "new" for the rows next to them.
+	const float* heights = mPrevSolution.data();
+
+	const int normalFirst = first == 1 ? first : first + 1;
+	const int normalLast = last == mNumRows - 1 ? last : last - 1;
+
+	for (int i = first; i < last; ++i)
+	{
+		UpdateHeightRows(i, i + 1);
+
+		// Row i-1 now has both neighbors.
+		if (i - 1 >= normalFirst && i - 1 < normalLast)
+			UpdateNormalRows(heights, i - 1, i);
+	}
+
+	// The band's last row can be finished here only against the boundary.
+	if (last - 1 >= normalFirst && last - 1 < normalLast)
+		UpdateNormalRows(heights, last - 1, last);
+}
+
+void Waves::UpdateHeightRows(int first, int last)
+{
+	for (int i = first; i < last; ++i)
+	{
+		UpdateHeightSpan(i, 1, mNumCols - 1);
+	}
+}
+
+void Waves::UpdateHeightSpan(int i, int j0, int j1)
+{
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// Note how we can do this inplace (read/write to same element) 
+	// because we won't need prev_ij again and the assignment happens last.
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to 
+	// keep consistent with our row indices going down.
+
+	// Columns [j0, j1) of the row are contiguous.
+	const int row = i * mNumCols + j0;
+	WavesSimd::UpdateRow(mSimdLevel,
+		&mPrevSolution[row],
+		&mCurrSolution[row],
+		&mCurrSolution[row - mNumCols],
+		&mCurrSolution[row + mNumCols],
+		j1 - j0, 1, mK1, mK2, mK3);
+}
+
+void Waves::UpdateNormalRows(const float* heights, int first, int last)
+{
+	for (int i = first; i < last; ++i)
+	{
+		UpdateNormalSpan(heights, i, 1, mNumCols - 1);
+	}
+}
 
+void Waves::UpdateNormalSpan(const float* heights, int i, int j0, int j1)
+{
+	for (int j = j0; j < j1; ++j)
+	{
+		float l = heights[i * mNumCols + j - 1];
+		float r = heights[i * mNumCols + j + 1];
+		float t = heights[(i - 1) * mNumCols + j];
+		float b = heights[(i + 1) * mNumCols + j];
+		mNormals[i * mNumCols + j].x = -r + l;
+		mNormals[i * mNumCols + j].y = 2.0f * mSpatialStep;
+		mNormals[i * mNumCols + j].z = b - t;
+
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i * mNumCols + j]));
+		XMStoreFloat3(&mNormals[i * mNumCols + j], n);
+
+		mTangentX[i * mNumCols + j] = XMFLOAT3(2.0f * mSpatialStep, r - l, 0.0f);
+		XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i * mNumCols + j]));
+		XMStoreFloat3(&mTangentX[i * mNumCols + j], T);
+	}
+}
+
+void Waves::EnableActiveTiles(bool enable, int tileSize, float sleepThreshold)
+{
+	mActiveRuns.clear();
+	mActiveTileCount = 0;
+	mTileLively.clear();
+	mTileActive.clear();
+
+	if (!enable)
+	{
+		mTileSize = mTileRows = mTileCols = 0;
+		return;
+	}
+
+	mTileSize = std::max(tileSize, 4);
+	mTileRows = (mNumRows + mTileSize - 1) / mTileSize;
+	mTileCols = (mNumCols + mTileSize - 1) / mTileSize;
+	mSleepThreshold = sleepThreshold;
+
+	// Start with every tile awake; the first step measures them and lets
+	// the calm ones fall asleep.
+	mTileLively.assign(mTileRows * mTileCols, 1);
+	mTileActive.assign(mTileRows * mTileCols, 0);
+	mTilesDirty = true;
+}
+
+void Waves::TileBounds(int t, int& r0, int& r1, int& c0, int& c1) const
+{
+	const int ti = t / mTileCols;
+	const int tj = t % mTileCols;
+
+	// Clip to the interior; the boundary rows/columns are never integrated.
+	r0 = std::max(ti * mTileSize, 1);
+	r1 = std::min((ti + 1) * mTileSize, mNumRows - 1);
+	c0 = std::max(tj * mTileSize, 1);
+	c1 = std::min((tj + 1) * mTileSize, mNumCols - 1);
+}
+
+void Waves::RunBounds(int k, int& r0, int& r1, int& c0, int& c1) const
+{
+	const TileRun& run = mActiveRuns[k];
+
+	int unused0, unused1;
+	TileBounds(run.Row * mTileCols + run.First, r0, r1, c0, unused0);
+	TileBounds(run.Row * mTileCols + run.Last - 1, unused0, unused1, unused0, c1);
+}
+
+void Waves::MeasureTile(int t)
+{
+	int r0, r1, c0, c1;
+	TileBounds(t, r0, r1, c0, c1);
+
+	// Any cell at or above the threshold keeps the tile lively, so stop at
+	// the first row that has one.
+	bool lively = false;
+	for (int i = r0; i < r1 && !lively; ++i)
+	{
+		const float* curr = &mCurrSolution[i * mNumCols];
+		const float* prev = &mPrevSolution[i * mNumCols];
+
+		float energy = 0.0f;
+		for (int j = c0; j < c1; ++j)
+		{
+			float a = fabsf(curr[j]);
+			float b = fabsf(prev[j]);
+			energy = energy > a ? energy : a;
+			energy = energy > b ? energy : b;
+		}
+
+		lively = energy >= mSleepThreshold;
+	}
+
+	mTileLively[t] = lively ? 1 : 0;
+}
+
+void Waves::RebuildActiveTiles()
+{
+	mActiveRuns.clear();
+	mActiveTileCount = 0;
+
+	for (int ti = 0; ti < mTileRows; ++ti)
+	{
+		for (int tj = 0; tj < mTileCols; ++tj)
+		{
+			// A wave crosses at most one cell per step, so a tile only has to
+			// run while it or one of its 8 neighbors is lively.
+			bool active = false;
+			for (int di = -1; di <= 1 && !active; ++di)
+			{
+				for (int dj = -1; dj <= 1 && !active; ++dj)
+				{
+					int ni = ti + di;
+					int nj = tj + dj;
+					if (ni >= 0 && ni < mTileRows && nj >= 0 && nj < mTileCols)
+						active = mTileLively[ni * mTileCols + nj] != 0;
+				}
+			}
+
+			const int t = ti * mTileCols + tj;
+			if (active)
+			{
+				if (!mActiveRuns.empty() && mActiveRuns.back().Row == ti && mActiveRuns.back().Last == tj)
+				{
+					mActiveRuns.back().Last = tj + 1;
+				}
+				else
+				{
+					TileRun run;
+					run.Row = ti;
+					run.First = tj;
+					run.Last = tj + 1;
+					mActiveRuns.push_back(run);
+				}
+				++mActiveTileCount;
+			}
+			else if (mTileActive[t])
+			{
+				// Falling asleep: flatten both time levels so the skipped
+				// cells are an exact rest state for their neighbors.
+				int r0, r1, c0, c1;
+				TileBounds(t, r0, r1, c0, c1);
+				for (int i = r0; i < r1; ++i)
+				{
+					for (int j = c0; j < c1; ++j)
+					{
+						mPrevSolution[i * mNumCols + j] = 0.0f;
+						mCurrSolution[i * mNumCols + j] = 0.0f;
+						mNormals[i * mNumCols + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
+						mTangentX[i * mNumCols + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+					}
+				}
+			}
+
+			mTileActive[t] = active ? 1 : 0;
+		}
+	}
+
+	mTilesDirty = false;
+}
+
+void Waves::WakeTiles(int r0, int r1, int c0, int c1)
+{
+	if (!ActiveTilesEnabled())
+		return;
+
+	for (int ti = r0 / mTileSize; ti <= (r1 - 1) / mTileSize; ++ti)
+	{
+		for (int tj = c0 / mTileSize; tj <= (c1 - 1) / mTileSize; ++tj)
+		{
+			const int t = ti * mTileCols + tj;
+			if (!mTileLively[t])
+			{
+				mTileLively[t] = 1;
+				mTilesDirty = true;
+			}
+		}
+	}
+}
+
+void Waves::WakeTilesAround(int i, int j)
+{
+	if (!ActiveTilesEnabled())
+		return;
+
+	const int t = (i / mTileSize) * mTileCols + (j / mTileSize);
+	if (!mTileLively[t])
+	{
+		mTileLively[t] = 1;
+		mTilesDirty = true;
+	}
+}
+
+void Waves::StepImplicit()
+{
+	const int m = mNumRows;
+	const int n = mNumCols;
+	const float r = mAdiR;
+	const float off = -0.25f * r;
+
+	// Boundary entries stay zero: they are the Dirichlet values of every
+	// line solve.
+	if (mImplicitScratch.size() != mCurrSolution.size())
+		mImplicitScratch.assign(mCurrSolution.size(), 0.0f);
+
+	float* w = mImplicitScratch.data();
+	const float* curr = mCurrSolution.data();
+	const float* prev = mPrevSolution.data();
+
+	// Right-hand side and the row solves, one row at a time while it is
+	// in cache.
+	mPool->ParallelFor(1, m - 1, mRowGrain, [=](int first, int last)
+		{
+			const float* ratio = mAdiRowRatio.data();
+			const float* pivot = mAdiRowPivot.data();
+
+			for (int i = first; i < last; ++i)
+			{
+				const float* u = curr + i * n;
+				const float* p = prev + i * n;
+				float* x = w + i * n;
+
+				for (int j = 1; j < n - 1; ++j)
+				{
+					float lu = u[j - 1] + u[j + 1] + u[j - n] + u[j + n] - 4.0f * u[j];
+					float lp = p[j - 1] + p[j + 1] + p[j - n] + p[j + n] - 4.0f * p[j];
+					x[j] = 2.0f * u[j] - mAdiOld * p[j] + r * (0.5f * lu + 0.25f * lp);
+				}
+
+				// Thomas algorithm on x[1..n-2].
+				float below = 0.0f;
+				for (int k = 0; k < n - 2; ++k)
+				{
+					x[k + 1] = (x[k + 1] - off * below) * pivot[k];
+					below = x[k + 1];
+				}
+				for (int k = n - 4; k >= 0; --k)
+				{
+					x[k + 1] -= ratio[k] * x[k + 2];
+				}
+			}
+		});
+
+	// Column solves, on strips of adjacent columns so every sweep walks whole
+	// row segments.  The boundary row above the first interior row is zero.
+	const int columnGrain = 256;
+	mPool->ParallelFor(1, n - 1, columnGrain, [=](int c0, int c1)
+		{
+			const float* ratio = mAdiColRatio.data();
+			const float* pivot = mAdiColPivot.data();
+
+			for (int k = 0; k < m - 2; ++k)
+			{
+				float* x = w + (k + 1) * n;
+				const float* above = x - n;
+				for (int c = c0; c < c1; ++c)
+					x[c] = (mAdiNew * x[c] - off * above[c]) * pivot[k];
+			}
+			for (int k = m - 4; k >= 0; --k)
+			{
+				float* x = w + (k + 1) * n;
+				const float* below = x + n;
+				for (int c = c0; c < c1; ++c)
+					x[c] -= ratio[k] * below[c];
+			}
+		});
+
+	// The oldest level becomes the scratch; the solution becomes current.
+	std::swap(mPrevSolution, mImplicitScratch);
+	std::swap(mPrevSolution, mCurrSolution);
+
+	mPool->ParallelFor(1, m - 1, mRowGrain, [this](int first, int last)
+		{
+			UpdateNormalRows(mCurrSolution.data(), first, last);
+		});
+}
+
+void Waves::StepActiveTiles()
+{
+	if (mTilesDirty)
+		RebuildActiveTiles();
+
+	const int count = static_cast<int>(mActiveRuns.size());
+
+	mPool->ParallelFor(0, count, 1, [this](int first, int last)
+		{
+			for (int k = first; k < last; ++k)
+			{
+				int r0, r1, c0, c1;
+				RunBounds(k, r0, r1, c0, c1);
+				for (int i = r0; i < r1; ++i)
+					UpdateHeightSpan(i, c0, c1);
+			}
+		});
+
+	std::swap(mPrevSolution, mCurrSolution);
+
+	mPool->ParallelFor(0, count, 1, [this](int first, int last)
+		{
+			for (int k = first; k < last; ++k)
+			{
+				int r0, r1, c0, c1;
+				RunBounds(k, r0, r1, c0, c1);
+				for (int i = r0; i < r1; ++i)
+					UpdateNormalSpan(mCurrSolution.data(), i, c0, c1);
+
+				const TileRun& run = mActiveRuns[k];
+				for (int tj = run.First; tj < run.Last; ++tj)
+					MeasureTile(run.Row * mTileCols + tj);
+			}
+		});
+
+	RebuildActiveTiles();
+}
+
+void Waves::Disturb(int i, int j, float magnitude)
+{
 	float halfMag = 0.5f * magnitude;
 
-	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i * mNumCols + j].y += magnitude;
-	mCurrSolution[i * mNumCols + j + 1].y += halfMag;
-	mCurrSolution[i * mNumCols + j - 1].y += halfMag;
-	mCurrSolution[(i + 1) * mNumCols + j].y += halfMag;
-	mCurrSolution[(i - 1) * mNumCols + j].y += halfMag;
+	// Disturb the ijth vertex height and its neighbors, but don't disturb
+	// boundaries.
+	const int di[5] = { 0, 0, 0, 1, -1 };
+	const int dj[5] = { 0, 1, -1, 0, 0 };
+	for (int k = 0; k < 5; ++k)
+	{
+		int r = i + di[k];
+		int c = j + dj[k];
+		if (r < 1 || r > mNumRows - 2 || c < 1 || c > mNumCols - 2)
+			continue;
+
+		mCurrSolution[r * mNumCols + c] += k == 0 ? magnitude : halfMag;
+		WakeTilesAround(r, c);
+	}
+
+	mHeightsTouched = true;
+
+	if (mRecorder != nullptr)
+		mRecorder->OnDisturb(mStepCount, i, j, magnitude);
+}
+
+void Waves::Reset()
+{
+	std::fill(mPrevSolution.begin(), mPrevSolution.end(), 0.0f);
+	std::fill(mCurrSolution.begin(), mCurrSolution.end(), 0.0f);
+	std::fill(mNormals.begin(), mNormals.end(), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	std::fill(mTangentX.begin(), mTangentX.end(), XMFLOAT3(1.0f, 0.0f, 0.0f));
+
+	mImpulses.clear();
+	mAccumulator = 0.0f;
+	mAlpha = 0.0f;
+	mHeightsTouched = true;
+
+	// Let the next step measure every tile again.
+	if (ActiveTilesEnabled())
+		EnableActiveTiles(true, mTileSize, mSleepThreshold);
+}
+
+void Waves::QueueDisturbance(const WavesImpulse& impulse)
+{
+	assert(impulse.Shape == WavesImpulseShape::Point || impulse.Radius > 0.0f);
+	mImpulses.push_back(impulse);
+}
+
+void Waves::QueueDisturbances(const WavesImpulse* impulses, int count)
+{
+	for (int k = 0; k < count; ++k)
+		QueueDisturbance(impulses[k]);
+}
+
+void Waves::ApplyDisturbances()
+{
+	const int count = static_cast<int>(mImpulses.size());
+	const float invDx = 1.0f / mSpatialStep;
+
+	// Grid coordinates of a world position, clamped so far-off impulses
+	// cannot overflow the conversion.
+	auto toCol = [this, invDx](float x)
+		{
+			return std::min(std::max((x + mHalfWidth) * invDx, -2.0f), static_cast<float>(mNumCols + 1));
+		};
+	auto toRow = [this, invDx](float z)
+		{
+			return std::min(std::max((mHalfDepth - z) * invDx, -2.0f), static_cast<float>(mNumRows + 1));
+		};
+
+	// Clipped rectangle of every impulse.
+	mImpulseSpans.resize(count);
+	mImpulseOrder.clear();
+	int weightCount = 0;
+	int maxRows = 0;
+
+	for (int k = 0; k < count; ++k)
+	{
+		const WavesImpulse& impulse = mImpulses[k];
+		ImpulseSpan& span = mImpulseSpans[k];
+		span.Weights = -1;
+
+		if (impulse.Shape == WavesImpulseShape::Point)
+		{
+			span.CenterRow = static_cast<int>(floorf(toRow(impulse.From.y) + 0.5f));
+			span.CenterCol = static_cast<int>(floorf(toCol(impulse.From.x) + 0.5f));
+			span.Row0 = span.CenterRow - 1;
+			span.Row1 = span.CenterRow + 2;
+			span.Col0 = span.CenterCol - 1;
+			span.Col1 = span.CenterCol + 2;
+		}
+		else
+		{
+			const XMFLOAT2 to = impulse.Shape == WavesImpulseShape::Segment ? impulse.To : impulse.From;
+			const float reach = 3.0f * impulse.Radius;
+
+			span.Col0 = static_cast<int>(ceilf(toCol(std::min(impulse.From.x, to.x) - reach)));
+			span.Col1 = static_cast<int>(floorf(toCol(std::max(impulse.From.x, to.x) + reach))) + 1;
+			span.Row0 = static_cast<int>(ceilf(toRow(std::max(impulse.From.y, to.y) + reach)));
+			span.Row1 = static_cast<int>(floorf(toRow(std::min(impulse.From.y, to.y) - reach))) + 1;
+		}
+
+		span.Row0 = std::max(span.Row0, 1);
+		span.Row1 = std::min(span.Row1, mNumRows - 1);
+		span.Col0 = std::max(span.Col0, 1);
+		span.Col1 = std::min(span.Col1, mNumCols - 1);
+		if (span.Row0 >= span.Row1 || span.Col0 >= span.Col1)
+			continue;
+
+		if (impulse.Shape == WavesImpulseShape::Gaussian)
+		{
+			span.Weights = weightCount;
+			weightCount += span.Col1 - span.Col0;
+		}
+
+		maxRows = std::max(maxRows, span.Row1 - span.Row0);
+		mImpulseOrder.push_back(k);
+		WakeTiles(span.Row0, span.Row1, span.Col0, span.Col1);
+	}
+
+	// A Gaussian is separable, so each one gets a row of column weights and
+	// the splat becomes a scaled add per row.
+	mImpulseWeights.resize(weightCount);
+	mPool->ParallelFor(0, count, 64, [this](int first, int last)
+		{
+			for (int k = first; k < last; ++k)
+			{
+				const ImpulseSpan& span = mImpulseSpans[k];
+				if (span.Weights < 0)
+					continue;
+
+				const WavesImpulse& impulse = mImpulses[k];
+				const float invRadius = 1.0f / impulse.Radius;
+				float* w = &mImpulseWeights[span.Weights];
+				for (int j = span.Col0; j < span.Col1; ++j)
+				{
+					float u = (-mHalfWidth + j * mSpatialStep - impulse.From.x) * invRadius;
+					w[j - span.Col0] = expf(-u * u);
+				}
+			}
+		});
+
+	// Sorted by first row, so a band only looks at impulses that can reach
+	// it.  Each vertex receives its impulses in the same order however the
+	// rows are split, which keeps the result deterministic.
+	std::stable_sort(mImpulseOrder.begin(), mImpulseOrder.end(), [this](int a, int b)
+		{
+			return mImpulseSpans[a].Row0 < mImpulseSpans[b].Row0;
+		});
+
+	mPool->ParallelFor(1, mNumRows - 1, mRowGrain, [this, maxRows](int first, int last)
+		{
+			auto it = std::lower_bound(mImpulseOrder.begin(), mImpulseOrder.end(), first - maxRows,
+				[this](int k, int row) { return mImpulseSpans[k].Row0 < row; });
+
+			for (; it != mImpulseOrder.end() && mImpulseSpans[*it].Row0 < last; ++it)
+			{
+				const ImpulseSpan& span = mImpulseSpans[*it];
+				const int r0 = std::max(span.Row0, first);
+				const int r1 = std::min(span.Row1, last);
+				for (int i = r0; i < r1; ++i)
+					SplatImpulseRow(*it, i);
+			}
+		});
+
+	mImpulses.clear();
+	mHeightsTouched = true;
+}
+
+void Waves::SplatImpulseRow(int k, int i)
+{
+	const WavesImpulse& impulse = mImpulses[k];
+	const ImpulseSpan& span = mImpulseSpans[k];
+	float* h = &mCurrSolution[i * mNumCols];
+
+	switch (impulse.Shape)
+	{
+	case WavesImpulseShape::Point:
+	{
+		const float halfMag = 0.5f * impulse.Magnitude;
+		if (i != span.CenterRow)
+		{
+			if (span.CenterCol >= span.Col0 && span.CenterCol < span.Col1)
+				h[span.CenterCol] += halfMag;
+			break;
+		}
+
+		for (int j = span.Col0; j < span.Col1; ++j)
+			h[j] += j == span.CenterCol ? impulse.Magnitude : halfMag;
+		break;
+	}
+
+	case WavesImpulseShape::Gaussian:
+	{
+		const float v = (mHalfDepth - i * mSpatialStep - impulse.From.y) / impulse.Radius;
+		const float scale = impulse.Magnitude * expf(-v * v);
+		const float* w = &mImpulseWeights[span.Weights] - span.Col0;
+		for (int j = span.Col0; j < span.Col1; ++j)
+			h[j] += scale * w[j];
+		break;
+	}
+
+	case WavesImpulseShape::Segment:
+	{
+		// Distance to the closest point of the segment, per vertex.
+		const float bx = impulse.To.x - impulse.From.x;
+		const float bz = impulse.To.y - impulse.From.y;
+		const float len2 = bx * bx + bz * bz;
+		const float invLen2 = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+		const float invRadius2 = 1.0f / (impulse.Radius * impulse.Radius);
+		const float pz = mHalfDepth - i * mSpatialStep - impulse.From.y;
+		const float x0 = -mHalfWidth - impulse.From.x;
+
+		for (int j = span.Col0; j < span.Col1; ++j)
+		{
+			float px = x0 + j * mSpatialStep;
+			float t = (px * bx + pz * bz) * invLen2;
+			t = std::min(std::max(t, 0.0f), 1.0f);
+			float ex = px - t * bx;
+			float ez = pz - t * bz;
+			h[j] += impulse.Magnitude * expf(-(ex * ex + ez * ez) * invRadius2);
+		}
+		break;
+	}
+	}
 }
@@ -1,6 +1,70 @@
 #pragma once
 #include <vector>
+#include <cstddef>
 #include <DirectXMath.h>
+#include "WavesMemory.h"
+#include "WavesSimd.h"
+#include "WavesSampler.h"
+
+class ThreadPool;
+class WavesRecorder;
+
+// Rows [First, Last) of the grid.
+struct WavesRowRange
+{
+	int First = 0;
+	int Last = 0;
+};
+
+// Time integration of the height field.
+enum class WavesIntegrator : int
+{
+	// The original explicit scheme.  Cheapest per step, but it diverges once
+	// the Courant number (cells a wave travels per step) gets too large.
+	Explicit = 0,
+
+	// Implicit theta = 1/4 scheme, factored ADI-style into tridiagonal line
+	// solves along every row and then every column.  Unconditionally stable,
+	// so the step can be several times larger; big steps cost some
+	// dispersion (short waves travel slower) instead of blowing up.
+	ImplicitAdi
+};
+
+// Shape of a queued disturbance.
+enum class WavesImpulseShape : int
+{
+	// Five-point splat at the nearest grid vertex, like Disturb.
+	Point = 0,
+
+	// Magnitude * exp(-(d / Radius)^2) around From, splatted over a box of
+	// three radii.
+	Gaussian,
+
+	// Same falloff around the segment From-To, e.g. a boat wake.
+	Segment
+};
+
+// One queued disturbance.  From/To are world-space (x, z) on the water
+// plane; the grid is centered at the origin (see Waves::Position).
+struct WavesImpulse
+{
+	WavesImpulseShape Shape = WavesImpulseShape::Point;
+	DirectX::XMFLOAT2 From = { 0.0f, 0.0f };
+	DirectX::XMFLOAT2 To = { 0.0f, 0.0f };
+	float Radius = 1.0f;
+	float Magnitude = 0.0f;
+};
+
+// How Update schedules the height integration and the normal/tangent pass.
+enum class WavesUpdateMode : int
+{
+	// Integrate the whole grid, then recompute every normal in a second sweep.
+	TwoPass = 0,
+
+	// Walk row bands and recompute normals one row behind the integration,
+	// while the new heights are still in cache.  Results are identical.
+	Fused
+};
 
 class Waves
 {
@@ -16,14 +80,226 @@ public:
 	int TriangleCount() const;
 	float Width() const;
 	float Depth() const;
+	float SpatialStep() const { return mSpatialStep; }
+
+	// Only the heights are stored; x and z are rebuilt from the grid spacing.
+	DirectX::XMFLOAT3 Position(int i) const
+	{
+		return DirectX::XMFLOAT3(
+			-mHalfWidth + (i % mNumCols) * mSpatialStep,
+			mCurrSolution[i],
+			mHalfDepth - (i / mNumCols) * mSpatialStep);
+	}
+	float Height(int i) const { return mCurrSolution[i]; }
+	const float* Heights() const { return mCurrSolution.data(); }
+
+	// Position blended between the last two simulation steps by
+	// InterpolationFactor(), for rendering between fixed steps.
+	DirectX::XMFLOAT3 InterpolatedPosition(int i) const
+	{
+		DirectX::XMFLOAT3 p = Position(i);
+		p.y = mPrevSolution[i] + mAlpha * (mCurrSolution[i] - mPrevSolution[i]);
+		return p;
+	}
 
-	const DirectX::XMFLOAT3& Position(int i) const { return mCurrSolution[i]; }
 	const DirectX::XMFLOAT3& Normal(int i) const { return mNormals[i]; }
 	const DirectX::XMFLOAT3& TangentX(int i) const { return mTangentX[i]; }
+	const DirectX::XMFLOAT3* Normals() const { return mNormals.data(); }
+
+	// World-space height/normal queries on the current heights.  Valid until
+	// the next Update and not safe to use while it runs; see
+	// AsyncWaves::HeightField for queries from other threads.
+	WavesSampler Sampler() const { return WavesSampler(mCurrSolution.data(), mNumRows, mNumCols, mSpatialStep); }
+
+	// Writes every vertex (position, normal and, if the layout asks for it,
+	// grid UVs) straight into dst, e.g. the mapped memory of an upload
+	// buffer, with parallel non-temporal stores.  Equivalent to filling each
+	// vertex from Position(i)/Normal(i) but without the intermediate copy.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout) const;
+
+	// Same, but only for the given rows.  dst is still the start of the
+	// whole vertex array.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout, const std::vector<WavesRowRange>& rows) const;
+
+	// Compact alternative to WriteVertices: one WavesCompactVertex (half
+	// height, octahedral normal) per vertex, a quarter of the bytes.  x and z
+	// come from a static stream written once by WriteGridPositions.
+	void WriteCompactVertices(WavesCompactVertex* dst) const;
+	void WriteCompactVertices(WavesCompactVertex* dst, const std::vector<WavesRowRange>& rows) const;
+
+	// (x, z) of every vertex, in the order of the vertex arrays above.
+	void WriteGridPositions(DirectX::XMFLOAT2* dst) const;
+
+	// Dirty-row tracking, so per-frame vertex buffers only re-upload rows
+	// whose vertices changed.  After each Update, a row whose heights moved
+	// more than 'tolerance' from what was last reported marks itself and its
+	// two neighbors (whose normals read its heights) with a new stamp.
+	// Smaller changes are ignored, so an upload can lag the simulation by up
+	// to the tolerance.
+	//
+	// Each consumer remembers the DirtyStamp() it last uploaded at and asks
+	// DirtyRows for everything newer; stamp 0 means "never uploaded" and
+	// returns the whole grid.
+	void EnableDirtyTracking(bool enable, float tolerance = 0.0f);
+	bool DirtyTrackingEnabled() const { return mDirtyTracking; }
+	unsigned long long DirtyStamp() const { return mDirtyStamp; }
+	void DirtyRows(unsigned long long since, std::vector<WavesRowRange>& rows) const;
+
+	// Stamp of the last change to row i; only valid while tracking.
+	unsigned long long RowStamp(int i) const { return mRowStamps[i]; }
+
+	// Kernel used for the height integration.  Defaults to the best level the
+	// CPU supports; requests above that are clamped.
+	WavesSimdLevel SimdLevel() const { return mSimdLevel; }
+	void SetSimdLevel(WavesSimdLevel level);
+
+	// Pool that runs the row loops of Update.  Defaults to ThreadPool::Default().
+	ThreadPool* Pool() const { return mPool; }
+	void SetThreadPool(ThreadPool* pool);
+
+	// Huge pages and first-touch placement for the per-vertex arrays; off by
+	// default.  Setting them reallocates the arrays, keeping their contents,
+	// so set the pool first for FirstTouch to spread the pages over it.
+	const WavesMemoryOptions& MemoryOptions() const { return mMemory; }
+	void SetMemoryOptions(const WavesMemoryOptions& options);
+
+	WavesUpdateMode UpdateMode() const { return mUpdateMode; }
+	void SetUpdateMode(WavesUpdateMode mode) { mUpdateMode = mode; }
+
+	// Rough main-memory traffic of one simulation step in the given mode,
+	// assuming the grid does not fit in cache (write-allocate counted).
+	std::size_t EstimatedStepBytes(WavesUpdateMode mode) const;
 
-	void Update(float dt);
+	// Explicit by default.  Active tiles and UpdateMode() only apply to the
+	// explicit integrator.
+	WavesIntegrator Integrator() const { return mIntegrator; }
+	void SetIntegrator(WavesIntegrator integrator) { mIntegrator = integrator; }
+
+	// Fixed step of Update.  Changing it keeps the wave speed the constructor
+	// arguments produce, so e.g. an implicit instance can take 4x the step
+	// and still look the same.
+	float TimeStep() const { return mTimeStep; }
+	void SetTimeStep(float dt);
+
+	// Cells a wave crosses per step.  The explicit integrator needs this
+	// below ~0.7; the implicit one takes any value.
+	float CourantNumber() const;
+
+	// Update advances the simulation in fixed steps of the 'dt' given to the
+	// constructor.  Frame time accumulates per instance; a long frame runs
+	// several steps, at most MaxSubsteps() per call (the rest of the backlog
+	// is dropped so a slow frame cannot snowball).
+	int MaxSubsteps() const { return mMaxSubsteps; }
+	void SetMaxSubsteps(int count);
+
+	// Fraction of a step left in the accumulator after the last Update, in [0, 1).
+	float InterpolationFactor() const { return mAlpha; }
+
+	// Steps taken since construction.
+	unsigned long long StepCount() const { return mStepCount; }
+
+	// Returns the number of steps taken.
+	int Update(float dt);
+
+	// Adds a five-point splat around vertex (i, j) right away.  Parts that
+	// fall on the boundary or outside the grid are clipped.
 	void Disturb(int i, int j, float magnitude);
 
+	// Flat, still water as after construction; queued impulses are dropped.
+	// StepCount keeps counting.
+	void Reset();
+
+	// Gets every Disturb call with the step count it came at; see
+	// WavesRecorder.  Null to stop.
+	void SetRecorder(WavesRecorder* recorder) { mRecorder = recorder; }
+
+	// Batched disturbances for rain, wakes and the like.  Impulses are only
+	// queued here and then applied together, in one parallel pass over the
+	// rows, right before the next step integrates.  Parts on the boundary or
+	// outside the grid are clipped.  Radius must be positive for Gaussian
+	// and Segment impulses.
+	void QueueDisturbance(const WavesImpulse& impulse);
+	void QueueDisturbances(const WavesImpulse* impulses, int count);
+	int QueuedDisturbanceCount() const { return static_cast<int>(mImpulses.size()); }
+	void ClearDisturbances() { mImpulses.clear(); }
+
+	// Active-tile mode for large, mostly calm water.  The grid is split into
+	// tileSize x tileSize tiles; a step only integrates and re-normals tiles
+	// that carry waves or border one that does.  A tile whose heights stay
+	// below sleepThreshold in both time levels, with no lively neighbor, is
+	// flattened to exactly zero and skipped until a wave or Disturb reaches
+	// it.  The threshold bounds the error against a full update.  Tiles are
+	// integrated in two passes regardless of UpdateMode().
+	void EnableActiveTiles(bool enable, int tileSize = 32, float sleepThreshold = 1e-4f);
+	bool ActiveTilesEnabled() const { return mTileSize > 0; }
+	int ActiveTileCount() const { return mActiveTileCount; }
+	int TileCount() const { return mTileRows * mTileCols; }
+
+	// For a caller that steps the grid itself and rewrites parts of it
+	// between steps, like WavesClipmap exchanging its levels' boundaries.
+	// Writes through these bypass dirty tracking and active tiles.
+	//
+	// One fixed step, without the accumulator of Update.
+	void StepOnce() { Step(); }
+
+	// Both time levels of heights, row-major like Heights().
+	float* CurrentHeights() { return mCurrSolution.data(); }
+	float* PreviousHeights() { return mPrevSolution.data(); }
+	const float* PreviousHeights() const { return mPrevSolution.data(); }
+
+	void SetNormal(int i, const DirectX::XMFLOAT3& normal) { mNormals[i] = normal; }
+
+	// Recomputes normals and tangents from the current heights: of interior
+	// rows [first, last) in parallel on Pool(), or of columns [j0, j1) of
+	// row i.
+	void UpdateNormals(int first, int last);
+	void UpdateNormals(int i, int j0, int j1);
+
+private:
+	// Reads and restores the complete state.
+	friend class WavesState;
+
+	// One fixed step of mTimeStep.
+	void Step();
+	void StepActiveTiles();
+	void StepImplicit();
+
+	// Recomputes the step-dependent constants of both integrators.
+	void UpdateConstants();
+
+	// (Re)allocates the per-vertex arrays as mMemory says.  Existing contents
+	// are carried over; new arrays start as calm water.
+	void AllocateArrays();
+
+	// Height integration / normal recomputation of rows [first, last), or of
+	// columns [j0, j1) of row i.
+	void UpdateHeightRows(int first, int last);
+	void UpdateNormalRows(const float* heights, int first, int last);
+	void UpdateHeightSpan(int i, int j0, int j1);
+	void UpdateNormalSpan(const float* heights, int i, int j0, int j1);
+
+	// Fused mode: integrate band [first, last) and recompute its normals one
+	// row behind.  Rows whose normals need a neighbor band's heights are left
+	// for the seam pass.
+	void UpdateBand(int first, int last);
+
+	// Active tiles: interior cell rectangle of tile t, measuring, and
+	// rebuilding the active list (flattening tiles that fall asleep).
+	void TileBounds(int t, int& r0, int& r1, int& c0, int& c1) const;
+	void RunBounds(int k, int& r0, int& r1, int& c0, int& c1) const;
+	void MeasureTile(int t);
+	void RebuildActiveTiles();
+	void WakeTilesAround(int i, int j);
+	void WakeTiles(int r0, int r1, int c0, int c1);
+
+	// Applies and clears the queued impulses.
+	void ApplyDisturbances();
+	void SplatImpulseRow(int k, int i);
+
+	// Compares the heights against the last reported ones and restamps the
+	// rows that moved.
+	void TrackDirtyRows();
+
 private:
 	int mNumRows = 0;
 	int mNumCols = 0;
@@ -37,11 +313,92 @@ private:
 	float mK3 = 0.0f;
 
 	float mTimeStep = 0.0f;
+	float mWaveSpeed = 0.0f;
+	float mDamping = 0.0f;
+	WavesIntegrator mIntegrator = WavesIntegrator::Explicit;
+	float mAccumulator = 0.0f;
+	float mAlpha = 0.0f;
+	int mMaxSubsteps = 4;
+	unsigned long long mStepCount = 0;
 	float mSpatialStep = 0.0f;
+	float mHalfWidth = 0.0f;
+	float mHalfDepth = 0.0f;
+
+	WavesSimdLevel mSimdLevel = WavesSimdLevel::Scalar;
+	ThreadPool* mPool = nullptr;
+	WavesUpdateMode mUpdateMode = WavesUpdateMode::Fused;
+
+	// Rows handed to a worker at a time.
+	int mRowGrain = 1;
 	
-	std::vector<DirectX::XMFLOAT3> mPrevSolution;
-	std::vector<DirectX::XMFLOAT3> mCurrSolution;
-	std::vector<DirectX::XMFLOAT3> mNormals;
-	std::vector<DirectX::XMFLOAT3> mTangentX;
+	// Row-major heights h(x_j, z_i) of the previous and current time step.
+	WavesMemoryOptions mMemory;
+	WavesVector<float> mPrevSolution;
+	WavesVector<float> mCurrSolution;
+	WavesVector<DirectX::XMFLOAT3> mNormals;
+	WavesVector<DirectX::XMFLOAT3> mTangentX;
+
+	// Active-tile state; mTileSize == 0 means every cell is updated.
+	int mTileSize = 0;
+	int mTileRows = 0;
+	int mTileCols = 0;
+	float mSleepThreshold = 0.0f;
+	bool mTilesDirty = false;
+	std::vector<unsigned char> mTileLively;
+	std::vector<unsigned char> mTileActive;
+	int mActiveTileCount = 0;
+
+	// Horizontal runs of adjacent active tiles in one tile row.  A run is
+	// processed as full-width row spans, so a fully active grid streams rows
+	// like the dense update does.
+	struct TileRun
+	{
+		int Row = 0;
+		int First = 0;
+		int Last = 0;
+	};
+	std::vector<TileRun> mActiveRuns;
+
+	// Dirty-row tracking.
+	WavesRecorder* mRecorder = nullptr;
+
+	bool mDirtyTracking = false;
+	bool mHeightsTouched = false;
+	float mDirtyTolerance = 0.0f;
+	unsigned long long mDirtyStamp = 0;
+	std::vector<float> mReportedHeights;
+	std::vector<unsigned char> mRowMoved;
+	std::vector<unsigned long long> mRowStamps;
+
+	// Implicit integrator: squared Courant number, damping factors of the
+	// new/old level, and the precomputed Thomas factors of the constant
+	// row/column systems (super-diagonal ratios and inverse pivots).
+	float mAdiR = 0.0f;
+	float mAdiNew = 1.0f;
+	float mAdiOld = 1.0f;
+	std::vector<float> mAdiRowRatio;
+	std::vector<float> mAdiRowPivot;
+	std::vector<float> mAdiColRatio;
+	std::vector<float> mAdiColPivot;
+	// Trades places with mPrevSolution every step, so it uses the same memory.
+	WavesVector<float> mImplicitScratch;
+
+	// Queued impulses and the per-impulse scratch of ApplyDisturbances:
+	// the clipped interior rectangle [Row0, Row1) x [Col0, Col1) each one
+	// touches, and for Gaussians the offset of its column weights.
+	struct ImpulseSpan
+	{
+		int Row0 = 0;
+		int Row1 = 0;
+		int Col0 = 0;
+		int Col1 = 0;
+		int CenterRow = 0;
+		int CenterCol = 0;
+		int Weights = -1;
+	};
+	std::vector<WavesImpulse> mImpulses;
+	std::vector<ImpulseSpan> mImpulseSpans;
+	std::vector<int> mImpulseOrder;
+	std::vector<float> mImpulseWeights;
 };
 
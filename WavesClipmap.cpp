@@ -0,0 +1,407 @@
+#include "WavesClipmap.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Appends triangle (a, b, c) with the winding of the plain grid
+	// triangles, (i, j), (i, j+1), (i+1, j), whatever order it came in.
+	void PushTriangle(std::vector<std::uint16_t>& indices, int n, int a, int b, int c)
+	{
+		// Grid coordinates x = j, y = -i; grid triangles turn clockwise.
+		const int abx = b % n - a % n;
+		const int aby = a / n - b / n;
+		const int acx = c % n - a % n;
+		const int acy = a / n - c / n;
+		if (abx * acy - aby * acx > 0)
+			std::swap(b, c);
+
+		indices.push_back(static_cast<std::uint16_t>(a));
+		indices.push_back(static_cast<std::uint16_t>(b));
+		indices.push_back(static_cast<std::uint16_t>(c));
+	}
+
+	// Triangulates the strip between a boundary edge, using only its even
+	// vertices (those the coarser level shares), and the row or column just
+	// inside it.  boundary(s) and inner(s) give the vertex at position s along
+	// the edge; the boundary runs over s = 0, 2, ..., n-1 and the inner line
+	// over s = 1, ..., n-2, so the four strips of a level meet on its
+	// diagonals.
+	template <typename Boundary, typename Inner>
+	void Zip(std::vector<std::uint16_t>& indices, int n, Boundary boundary, Inner inner)
+	{
+		int a = 0;
+		int b = 1;
+		while (a < n - 1 || b < n - 2)
+		{
+			if (b == n - 2 || (a < n - 1 && a + 2 < b + 1))
+			{
+				PushTriangle(indices, n, boundary(a), boundary(a + 2), inner(b));
+				a += 2;
+			}
+			else
+			{
+				PushTriangle(indices, n, boundary(a), inner(b + 1), inner(b));
+				++b;
+			}
+		}
+	}
+}
+
+WavesClipmap::WavesClipmap(int levelCount, int n, float dx, float dt, float speed, float damping)
+{
+	assert(levelCount >= 1);
+	assert(n >= 5 && (n - 1) % 4 == 0);
+
+	// Every level has to be addressable with 16-bit indices.
+	assert(n * n <= 0x10000);
+
+	mSize = n;
+	mHole = (n - 1) / 4;
+	mRowGrain = std::max(1, (16 * 1024) / n);
+	mTimeStep = dt;
+
+	// Waves derives its wave speed as speed * sqrt(dx / dt), so the speed
+	// argument of a level with spacing dx_l is scaled by sqrt(dx / dx_l) to
+	// keep every level at the finest level's speed.
+	for (int l = 0; l < levelCount; ++l)
+	{
+		const float spacing = dx * static_cast<float>(1 << l);
+		mLevels.push_back(std::make_unique<Waves>(n, n, spacing, dt,
+			speed * sqrtf(dx / spacing), damping));
+	}
+}
+
+WavesClipmap::~WavesClipmap()
+{
+}
+
+float WavesClipmap::Extent() const
+{
+	return (mSize - 1) * LevelSpacing(LevelCount() - 1);
+}
+
+void WavesClipmap::SetMaxSubsteps(int count)
+{
+	mMaxSubsteps = std::max(count, 1);
+}
+
+bool WavesClipmap::SetFocus(float x, float z)
+{
+	// The coarsest spacing is a whole number of cells on every level, so
+	// snapping to it keeps each finer level on its coarser level's vertices.
+	const int levelCount = LevelCount();
+	const float snap = LevelSpacing(levelCount - 1);
+
+	const int dx = static_cast<int>(lroundf((x - mCenter.x) / snap));
+	const int dz = static_cast<int>(lroundf((z - mCenter.y) / snap));
+	if (dx == 0 && dz == 0)
+		return false;
+
+	mCenter.x += dx * snap;
+	mCenter.y += dz * snap;
+
+	// Coarse first, so the finer levels can fill from the scrolled coarse
+	// level.  Row 0 is at +z, so moving toward +z scrolls the rows back.
+	for (int l = levelCount - 1; l >= 0; --l)
+	{
+		const int cells = 1 << (levelCount - 1 - l);
+		Scroll(l, -dz * cells, dx * cells);
+	}
+
+	for (int l = 0; l < levelCount; ++l)
+	{
+		mLevels[l]->UpdateNormals(1, mSize - 1);
+	}
+
+	for (int l = 0; l + 1 < levelCount; ++l)
+		Restrict(l);
+	for (int l = 0; l + 1 < levelCount; ++l)
+		Prolong(l);
+
+	return true;
+}
+
+int WavesClipmap::Update(float dt)
+{
+	mAccumulator += dt;
+
+	int steps = 0;
+	while (mAccumulator >= mTimeStep && steps < mMaxSubsteps)
+	{
+		Step();
+		mAccumulator -= mTimeStep;
+		++steps;
+	}
+
+	if (mAccumulator >= mTimeStep)
+	{
+		mAccumulator = fmodf(mAccumulator, mTimeStep);
+	}
+
+	return steps;
+}
+
+void WavesClipmap::Step()
+{
+	const int levelCount = LevelCount();
+
+	for (int l = 0; l < levelCount; ++l)
+		mLevels[l]->StepOnce();
+
+	// Fine to coarse, so a wave near the center reaches every level in the
+	// same step.
+	for (int l = 0; l + 1 < levelCount; ++l)
+		Restrict(l);
+	for (int l = 0; l + 1 < levelCount; ++l)
+		Prolong(l);
+
+	++mStepCount;
+}
+
+void WavesClipmap::Restrict(int l)
+{
+	const Waves& fine = *mLevels[l];
+	Waves& coarse = *mLevels[l + 1];
+	const int n = mSize;
+	const int first = mHole;
+	const int last = n - 1 - mHole;
+
+	const float* finePrev = fine.PreviousHeights();
+	const float* fineCurr = fine.Heights();
+	float* coarsePrev = coarse.PreviousHeights();
+	float* coarseCurr = coarse.CurrentHeights();
+
+	// Coarse vertices strictly inside the hole coincide with the fine
+	// level's even vertices.  The hole's edge stays the coarse level's own:
+	// it is what the fine boundary is taken from.
+	coarse.Pool()->ParallelFor(first + 1, last, mRowGrain, [&](int r0, int r1)
+		{
+			for (int i = r0; i < r1; ++i)
+			{
+				const int src = 2 * (i - first) * n - 2 * first;
+				for (int j = first + 1; j < last; ++j)
+				{
+					coarsePrev[i * n + j] = finePrev[src + 2 * j];
+					coarseCurr[i * n + j] = fineCurr[src + 2 * j];
+				}
+			}
+		});
+
+	// The hole's edge is drawn by the coarse ring; its normals read the
+	// heights just restricted.
+	coarse.UpdateNormals(first, first, last + 1);
+	coarse.UpdateNormals(last, first, last + 1);
+	for (int i = first + 1; i < last; ++i)
+	{
+		coarse.UpdateNormals(i, first, first + 1);
+		coarse.UpdateNormals(i, last, last + 1);
+	}
+}
+
+float WavesClipmap::CoarseHeight(const float* coarse, int i, int j) const
+{
+	// Fine vertex (i, j) sits at coarse (mHole + i/2, mHole + j/2); odd
+	// indices fall halfway between two coarse vertices.
+	const int n = mSize;
+	const int i0 = mHole + i / 2;
+	const int i1 = mHole + (i + 1) / 2;
+	const int j0 = mHole + j / 2;
+	const int j1 = mHole + (j + 1) / 2;
+
+	return 0.25f * (coarse[i0 * n + j0] + coarse[i0 * n + j1] + coarse[i1 * n + j0] + coarse[i1 * n + j1]);
+}
+
+XMFLOAT3 WavesClipmap::CoarseNormal(int l, int i, int j) const
+{
+	const Waves& coarse = *mLevels[l + 1];
+	const int n = mSize;
+	const int i0 = mHole + i / 2;
+	const int i1 = mHole + (i + 1) / 2;
+	const int j0 = mHole + j / 2;
+	const int j1 = mHole + (j + 1) / 2;
+
+	XMVECTOR sum = XMLoadFloat3(&coarse.Normal(i0 * n + j0));
+	sum = XMVectorAdd(sum, XMLoadFloat3(&coarse.Normal(i0 * n + j1)));
+	sum = XMVectorAdd(sum, XMLoadFloat3(&coarse.Normal(i1 * n + j0)));
+	sum = XMVectorAdd(sum, XMLoadFloat3(&coarse.Normal(i1 * n + j1)));
+
+	XMFLOAT3 normal;
+	XMStoreFloat3(&normal, XMVector3Normalize(sum));
+	return normal;
+}
+
+void WavesClipmap::Prolong(int l)
+{
+	Waves& fine = *mLevels[l];
+	const Waves& coarse = *mLevels[l + 1];
+	const int n = mSize;
+
+	float* finePrev = fine.PreviousHeights();
+	float* fineCurr = fine.CurrentHeights();
+
+	// Both time levels: the integrator expects the boundary to hold the same
+	// value in each.
+	auto set = [&](int i, int j)
+	{
+		const float h = CoarseHeight(coarse.Heights(), i, j);
+		finePrev[i * n + j] = h;
+		fineCurr[i * n + j] = h;
+		fine.SetNormal(i * n + j, CoarseNormal(l, i, j));
+	};
+
+	for (int j = 0; j < n; ++j)
+	{
+		set(0, j);
+		set(n - 1, j);
+	}
+	for (int i = 1; i < n - 1; ++i)
+	{
+		set(i, 0);
+		set(i, n - 1);
+	}
+
+	// The vertices next to the boundary were re-normaled against the old
+	// boundary by the step.
+	fine.UpdateNormals(1, 2);
+	fine.UpdateNormals(n - 2, n - 1);
+	for (int i = 2; i < n - 2; ++i)
+	{
+		fine.UpdateNormals(i, 1, 2);
+		fine.UpdateNormals(i, n - 2, n - 1);
+	}
+}
+
+void WavesClipmap::Scroll(int l, int rows, int cols)
+{
+	Waves& level = *mLevels[l];
+	const int n = mSize;
+	const bool coarsest = l + 1 == LevelCount();
+
+	std::vector<float> scrolled(n * n);
+
+	for (int k = 0; k < 2; ++k)
+	{
+		float* field = k == 0 ? level.PreviousHeights() : level.CurrentHeights();
+		const float* coarse = nullptr;
+		if (!coarsest)
+			coarse = k == 0 ? mLevels[l + 1]->PreviousHeights() : mLevels[l + 1]->Heights();
+
+		level.Pool()->ParallelFor(0, n, mRowGrain, [&](int first, int last)
+			{
+				for (int i = first; i < last; ++i)
+				{
+					for (int j = 0; j < n; ++j)
+					{
+						const int si = i + rows;
+						const int sj = j + cols;
+
+						float h;
+						if (si >= 0 && si < n && sj >= 0 && sj < n)
+							h = field[si * n + sj];
+						else
+							h = coarse != nullptr ? CoarseHeight(coarse, i, j) : 0.0f;
+
+						// The coarsest boundary stays at rest.
+						if (coarsest && (i == 0 || i == n - 1 || j == 0 || j == n - 1))
+							h = 0.0f;
+
+						scrolled[i * n + j] = h;
+					}
+				}
+			});
+
+		std::copy(scrolled.begin(), scrolled.end(), field);
+	}
+}
+
+void WavesClipmap::QueueDisturbance(const WavesImpulse& impulse)
+{
+	WavesImpulse local = impulse;
+	local.From.x -= mCenter.x;
+	local.From.y -= mCenter.y;
+	local.To.x -= mCenter.x;
+	local.To.y -= mCenter.y;
+
+	const bool segment = impulse.Shape == WavesImpulseShape::Segment;
+
+	for (int l = 0; l < LevelCount(); ++l)
+	{
+		// Keep clear of the boundary, which the next exchange overwrites.
+		const float reach = 0.5f * (mSize - 1) * LevelSpacing(l) - 2.0f * LevelSpacing(l);
+
+		auto inside = [reach](const XMFLOAT2& p)
+		{
+			return fabsf(p.x) < reach && fabsf(p.y) < reach;
+		};
+
+		if (inside(local.From) && (!segment || inside(local.To)))
+		{
+			mLevels[l]->QueueDisturbance(local);
+			return;
+		}
+	}
+}
+
+void WavesClipmap::WriteVertices(void* dst, const WavesVertexLayout& layout) const
+{
+	unsigned char* base = static_cast<unsigned char*>(dst);
+	const std::size_t levelBytes = static_cast<std::size_t>(mSize) * mSize * layout.Stride;
+
+	for (int l = 0; l < LevelCount(); ++l)
+		mLevels[l]->WriteVertices(base + l * levelBytes, layout);
+}
+
+void WavesClipmap::BuildIndices(std::vector<std::uint16_t>& indices, std::vector<WavesClipmapRange>& ranges) const
+{
+	const int n = mSize;
+	const int levelCount = LevelCount();
+
+	indices.clear();
+	ranges.resize(levelCount);
+
+	for (int l = 0; l < levelCount; ++l)
+	{
+		const bool stitched = l + 1 < levelCount;
+		const bool hollow = l > 0;
+
+		WavesClipmapRange& range = ranges[l];
+		range.StartIndex = static_cast<unsigned>(indices.size());
+		range.BaseVertex = l * n * n;
+
+		// Plain quads, minus the finer level's hole and, below the coarsest
+		// level, the outermost ring.
+		const int q0 = stitched ? 1 : 0;
+		const int q1 = stitched ? n - 2 : n - 1;
+		for (int i = q0; i < q1; ++i)
+		{
+			for (int j = q0; j < q1; ++j)
+			{
+				if (hollow && i >= mHole && i < n - 1 - mHole && j >= mHole && j < n - 1 - mHole)
+					continue;
+
+				indices.push_back(static_cast<std::uint16_t>(i * n + j));
+				indices.push_back(static_cast<std::uint16_t>(i * n + j + 1));
+				indices.push_back(static_cast<std::uint16_t>((i + 1) * n + j));
+
+				indices.push_back(static_cast<std::uint16_t>((i + 1) * n + j));
+				indices.push_back(static_cast<std::uint16_t>(i * n + j + 1));
+				indices.push_back(static_cast<std::uint16_t>((i + 1) * n + j + 1));
+			}
+		}
+
+		if (stitched)
+		{
+			Zip(indices, n, [](int s) { return s; }, [n](int s) { return n + s; });
+			Zip(indices, n, [n](int s) { return (n - 1) * n + s; }, [n](int s) { return (n - 2) * n + s; });
+			Zip(indices, n, [n](int s) { return s * n; }, [n](int s) { return s * n + 1; });
+			Zip(indices, n, [n](int s) { return s * n + n - 1; }, [n](int s) { return s * n + n - 2; });
+		}
+
+		range.IndexCount = static_cast<unsigned>(indices.size()) - range.StartIndex;
+	}
+}
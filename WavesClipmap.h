@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+#include "Waves.h"
+
+// One level's slice of the index list built by WavesClipmap::BuildIndices.
+// Indices are relative to BaseVertex, the level's first vertex in the
+// vertex array WriteVertices fills.
+struct WavesClipmapRange
+{
+	unsigned IndexCount = 0;
+	unsigned StartIndex = 0;
+	int BaseVertex = 0;
+};
+
+// Nested-ring (clipmap) water around a moving focus point, usually the camera.
+//
+// Level l is an n x n Waves grid with spacing dx * 2^l, and every level is
+// centered on the same point, so each level covers the middle half of the next
+// coarser one.  Levels are drawn as rings: a level leaves out the hole the
+// finer level fills, and its outermost quads are re-triangulated onto every
+// other vertex so they meet the coarser ring without T-junctions.
+//
+// The levels step in lockstep and are coupled after every step: the part of a
+// coarse level under the finer one is overwritten with the fine solution, and
+// the fine level's boundary, instead of the usual fixed zero, is interpolated
+// from the coarse level.  Waves therefore leave the fine region and keep
+// travelling, at the coarse level's resolution, instead of reflecting.
+//
+// The shared center is snapped to the coarsest spacing.  When the focus moves
+// past half a coarsest cell every level scrolls by whole cells; cells that
+// scroll in are filled from the next coarser level, or with calm water at the
+// coarsest level.
+//
+// Only the explicit integrator is supported, without active tiles.
+class WavesClipmap
+{
+public:
+	// n - 1 must be a multiple of 4.  speed/damping/dt mean what they do for
+	// Waves at the finest spacing dx; coarser levels are set up to travel at
+	// the same speed.
+	WavesClipmap(int levelCount, int n, float dx, float dt, float speed, float damping);
+	WavesClipmap(const WavesClipmap& rhs) = delete;
+	WavesClipmap& operator=(const WavesClipmap& rhs) = delete;
+	~WavesClipmap();
+
+	int LevelCount() const { return static_cast<int>(mLevels.size()); }
+	int LevelSize() const { return mSize; }
+
+	// Total over all levels.  Level l's vertices start at l * n * n.
+	int VertexCount() const { return LevelCount() * mSize * mSize; }
+
+	Waves& Level(int l) { return *mLevels[l]; }
+	const Waves& Level(int l) const { return *mLevels[l]; }
+	float LevelSpacing(int l) const { return mLevels[l]->SpatialStep(); }
+
+	// World-space (x, z) of the shared center.  WriteVertices writes positions
+	// relative to it, so the renderer translates the water by it.
+	DirectX::XMFLOAT2 Center() const { return mCenter; }
+
+	// Side length covered by the coarsest level.
+	float Extent() const;
+
+	// Re-centers the levels on world-space (x, z).  Returns true if they
+	// scrolled.
+	bool SetFocus(float x, float z);
+
+	// Same fixed-step accumulator as Waves::Update; returns the steps taken.
+	int Update(float dt);
+
+	int MaxSubsteps() const { return mMaxSubsteps; }
+	void SetMaxSubsteps(int count);
+	unsigned long long StepCount() const { return mStepCount; }
+
+	// Queues an impulse, in world space, on the finest level that contains
+	// it.  Impulses outside every level are dropped.
+	void QueueDisturbance(const WavesImpulse& impulse);
+
+	// Writes every level, one after another, in the layout of
+	// Waves::WriteVertices.
+	void WriteVertices(void* dst, const WavesVertexLayout& layout) const;
+
+	// Triangle-list indices of every level's ring, 16-bit, relative to each
+	// level's first vertex.
+	void BuildIndices(std::vector<std::uint16_t>& indices, std::vector<WavesClipmapRange>& ranges) const;
+
+private:
+	// One lockstep step of every level plus the exchange between them.
+	void Step();
+
+	// Fine level l -> hole of level l+1, both time levels.
+	void Restrict(int l);
+
+	// Level l+1 -> boundary of level l, both time levels, and the boundary
+	// normals.
+	void Prolong(int l);
+
+	// Scrolls level l by (rows, cols) cells; cells that come in are filled
+	// from level l+1 or zeroed.
+	void Scroll(int l, int rows, int cols);
+
+	// Coarse heights/normals (of level l+1) at fine-grid vertex (i, j) of
+	// level l.
+	float CoarseHeight(const float* coarse, int i, int j) const;
+	DirectX::XMFLOAT3 CoarseNormal(int l, int i, int j) const;
+
+private:
+	int mSize = 0;
+
+	// First coarse row/column under the finer level: (n - 1) / 4.  The finer
+	// level spans coarse vertices [mHole, mSize - 1 - mHole].
+	int mHole = 0;
+
+	// Rows per task of the row loops over a level, as Waves picks them.
+	int mRowGrain = 1;
+
+	std::vector<std::unique_ptr<Waves>> mLevels;
+
+	DirectX::XMFLOAT2 mCenter = { 0.0f, 0.0f };
+
+	float mTimeStep = 0.0f;
+	float mAccumulator = 0.0f;
+	int mMaxSubsteps = 4;
+	unsigned long long mStepCount = 0;
+};
@@ -0,0 +1,124 @@
+#include "WavesMemory.h"
+#include <cstdint>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	const std::size_t HugePageSize = 2 * 1024 * 1024;
+
+	std::size_t RoundUp(std::size_t bytes, std::size_t multiple)
+	{
+		return (bytes + multiple - 1) / multiple * multiple;
+	}
+
+	// Smaller arrays would mostly be padding.
+	bool UseHugePages(std::size_t bytes, bool hugePages)
+	{
+		return hugePages && bytes >= HugePageSize;
+	}
+
+#if defined(_WIN32)
+	// Large pages need SeLockMemoryPrivilege, which the account must have
+	// been granted and the process must enable.  Returns the large page size,
+	// or 0 if they cannot be used.
+	SIZE_T QueryLargePageSize()
+	{
+		const SIZE_T size = GetLargePageMinimum();
+		if (size == 0)
+			return 0;
+
+		HANDLE token;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+			return 0;
+
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		const bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+			GetLastError() == ERROR_SUCCESS;
+		CloseHandle(token);
+
+		return enabled ? size : 0;
+	}
+
+	SIZE_T LargePageSize()
+	{
+		static const SIZE_T size = QueryLargePageSize();
+		return size;
+	}
+#endif
+}
+
+void* WavesMemory::Allocate(std::size_t bytes, bool hugePages)
+{
+	if (!UseHugePages(bytes, hugePages))
+		return ::operator new(bytes);
+
+#if defined(_WIN32)
+	void* p = nullptr;
+	if (const SIZE_T large = LargePageSize())
+	{
+		p = VirtualAlloc(nullptr, RoundUp(bytes, large),
+			MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	}
+	if (p == nullptr)
+		p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+#else
+	const std::size_t size = RoundUp(bytes, HugePageSize);
+
+#if defined(MAP_HUGETLB)
+	// Only succeeds when huge pages have been reserved (vm.nr_hugepages).
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+		return p;
+#endif
+
+	// Transparent huge pages: map one page extra, trim to a 2 MB boundary
+	// and ask the kernel to back the range with huge pages as it faults in.
+	void* raw = mmap(nullptr, size + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		throw std::bad_alloc();
+
+	const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(raw);
+	const std::uintptr_t aligned = RoundUp(begin, HugePageSize);
+	if (aligned > begin)
+		munmap(raw, aligned - begin);
+	if (aligned + size < begin + size + HugePageSize)
+		munmap(reinterpret_cast<void*>(aligned + size), begin + HugePageSize - aligned);
+
+#if defined(MADV_HUGEPAGE)
+	madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+	return reinterpret_cast<void*>(aligned);
+#endif
+}
+
+void WavesMemory::Free(void* p, std::size_t bytes, bool hugePages)
+{
+	if (p == nullptr)
+		return;
+
+	if (!UseHugePages(bytes, hugePages))
+	{
+		::operator delete(p);
+		return;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, RoundUp(bytes, HugePageSize));
+#endif
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Where Waves puts its per-vertex arrays (both height levels, normals and
+// tangents).  Neither option changes the results, only how fast they come.
+struct WavesMemoryOptions
+{
+	// Back arrays of 2 MB and up with 2 MB pages, so a step over a large grid
+	// walks a few hundred TLB entries instead of tens of thousands.  Linux
+	// takes reserved huge pages (MAP_HUGETLB) when there are any and
+	// otherwise 2 MB-aligned memory advised MADV_HUGEPAGE; Windows takes
+	// large pages when the process holds SeLockMemoryPrivilege.  Falls back
+	// to ordinary pages where neither is available.
+	bool HugePages = false;
+
+	// Fault the pages in from the pool threads, a row band per task like
+	// Update hands them out, instead of from the constructing thread.  Under
+	// first-touch placement (the Linux default) this spreads the grid over
+	// the NUMA nodes the workers run on rather than putting all of it on
+	// one.  Windows large pages are committed up front, so there this only
+	// applies to ordinary pages.
+	bool FirstTouch = false;
+};
+
+namespace WavesMemory
+{
+	// Huge-page or ordinary memory; throws std::bad_alloc.
+	// Free must get the same size and kind.
+	void* Allocate(std::size_t bytes, bool hugePages);
+	void Free(void* p, std::size_t bytes, bool hugePages);
+}
+
+// Allocator for the arrays above.  It remembers whether its memory comes in
+// huge pages and moves along with the memory on swap and move, so the
+// simulation can keep swapping its time levels.
+//
+// Elements constructed without arguments are default-initialized, which for
+// float and XMFLOAT3 leaves them untouched: resize() reserves the pages
+// without faulting them in, and whoever writes first places them.
+template <class T>
+class WavesAllocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	WavesAllocator() = default;
+	explicit WavesAllocator(bool hugePages) : mHugePages(hugePages) {}
+	template <class U>
+	WavesAllocator(const WavesAllocator<U>& rhs) : mHugePages(rhs.HugePages()) {}
+
+	bool HugePages() const { return mHugePages; }
+
+	T* allocate(std::size_t count)
+	{
+		return static_cast<T*>(WavesMemory::Allocate(count * sizeof(T), mHugePages));
+	}
+
+	void deallocate(T* p, std::size_t count)
+	{
+		WavesMemory::Free(p, count * sizeof(T), mHugePages);
+	}
+
+	template <class U>
+	void construct(U* p)
+	{
+		::new (static_cast<void*>(p)) U;
+	}
+
+	template <class U, class... Args>
+	void construct(U* p, Args&&... args)
+	{
+		::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+	}
+
+private:
+	bool mHugePages = false;
+};
+
+template <class T, class U>
+bool operator==(const WavesAllocator<T>& lhs, const WavesAllocator<U>& rhs)
+{
+	return lhs.HugePages() == rhs.HugePages();
+}
+
+template <class T, class U>
+bool operator!=(const WavesAllocator<T>& lhs, const WavesAllocator<U>& rhs)
+{
+	return !(lhs == rhs);
+}
+
+template <class T>
+using WavesVector = std::vector<T, WavesAllocator<T>>;
@@ -0,0 +1,271 @@
+#include "WavesRecording.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	const char Magic[4] = { 'W', 'V', 'R', 'C' };
+	const std::uint32_t Version = 1;
+
+	// Desc fields in file order; the integrator is stored as a uint32.
+	struct FileHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::int32_t Rows;
+		std::int32_t Columns;
+		float SpatialStep;
+		float TimeStep;
+		float Speed;
+		float Damping;
+		std::uint32_t Integrator;
+		std::uint32_t Reserved;
+		std::uint64_t StepCount;
+		std::uint64_t Checksum;
+		std::uint64_t DisturbanceCount;
+	};
+
+	void PutVarint(std::vector<unsigned char>& out, std::uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<unsigned char>(value));
+	}
+
+	bool GetVarint(const unsigned char*& p, const unsigned char* end, std::uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (p == end)
+				return false;
+
+			const unsigned char byte = *p++;
+			value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+WavesRecording::WavesRecording(const WavesRecordingDesc& desc)
+	: mDesc(desc)
+{
+}
+
+void WavesRecording::Add(const WavesDisturbance& disturbance)
+{
+	assert(mDisturbances.empty() || mDisturbances.back().Step <= disturbance.Step);
+	mDisturbances.push_back(disturbance);
+}
+
+void WavesRecording::Finish(unsigned long long stepCount, std::uint64_t checksum)
+{
+	assert(mDisturbances.empty() || mDisturbances.back().Step <= stepCount);
+	mStepCount = stepCount;
+	mChecksum = checksum;
+}
+
+bool WavesRecording::Save(const std::string& filename) const
+{
+	FileHeader header = {};
+	std::memcpy(header.Magic, Magic, sizeof(Magic));
+	header.Version = Version;
+	header.Rows = mDesc.Rows;
+	header.Columns = mDesc.Columns;
+	header.SpatialStep = mDesc.SpatialStep;
+	header.TimeStep = mDesc.TimeStep;
+	header.Speed = mDesc.Speed;
+	header.Damping = mDesc.Damping;
+	header.Integrator = static_cast<std::uint32_t>(mDesc.Integrator);
+	header.StepCount = mStepCount;
+	header.Checksum = mChecksum;
+	header.DisturbanceCount = mDisturbances.size();
+
+	std::vector<unsigned char> body;
+	body.reserve(mDisturbances.size() * 8);
+
+	unsigned long long step = 0;
+	for (const WavesDisturbance& d : mDisturbances)
+	{
+		PutVarint(body, d.Step - step);
+		PutVarint(body, static_cast<std::uint32_t>(d.Row));
+		PutVarint(body, static_cast<std::uint32_t>(d.Column));
+
+		unsigned char magnitude[sizeof(float)];
+		std::memcpy(magnitude, &d.Magnitude, sizeof(float));
+		body.insert(body.end(), magnitude, magnitude + sizeof(float));
+
+		step = d.Step;
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(body.data()), static_cast<std::streamsize>(body.size()));
+	return static_cast<bool>(file);
+}
+
+bool WavesRecording::Load(const std::string& filename)
+{
+	*this = WavesRecording();
+
+	std::ifstream file(filename, std::ios::binary);
+	FileHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0 || header.Version != Version ||
+		header.Rows < 3 || header.Columns < 3 || !(header.SpatialStep > 0.0f) || !(header.TimeStep > 0.0f) ||
+		header.Integrator > static_cast<std::uint32_t>(WavesIntegrator::ImplicitAdi))
+		return false;
+
+	const std::vector<unsigned char> body(
+		(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	WavesRecording recording;
+	recording.mDesc.Rows = header.Rows;
+	recording.mDesc.Columns = header.Columns;
+	recording.mDesc.SpatialStep = header.SpatialStep;
+	recording.mDesc.TimeStep = header.TimeStep;
+	recording.mDesc.Speed = header.Speed;
+	recording.mDesc.Damping = header.Damping;
+	recording.mDesc.Integrator = static_cast<WavesIntegrator>(header.Integrator);
+	recording.mStepCount = header.StepCount;
+	recording.mChecksum = header.Checksum;
+
+	// Each disturbance takes at least 7 bytes; don't trust the count beyond that.
+	recording.mDisturbances.reserve(std::min<std::uint64_t>(header.DisturbanceCount, body.size() / 7));
+
+	const unsigned char* p = body.data();
+	const unsigned char* end = p + body.size();
+	unsigned long long step = 0;
+	for (std::uint64_t k = 0; k < header.DisturbanceCount; ++k)
+	{
+		std::uint64_t delta, row, column;
+		if (!GetVarint(p, end, delta) || !GetVarint(p, end, row) || !GetVarint(p, end, column) ||
+			end - p < static_cast<std::ptrdiff_t>(sizeof(float)) ||
+			row >= static_cast<std::uint64_t>(header.Rows) || column >= static_cast<std::uint64_t>(header.Columns))
+			return false;
+
+		WavesDisturbance d;
+		step += delta;
+		d.Step = step;
+		d.Row = static_cast<int>(row);
+		d.Column = static_cast<int>(column);
+		std::memcpy(&d.Magnitude, p, sizeof(float));
+		p += sizeof(float);
+
+		recording.mDisturbances.push_back(d);
+	}
+
+	if (step > recording.mStepCount)
+		return false;
+
+	*this = std::move(recording);
+	return true;
+}
+
+std::unique_ptr<Waves> WavesRecording::CreateSimulation() const
+{
+	auto waves = std::make_unique<Waves>(mDesc.Rows, mDesc.Columns,
+		mDesc.SpatialStep, mDesc.TimeStep, mDesc.Speed, mDesc.Damping);
+	waves->SetIntegrator(mDesc.Integrator);
+	return waves;
+}
+
+WavesReplayResult WavesRecording::Replay(Waves& waves) const
+{
+	assert(waves.RowCount() == mDesc.Rows && waves.ColumnCount() == mDesc.Columns);
+	assert(waves.TimeStep() == mDesc.TimeStep && waves.Integrator() == mDesc.Integrator);
+
+	waves.Reset();
+	const unsigned long long first = waves.StepCount();
+	const float dt = waves.TimeStep();
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// The accumulator starts empty, so each Update(dt) takes exactly one step.
+	std::size_t next = 0;
+	for (unsigned long long step = 0; step <= mStepCount; ++step)
+	{
+		for (; next < mDisturbances.size() && mDisturbances[next].Step == step; ++next)
+		{
+			const WavesDisturbance& d = mDisturbances[next];
+			waves.Disturb(d.Row, d.Column, d.Magnitude);
+		}
+
+		if (step < mStepCount)
+			waves.Update(dt);
+	}
+
+	const auto stop = std::chrono::steady_clock::now();
+
+	WavesReplayResult result;
+	result.Steps = waves.StepCount() - first;
+	result.Seconds = std::chrono::duration<double>(stop - start).count();
+	result.Checksum = HeightChecksum(waves);
+	result.Matches = result.Steps == mStepCount && result.Checksum == mChecksum;
+	return result;
+}
+
+std::uint64_t WavesRecording::HeightChecksum(const Waves& waves)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(waves.Heights());
+	const std::size_t count = static_cast<std::size_t>(waves.VertexCount()) * sizeof(float);
+
+	std::uint64_t hash = 14695981039346656037ull;
+	for (std::size_t k = 0; k < count; ++k)
+	{
+		hash ^= bytes[k];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+WavesRecorder::~WavesRecorder()
+{
+	if (IsRecording())
+		End();
+}
+
+void WavesRecorder::Begin(const WavesRecordingDesc& desc, Waves& waves)
+{
+	assert(waves.RowCount() == desc.Rows && waves.ColumnCount() == desc.Columns);
+	assert(waves.TimeStep() == desc.TimeStep && waves.Integrator() == desc.Integrator);
+
+	if (IsRecording())
+		End();
+
+	mRecording = WavesRecording(desc);
+	mWaves = &waves;
+
+	mWaves->Reset();
+	mFirstStep = mWaves->StepCount();
+	mWaves->SetRecorder(this);
+}
+
+void WavesRecorder::End()
+{
+	if (!IsRecording())
+		return;
+
+	mWaves->SetRecorder(nullptr);
+	mRecording.Finish(mWaves->StepCount() - mFirstStep, WavesRecording::HeightChecksum(*mWaves));
+	mWaves = nullptr;
+}
+
+void WavesRecorder::OnDisturb(unsigned long long step, int i, int j, float magnitude)
+{
+	WavesDisturbance d;
+	d.Step = step - mFirstStep;
+	d.Row = i;
+	d.Column = j;
+	d.Magnitude = magnitude;
+	mRecording.Add(d);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Waves.h"
+
+// Everything a replay needs to rebuild a simulation that steps exactly like
+// the recorded one: Waves' constructor arguments and the integrator.
+// Active tiles change the results (calm tiles are flattened), so leave them
+// off on both sides or turn them on on both.
+struct WavesRecordingDesc
+{
+	int Rows = 128;
+	int Columns = 128;
+	float SpatialStep = 1.0f;
+	float TimeStep = 0.03f;
+	float Speed = 4.0f;
+	float Damping = 0.2f;
+	WavesIntegrator Integrator = WavesIntegrator::Explicit;
+};
+
+// One Waves::Disturb call, made after 'Step' steps of the recording.
+struct WavesDisturbance
+{
+	unsigned long long Step = 0;
+	int Row = 0;
+	int Column = 0;
+	float Magnitude = 0.0f;
+};
+
+// Timing and result of WavesRecording::Replay.
+struct WavesReplayResult
+{
+	unsigned long long Steps = 0;
+	double Seconds = 0.0;
+	std::uint64_t Checksum = 0;
+
+	// Checksum equals the one taken when the recording ended.
+	bool Matches = false;
+};
+
+// A stream of disturbances with the step each one came before, the total
+// step count and a checksum of the final heights.
+//
+// The simulation is deterministic given its steps and disturbances: every
+// SIMD level, update mode and thread count produces the same heights.  So
+// replaying a recording does the same work as the run it came from,
+// independent of frame times and rand(), and the checksum catches any
+// build that computes something else.
+//
+// On disk: a small header, then per disturbance the step delta, row and
+// column as LEB128 varints and the magnitude as a raw float, typically 7
+// bytes each.
+class WavesRecording
+{
+public:
+	WavesRecording() = default;
+	explicit WavesRecording(const WavesRecordingDesc& desc);
+
+	const WavesRecordingDesc& Desc() const { return mDesc; }
+	const std::vector<WavesDisturbance>& Disturbances() const { return mDisturbances; }
+
+	// Steps from start to end of the recording, and the checksum of the
+	// heights at the end.  Both 0 until Finish.
+	unsigned long long StepCount() const { return mStepCount; }
+	std::uint64_t Checksum() const { return mChecksum; }
+
+	// Steps must not decrease from one call to the next.
+	void Add(const WavesDisturbance& disturbance);
+	void Finish(unsigned long long stepCount, std::uint64_t checksum);
+
+	// Return false on I/O errors or, for Load, a file that is not a
+	// recording; Load then leaves the recording empty.
+	bool Save(const std::string& filename) const;
+	bool Load(const std::string& filename);
+
+	// A new simulation as described by Desc().
+	std::unique_ptr<Waves> CreateSimulation() const;
+
+	// Resets 'waves' (which must match Desc()) to calm water and runs the
+	// recording on it as fast as it goes, with no rendering.  Configure the
+	// simulation (SIMD level, update mode, pool) beforehand to compare them.
+	WavesReplayResult Replay(Waves& waves) const;
+
+	// 64-bit FNV-1a over the bit patterns of the current heights.
+	static std::uint64_t HeightChecksum(const Waves& waves);
+
+private:
+	WavesRecordingDesc mDesc;
+	std::vector<WavesDisturbance> mDisturbances;
+	unsigned long long mStepCount = 0;
+	std::uint64_t mChecksum = 0;
+};
+
+// Records the Disturb calls of a running simulation.
+//
+// Begin calms the water, so the replay and the recorded run start from the
+// same state, and attaches to the simulation; End detaches and takes the
+// final step count and checksum.  Only Waves::Disturb is recorded, not
+// queued impulses.  The recorder is called from whichever thread runs the
+// simulation, so with AsyncWaves only Begin/End after Flush.
+class WavesRecorder
+{
+public:
+	WavesRecorder() = default;
+	WavesRecorder(const WavesRecorder& rhs) = delete;
+	WavesRecorder& operator=(const WavesRecorder& rhs) = delete;
+	~WavesRecorder();
+
+	// desc must describe how 'waves' was made.
+	void Begin(const WavesRecordingDesc& desc, Waves& waves);
+	void End();
+
+	bool IsRecording() const { return mWaves != nullptr; }
+	const WavesRecording& Recording() const { return mRecording; }
+
+private:
+	friend class Waves;
+	void OnDisturb(unsigned long long step, int i, int j, float magnitude);
+
+private:
+	WavesRecording mRecording;
+	Waves* mWaves = nullptr;
+	unsigned long long mFirstStep = 0;
+};
@@ -0,0 +1,175 @@
+#include "WavesSampler.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+// Bilinear queries must round exactly like WavesSimd::SampleBilinear.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace
+{
+	// Catmull-Rom weights of the four samples around t in [0, 1], and their
+	// derivatives with respect to t.
+	void CatmullRomWeights(float t, float w[4], float dw[4])
+	{
+		const float t2 = t * t;
+		const float t3 = t2 * t;
+
+		w[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+		w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+		w[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+		w[3] = 0.5f * (t3 - t2);
+
+		dw[0] = 0.5f * (-3.0f * t2 + 4.0f * t - 1.0f);
+		dw[1] = 0.5f * (9.0f * t2 - 10.0f * t);
+		dw[2] = 0.5f * (-9.0f * t2 + 8.0f * t + 1.0f);
+		dw[3] = 0.5f * (3.0f * t2 - 2.0f * t);
+	}
+}
+
+WavesSampler::WavesSampler(const float* heights, int m, int n, float dx)
+{
+	assert(m >= 2 && n >= 2 && dx > 0.0f);
+
+	mHeights = heights;
+	mNumRows = m;
+	mNumCols = n;
+	mSpatialStep = dx;
+	mInvSpatialStep = 1.0f / dx;
+	mX0 = -(n - 1) * dx * 0.5f;
+	mZ0 = (m - 1) * dx * 0.5f;
+	mSimdLevel = WavesSimd::DetectLevel();
+}
+
+void WavesSampler::SetSimdLevel(WavesSimdLevel level)
+{
+	mSimdLevel = std::min(level, WavesSimd::DetectLevel());
+}
+
+bool WavesSampler::Contains(float x, float z) const
+{
+	return x >= mX0 && x <= -mX0 && z <= mZ0 && z >= -mZ0;
+}
+
+float WavesSampler::Height(float x, float z, WavesFilter filter) const
+{
+	float u, v;
+	GridCoordinates(x, z, u, v);
+
+	return filter == WavesFilter::Bicubic ?
+		SampleBicubic(u, v, nullptr, nullptr) :
+		SampleBilinear(u, v, nullptr, nullptr);
+}
+
+XMFLOAT3 WavesSampler::Normal(float x, float z, WavesFilter filter) const
+{
+	float u, v;
+	GridCoordinates(x, z, u, v);
+
+	float dhdu, dhdv;
+	if (filter == WavesFilter::Bicubic)
+		SampleBicubic(u, v, &dhdu, &dhdv);
+	else
+		SampleBilinear(u, v, &dhdu, &dhdv);
+
+	// v runs toward -z, so dh/dz = -dh/dv / dx.  Scaled by dx, the normal
+	// (-dh/dx, 1, -dh/dz) becomes (-dh/du, dx, dh/dv).
+	XMFLOAT3 normal;
+	XMStoreFloat3(&normal, XMVector3Normalize(XMVectorSet(-dhdu, mSpatialStep, dhdv, 0.0f)));
+	return normal;
+}
+
+void WavesSampler::Heights(const XMFLOAT2* points, int count, float* out, WavesFilter filter) const
+{
+	if (filter == WavesFilter::Bilinear)
+	{
+		WavesSimd::SampleBilinear(mSimdLevel, mHeights, mNumRows, mNumCols,
+			mX0, mZ0, mInvSpatialStep, &points[0].x, count, out);
+		return;
+	}
+
+	for (int k = 0; k < count; ++k)
+		out[k] = Height(points[k].x, points[k].y, filter);
+}
+
+void WavesSampler::Normals(const XMFLOAT2* points, int count, XMFLOAT3* out, WavesFilter filter) const
+{
+	for (int k = 0; k < count; ++k)
+		out[k] = Normal(points[k].x, points[k].y, filter);
+}
+
+void WavesSampler::GridCoordinates(float x, float z, float& u, float& v) const
+{
+	// Same arithmetic as WavesSimd::SampleBilinear, so single and batched
+	// queries agree bit for bit.
+	u = std::min(std::max((x - mX0) * mInvSpatialStep, 0.0f), static_cast<float>(mNumCols - 1));
+	v = std::min(std::max((mZ0 - z) * mInvSpatialStep, 0.0f), static_cast<float>(mNumRows - 1));
+}
+
+float WavesSampler::SampleBilinear(float u, float v, float* dhdu, float* dhdv) const
+{
+	const int j = std::min(static_cast<int>(u), mNumCols - 2);
+	const int i = std::min(static_cast<int>(v), mNumRows - 2);
+	const float fu = u - static_cast<float>(j);
+	const float fv = v - static_cast<float>(i);
+
+	const float* r0 = mHeights + i * mNumCols + j;
+	const float* r1 = r0 + mNumCols;
+
+	if (dhdu != nullptr)
+	{
+		*dhdu = (r0[1] - r0[0]) + fv * ((r1[1] - r1[0]) - (r0[1] - r0[0]));
+		*dhdv = (r1[0] - r0[0]) + fu * ((r1[1] - r0[1]) - (r1[0] - r0[0]));
+	}
+
+	const float top = r0[0] + fu * (r0[1] - r0[0]);
+	const float bottom = r1[0] + fu * (r1[1] - r1[0]);
+	return top + fv * (bottom - top);
+}
+
+float WavesSampler::SampleBicubic(float u, float v, float* dhdu, float* dhdv) const
+{
+	const int j = std::min(static_cast<int>(u), mNumCols - 2);
+	const int i = std::min(static_cast<int>(v), mNumRows - 2);
+
+	float wu[4], dwu[4], wv[4], dwv[4];
+	CatmullRomWeights(u - static_cast<float>(j), wu, dwu);
+	CatmullRomWeights(v - static_cast<float>(i), wv, dwv);
+
+	float h = 0.0f;
+	float hu = 0.0f;
+	float hv = 0.0f;
+	for (int r = 0; r < 4; ++r)
+	{
+		float row = 0.0f;
+		float rowU = 0.0f;
+		for (int c = 0; c < 4; ++c)
+		{
+			const float s = At(i - 1 + r, j - 1 + c);
+			row += wu[c] * s;
+			rowU += dwu[c] * s;
+		}
+
+		h += wv[r] * row;
+		hu += wv[r] * rowU;
+		hv += dwv[r] * row;
+	}
+
+	if (dhdu != nullptr)
+	{
+		*dhdu = hu;
+		*dhdv = hv;
+	}
+	return h;
+}
+
+float WavesSampler::At(int i, int j) const
+{
+	// Edge vertices repeat past the border.
+	i = std::min(std::max(i, 0), mNumRows - 1);
+	j = std::min(std::max(j, 0), mNumCols - 1);
+	return mHeights[i * mNumCols + j];
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <DirectXMath.h>
+#include "WavesSimd.h"
+
+// How WavesSampler interpolates between grid vertices.
+enum class WavesFilter : int
+{
+	// Continuous heights, normals that jump across cell edges.  Batched
+	// queries use the SIMD gather kernel.
+	Bilinear = 0,
+
+	// Catmull-Rom through the 4x4 surrounding vertices: continuous heights
+	// and normals, about four times the work.  Always scalar.
+	Bicubic
+};
+
+// World-space height/normal queries over a row-major grid of heights laid
+// out like Waves' vertices: m x n, spacing dx, centered on the origin, row 0
+// at +z.
+//
+// A sampler does not own the heights; it is only valid while they are.  All
+// queries are const and may run on any number of threads at once.  Points
+// outside the grid are clamped to its edge.
+class WavesSampler
+{
+public:
+	WavesSampler() = default;
+	WavesSampler(const float* heights, int m, int n, float dx);
+
+	bool Valid() const { return mHeights != nullptr; }
+	int RowCount() const { return mNumRows; }
+	int ColumnCount() const { return mNumCols; }
+	float SpatialStep() const { return mSpatialStep; }
+
+	// True if (x, z) lies on the grid.
+	bool Contains(float x, float z) const;
+
+	float Height(float x, float z, WavesFilter filter = WavesFilter::Bilinear) const;
+
+	// Unit normal from the gradient of the interpolated surface.
+	DirectX::XMFLOAT3 Normal(float x, float z, WavesFilter filter = WavesFilter::Bilinear) const;
+
+	// Batched: out[k] for points[k] = (x, z).  Bilinear batches run on
+	// WavesSimd::SampleBilinear at simdLevel and match Height() exactly.
+	void Heights(const DirectX::XMFLOAT2* points, int count, float* out,
+		WavesFilter filter = WavesFilter::Bilinear) const;
+	void Normals(const DirectX::XMFLOAT2* points, int count, DirectX::XMFLOAT3* out,
+		WavesFilter filter = WavesFilter::Bilinear) const;
+
+	WavesSimdLevel SimdLevel() const { return mSimdLevel; }
+	void SetSimdLevel(WavesSimdLevel level);
+
+private:
+	// Grid coordinates (u along columns, v along rows) of (x, z), clamped.
+	void GridCoordinates(float x, float z, float& u, float& v) const;
+
+	// Height and its derivatives along u and v, in grid units.
+	float SampleBilinear(float u, float v, float* dhdu, float* dhdv) const;
+	float SampleBicubic(float u, float v, float* dhdu, float* dhdv) const;
+
+	float At(int i, int j) const;
+
+private:
+	const float* mHeights = nullptr;
+	int mNumRows = 0;
+	int mNumCols = 0;
+	float mSpatialStep = 1.0f;
+	float mInvSpatialStep = 1.0f;
+	float mX0 = 0.0f;
+	float mZ0 = 0.0f;
+	WavesSimdLevel mSimdLevel = WavesSimdLevel::Scalar;
+};
+
+// A copy of a height grid together with the simulation step it was taken at,
+// for readers that outlive the simulation's next step.  See
+// AsyncWaves::HeightField.
+class WavesHeightField
+{
+public:
+	int RowCount() const { return mNumRows; }
+	int ColumnCount() const { return mNumCols; }
+	float SpatialStep() const { return mSpatialStep; }
+	unsigned long long StepCount() const { return mStepCount; }
+	const float* Heights() const { return mHeights.data(); }
+
+	// Valid as long as this field is.
+	WavesSampler Sampler() const { return WavesSampler(mHeights.data(), mNumRows, mNumCols, mSpatialStep); }
+
+private:
+	friend class AsyncWaves;
+
+	int mNumRows = 0;
+	int mNumCols = 0;
+	float mSpatialStep = 1.0f;
+	unsigned long long mStepCount = 0;
+
+	// Dirty stamp of the simulation when last filled; 0 forces a full copy.
+	unsigned long long mDirtyStamp = 0;
+
+	std::vector<float> mHeights;
+};
@@ -0,0 +1,739 @@
+#include "WavesSimd.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WAVES_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define WAVES_SIMD_X86 0
+#endif
+
+// MSVC lets any function use any intrinsic; GCC/Clang need the target
+// attribute so the wider paths can live in this translation unit without
+// raising the baseline of the whole build.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define WAVES_TARGET(x)
+#else
+#define WAVES_TARGET(x) __attribute__((target(x)))
+#endif
+
+// GCC contracts mul+add pairs into FMAs once a target enables FMA (AVX-512
+// implies it), which would break the bit-exact match with the scalar loop.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace
+{
+	void UpdateRowScalar(float* prev, const float* curr, const float* up, const float* down,
+		int count, int stride, float k1, float k2, float k3)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			const int o = j * stride;
+			prev[o] =
+				k1 * prev[o] +
+				k2 * curr[o] +
+				k3 * (down[o] +
+					up[o] +
+					curr[o + stride] +
+					curr[o - stride]);
+		}
+	}
+
+	void SampleBilinearScalar(const float* heights, int rows, int cols,
+		float x0, float z0, float invDx, const float* points, int count, float* out)
+	{
+		const float maxU = static_cast<float>(cols - 1);
+		const float maxV = static_cast<float>(rows - 1);
+
+		for (int k = 0; k < count; ++k)
+		{
+			const float u = std::min(std::max((points[2 * k] - x0) * invDx, 0.0f), maxU);
+			const float v = std::min(std::max((z0 - points[2 * k + 1]) * invDx, 0.0f), maxV);
+
+			// u, v >= 0, so truncation is floor.  The last cell takes the edge.
+			const int j = std::min(static_cast<int>(u), cols - 2);
+			const int i = std::min(static_cast<int>(v), rows - 2);
+			const float fu = u - static_cast<float>(j);
+			const float fv = v - static_cast<float>(i);
+
+			const float* r0 = heights + i * cols + j;
+			const float* r1 = r0 + cols;
+			const float top = r0[0] + fu * (r0[1] - r0[0]);
+			const float bottom = r1[0] + fu * (r1[1] - r1[0]);
+			out[k] = top + fv * (bottom - top);
+		}
+	}
+
+	// Octahedral projection onto the xz plane, lower hemisphere folded over
+	// the diagonals.
+	void EncodeOctahedralScalar(float x, float y, float z, std::int16_t* encoded)
+	{
+		const float s = std::max(fabsf(x) + fabsf(y) + fabsf(z), 1e-30f);
+		float u = x / s;
+		float v = z / s;
+
+		if (y < 0.0f)
+		{
+			const float fu = (1.0f - fabsf(v)) * (u < 0.0f ? -1.0f : 1.0f);
+			const float fv = (1.0f - fabsf(u)) * (v < 0.0f ? -1.0f : 1.0f);
+			u = fu;
+			v = fv;
+		}
+
+		encoded[0] = static_cast<std::int16_t>(lrintf(std::min(std::max(u, -1.0f), 1.0f) * 32767.0f));
+		encoded[1] = static_cast<std::int16_t>(lrintf(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f));
+	}
+
+	void StreamCompactRowScalar(WavesCompactVertex* dst, const float* heights, const float* normals, int count)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			WavesCompactVertex vertex;
+			vertex.Height = WavesSimd::FloatToHalf(heights[j]);
+			vertex.Pad = 0;
+			EncodeOctahedralScalar(normals[3 * j], normals[3 * j + 1], normals[3 * j + 2], vertex.Normal);
+
+#if WAVES_SIMD_X86
+			int words[2];
+			memcpy(words, &vertex, sizeof(words));
+			_mm_stream_si32(reinterpret_cast<int*>(dst + j), words[0]);
+			_mm_stream_si32(reinterpret_cast<int*>(dst + j) + 1, words[1]);
+#else
+			dst[j] = vertex;
+#endif
+		}
+	}
+
+#if WAVES_SIMD_X86
+	WAVES_TARGET("sse4.1")
+	inline __m128 Load4(const float* p, int stride)
+	{
+		if (stride == 1)
+			return _mm_loadu_ps(p);
+
+		// Compiles to movss + insertps.
+		return _mm_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride]);
+	}
+
+	WAVES_TARGET("sse4.1")
+	void UpdateRowSSE41(float* prev, const float* curr, const float* up, const float* down,
+		int count, int stride, float k1, float k2, float k3)
+	{
+		const __m128 vk1 = _mm_set1_ps(k1);
+		const __m128 vk2 = _mm_set1_ps(k2);
+		const __m128 vk3 = _mm_set1_ps(k3);
+
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			const int o = j * stride;
+
+			__m128 sum = _mm_add_ps(Load4(down + o, stride), Load4(up + o, stride));
+			sum = _mm_add_ps(sum, Load4(curr + o + stride, stride));
+			sum = _mm_add_ps(sum, Load4(curr + o - stride, stride));
+
+			__m128 r = _mm_add_ps(
+				_mm_mul_ps(vk1, Load4(prev + o, stride)),
+				_mm_mul_ps(vk2, Load4(curr + o, stride)));
+			r = _mm_add_ps(r, _mm_mul_ps(vk3, sum));
+
+			if (stride == 1)
+			{
+				_mm_storeu_ps(prev + o, r);
+			}
+			else
+			{
+				prev[o] = _mm_cvtss_f32(r);
+				prev[o + stride] = _mm_cvtss_f32(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)));
+				prev[o + 2 * stride] = _mm_cvtss_f32(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)));
+				prev[o + 3 * stride] = _mm_cvtss_f32(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+			}
+		}
+
+		UpdateRowScalar(prev + j * stride, curr + j * stride, up + j * stride, down + j * stride,
+			count - j, stride, k1, k2, k3);
+	}
+
+	WAVES_TARGET("avx2")
+	void UpdateRowAVX2(float* prev, const float* curr, const float* up, const float* down,
+		int count, int stride, float k1, float k2, float k3)
+	{
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+		const __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			const int o = j * stride;
+
+			__m256 p, c, u, d, r0, l0;
+			if (stride == 1)
+			{
+				p = _mm256_loadu_ps(prev + o);
+				c = _mm256_loadu_ps(curr + o);
+				u = _mm256_loadu_ps(up + o);
+				d = _mm256_loadu_ps(down + o);
+				r0 = _mm256_loadu_ps(curr + o + 1);
+				l0 = _mm256_loadu_ps(curr + o - 1);
+			}
+			else
+			{
+				p = _mm256_i32gather_ps(prev + o, idx, 4);
+				c = _mm256_i32gather_ps(curr + o, idx, 4);
+				u = _mm256_i32gather_ps(up + o, idx, 4);
+				d = _mm256_i32gather_ps(down + o, idx, 4);
+				r0 = _mm256_i32gather_ps(curr + o + stride, idx, 4);
+				l0 = _mm256_i32gather_ps(curr + o - stride, idx, 4);
+			}
+
+			__m256 sum = _mm256_add_ps(d, u);
+			sum = _mm256_add_ps(sum, r0);
+			sum = _mm256_add_ps(sum, l0);
+
+			__m256 r = _mm256_add_ps(_mm256_mul_ps(vk1, p), _mm256_mul_ps(vk2, c));
+			r = _mm256_add_ps(r, _mm256_mul_ps(vk3, sum));
+
+			if (stride == 1)
+			{
+				_mm256_storeu_ps(prev + o, r);
+			}
+			else
+			{
+				// AVX2 has no scatter.
+				alignas(32) float tmp[8];
+				_mm256_store_ps(tmp, r);
+				for (int k = 0; k < 8; ++k)
+					prev[o + k * stride] = tmp[k];
+			}
+		}
+
+		UpdateRowSSE41(prev + j * stride, curr + j * stride, up + j * stride, down + j * stride,
+			count - j, stride, k1, k2, k3);
+	}
+
+	WAVES_TARGET("avx512f")
+	void UpdateRowAVX512(float* prev, const float* curr, const float* up, const float* down,
+		int count, int stride, float k1, float k2, float k3)
+	{
+		const __m512 vk1 = _mm512_set1_ps(k1);
+		const __m512 vk2 = _mm512_set1_ps(k2);
+		const __m512 vk3 = _mm512_set1_ps(k3);
+		const __m512i idx = _mm512_mullo_epi32(
+			_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(stride));
+
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			const int o = j * stride;
+
+			__m512 p, c, u, d, r0, l0;
+			if (stride == 1)
+			{
+				p = _mm512_loadu_ps(prev + o);
+				c = _mm512_loadu_ps(curr + o);
+				u = _mm512_loadu_ps(up + o);
+				d = _mm512_loadu_ps(down + o);
+				r0 = _mm512_loadu_ps(curr + o + 1);
+				l0 = _mm512_loadu_ps(curr + o - 1);
+			}
+			else
+			{
+				p = _mm512_i32gather_ps(idx, prev + o, 4);
+				c = _mm512_i32gather_ps(idx, curr + o, 4);
+				u = _mm512_i32gather_ps(idx, up + o, 4);
+				d = _mm512_i32gather_ps(idx, down + o, 4);
+				r0 = _mm512_i32gather_ps(idx, curr + o + stride, 4);
+				l0 = _mm512_i32gather_ps(idx, curr + o - stride, 4);
+			}
+
+			__m512 sum = _mm512_add_ps(d, u);
+			sum = _mm512_add_ps(sum, r0);
+			sum = _mm512_add_ps(sum, l0);
+
+			__m512 r = _mm512_add_ps(_mm512_mul_ps(vk1, p), _mm512_mul_ps(vk2, c));
+			r = _mm512_add_ps(r, _mm512_mul_ps(vk3, sum));
+
+			if (stride == 1)
+				_mm512_storeu_ps(prev + o, r);
+			else
+				_mm512_i32scatter_ps(prev + o, idx, r, 4);
+		}
+
+		UpdateRowAVX2(prev + j * stride, curr + j * stride, up + j * stride, down + j * stride,
+			count - j, stride, k1, k2, k3);
+	}
+
+	WAVES_TARGET("avx2")
+	void SampleBilinearAVX2(const float* heights, int rows, int cols,
+		float x0, float z0, float invDx, const float* points, int count, float* out)
+	{
+		const __m256 vx0 = _mm256_set1_ps(x0);
+		const __m256 vz0 = _mm256_set1_ps(z0);
+		const __m256 vinv = _mm256_set1_ps(invDx);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 maxU = _mm256_set1_ps(static_cast<float>(cols - 1));
+		const __m256 maxV = _mm256_set1_ps(static_cast<float>(rows - 1));
+		const __m256i lastCol = _mm256_set1_epi32(cols - 2);
+		const __m256i lastRow = _mm256_set1_epi32(rows - 2);
+		const __m256i vcols = _mm256_set1_epi32(cols);
+
+		int k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			// De-interleave eight (x, z) pairs: the shuffles leave the lanes in
+			// 0 1 4 5 2 3 6 7 order, and the 64-bit permute restores it.
+			const __m256 a = _mm256_loadu_ps(points + 2 * k);
+			const __m256 b = _mm256_loadu_ps(points + 2 * k + 8);
+			const __m256 x = _mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+			const __m256 z = _mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+			const __m256 u = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(x, vx0), vinv), zero), maxU);
+			const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(vz0, z), vinv), zero), maxV);
+
+			const __m256i j = _mm256_min_epi32(_mm256_cvttps_epi32(u), lastCol);
+			const __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(v), lastRow);
+			const __m256 fu = _mm256_sub_ps(u, _mm256_cvtepi32_ps(j));
+			const __m256 fv = _mm256_sub_ps(v, _mm256_cvtepi32_ps(i));
+
+			const __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(i, vcols), j);
+			const __m256 h00 = _mm256_i32gather_ps(heights, idx, 4);
+			const __m256 h01 = _mm256_i32gather_ps(heights + 1, idx, 4);
+			const __m256 h10 = _mm256_i32gather_ps(heights + cols, idx, 4);
+			const __m256 h11 = _mm256_i32gather_ps(heights + cols + 1, idx, 4);
+
+			const __m256 top = _mm256_add_ps(h00, _mm256_mul_ps(fu, _mm256_sub_ps(h01, h00)));
+			const __m256 bottom = _mm256_add_ps(h10, _mm256_mul_ps(fu, _mm256_sub_ps(h11, h10)));
+			_mm256_storeu_ps(out + k, _mm256_add_ps(top, _mm256_mul_ps(fv, _mm256_sub_ps(bottom, top))));
+		}
+
+		SampleBilinearScalar(heights, rows, cols, x0, z0, invDx, points + 2 * k, count - k, out + k);
+	}
+
+	WAVES_TARGET("avx2,f16c")
+	void StreamCompactRowAVX2(WavesCompactVertex* dst, const float* heights, const float* normals, int count)
+	{
+		const __m256i xyz = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 minusOne = _mm256_set1_ps(-1.0f);
+		const __m256 tiny = _mm256_set1_ps(1e-30f);
+		const __m256 scale = _mm256_set1_ps(32767.0f);
+		const __m256i low16 = _mm256_set1_epi32(0xffff);
+		const bool aligned = (reinterpret_cast<std::uintptr_t>(dst) & 31) == 0;
+
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			// Same operations as EncodeOctahedralScalar, eight normals at once.
+			const float* n = normals + 3 * j;
+			const __m256 x = _mm256_i32gather_ps(n, xyz, 4);
+			const __m256 y = _mm256_i32gather_ps(n + 1, xyz, 4);
+			const __m256 z = _mm256_i32gather_ps(n + 2, xyz, 4);
+
+			const __m256 s = _mm256_max_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_and_ps(x, absMask), _mm256_and_ps(y, absMask)), _mm256_and_ps(z, absMask)), tiny);
+			__m256 u = _mm256_div_ps(x, s);
+			__m256 v = _mm256_div_ps(z, s);
+
+			const __m256 signU = _mm256_blendv_ps(one, minusOne, _mm256_cmp_ps(u, zero, _CMP_LT_OQ));
+			const __m256 signV = _mm256_blendv_ps(one, minusOne, _mm256_cmp_ps(v, zero, _CMP_LT_OQ));
+			const __m256 foldU = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(v, absMask)), signU);
+			const __m256 foldV = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(u, absMask)), signV);
+			const __m256 lower = _mm256_cmp_ps(y, zero, _CMP_LT_OQ);
+			u = _mm256_blendv_ps(u, foldU, lower);
+			v = _mm256_blendv_ps(v, foldV, lower);
+
+			const __m256i eu = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(u, minusOne), one), scale));
+			const __m256i ev = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, minusOne), one), scale));
+
+			// Vertex k is the 64-bit pair (height, normal) of lane k.
+			const __m256i h = _mm256_cvtepu16_epi32(
+				_mm256_cvtps_ph(_mm256_loadu_ps(heights + j), _MM_FROUND_TO_NEAREST_INT));
+			const __m256i normal = _mm256_or_si256(_mm256_and_si256(eu, low16), _mm256_slli_epi32(ev, 16));
+
+			const __m256i lo = _mm256_unpacklo_epi32(h, normal);
+			const __m256i hi = _mm256_unpackhi_epi32(h, normal);
+			const __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+			const __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+
+			__m256i* out = reinterpret_cast<__m256i*>(dst + j);
+			if (aligned)
+			{
+				_mm256_stream_si256(out, first);
+				_mm256_stream_si256(out + 1, second);
+			}
+			else
+			{
+				_mm256_storeu_si256(out, first);
+				_mm256_storeu_si256(out + 1, second);
+			}
+		}
+
+		StreamCompactRowScalar(dst + j, heights + j, normals + 3 * j, count - j);
+	}
+#endif
+
+	WavesSimdLevel QueryLevel()
+	{
+#if WAVES_SIMD_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse41 = (info[2] & (1 << 19)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!sse41)
+			return WavesSimdLevel::Scalar;
+		if (!osxsave || maxLeaf < 7)
+			return WavesSimdLevel::SSE41;
+
+		// The OS has to save the YMM (and for AVX-512 the opmask/ZMM) state.
+		const unsigned long long xcr0 = _xgetbv(0);
+		const bool osAvx = (xcr0 & 0x6) == 0x6;
+		const bool osAvx512 = (xcr0 & 0xE6) == 0xE6;
+
+		__cpuidex(info, 7, 0);
+		const bool avx2 = (info[1] & (1 << 5)) != 0;
+		const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+		if (avx512f && osAvx512)
+			return WavesSimdLevel::AVX512;
+		if (avx2 && osAvx)
+			return WavesSimdLevel::AVX2;
+		return WavesSimdLevel::SSE41;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return WavesSimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return WavesSimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return WavesSimdLevel::SSE41;
+		return WavesSimdLevel::Scalar;
+#endif
+#else
+		return WavesSimdLevel::Scalar;
+#endif
+	}
+}
+
+namespace
+{
+	// F16C (half conversions) is its own CPUID bit, though every AVX2 CPU so
+	// far has it.
+	bool QueryF16C()
+	{
+#if WAVES_SIMD_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 29)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("f16c") != 0;
+#endif
+#else
+		return false;
+#endif
+	}
+}
+
+WavesSimdLevel WavesSimd::DetectLevel()
+{
+	static const WavesSimdLevel level = QueryLevel();
+	return level;
+}
+
+const char* WavesSimd::LevelName(WavesSimdLevel level)
+{
+	switch (level)
+	{
+	case WavesSimdLevel::SSE41:  return "SSE4.1";
+	case WavesSimdLevel::AVX2:   return "AVX2";
+	case WavesSimdLevel::AVX512: return "AVX-512";
+	default:                     return "Scalar";
+	}
+}
+
+void WavesSimd::UpdateRow(WavesSimdLevel level, float* prev, const float* curr,
+	const float* up, const float* down, int count, int stride,
+	float k1, float k2, float k3)
+{
+#if WAVES_SIMD_X86
+	switch (level)
+	{
+	case WavesSimdLevel::AVX512:
+		UpdateRowAVX512(prev, curr, up, down, count, stride, k1, k2, k3);
+		return;
+	case WavesSimdLevel::AVX2:
+		UpdateRowAVX2(prev, curr, up, down, count, stride, k1, k2, k3);
+		return;
+	case WavesSimdLevel::SSE41:
+		UpdateRowSSE41(prev, curr, up, down, count, stride, k1, k2, k3);
+		return;
+	default:
+		break;
+	}
+#endif
+	UpdateRowScalar(prev, curr, up, down, count, stride, k1, k2, k3);
+}
+
+void WavesSimd::StreamVertexRow(void* dst, const WavesVertexLayout& layout,
+	const float* heights, const float* normals, int count,
+	float x0, float dx, float z, float du, float v)
+{
+	unsigned char* out = static_cast<unsigned char*>(dst);
+
+#if WAVES_SIMD_X86
+	const bool packed =
+		layout.Stride == 8 * sizeof(float) &&
+		layout.PositionOffset == 0 &&
+		layout.NormalOffset == 3 * sizeof(float) &&
+		layout.TexCOffset == 6 * sizeof(float) &&
+		(reinterpret_cast<std::uintptr_t>(out) & 15) == 0;
+
+	if (packed)
+	{
+		for (int j = 0; j < count; ++j)
+		{
+			const float* n = normals + 3 * j;
+			float* p = reinterpret_cast<float*>(out + j * layout.Stride);
+			_mm_stream_ps(p, _mm_setr_ps(x0 + j * dx, heights[j], z, n[0]));
+			_mm_stream_ps(p + 4, _mm_setr_ps(n[1], n[2], j * du, v));
+		}
+	}
+	else
+	{
+		auto stream = [](unsigned char* p, float f)
+		{
+			int bits;
+			memcpy(&bits, &f, sizeof(bits));
+			_mm_stream_si32(reinterpret_cast<int*>(p), bits);
+		};
+
+		for (int j = 0; j < count; ++j)
+		{
+			unsigned char* vtx = out + j * layout.Stride;
+
+			unsigned char* p = vtx + layout.PositionOffset;
+			stream(p, x0 + j * dx);
+			stream(p + 4, heights[j]);
+			stream(p + 8, z);
+
+			if (layout.NormalOffset != WavesVertexLayout::NoAttribute)
+			{
+				const float* n = normals + 3 * j;
+				p = vtx + layout.NormalOffset;
+				stream(p, n[0]);
+				stream(p + 4, n[1]);
+				stream(p + 8, n[2]);
+			}
+
+			if (layout.TexCOffset != WavesVertexLayout::NoAttribute)
+			{
+				p = vtx + layout.TexCOffset;
+				stream(p, j * du);
+				stream(p + 4, v);
+			}
+		}
+	}
+
+	_mm_sfence();
+#else
+	for (int j = 0; j < count; ++j)
+	{
+		unsigned char* vtx = out + j * layout.Stride;
+
+		const float pos[3] = { x0 + j * dx, heights[j], z };
+		memcpy(vtx + layout.PositionOffset, pos, sizeof(pos));
+
+		if (layout.NormalOffset != WavesVertexLayout::NoAttribute)
+			memcpy(vtx + layout.NormalOffset, normals + 3 * j, 3 * sizeof(float));
+
+		if (layout.TexCOffset != WavesVertexLayout::NoAttribute)
+		{
+			const float uv[2] = { j * du, v };
+			memcpy(vtx + layout.TexCOffset, uv, sizeof(uv));
+		}
+	}
+#endif
+}
+
+void WavesSimd::SampleBilinear(WavesSimdLevel level, const float* heights, int rows, int cols,
+	float x0, float z0, float invDx, const float* points, int count, float* out)
+{
+#if WAVES_SIMD_X86
+	if (level >= WavesSimdLevel::AVX2)
+	{
+		SampleBilinearAVX2(heights, rows, cols, x0, z0, invDx, points, count, out);
+		return;
+	}
+#endif
+	SampleBilinearScalar(heights, rows, cols, x0, z0, invDx, points, count, out);
+}
+
+void WavesSimd::StreamCompactRow(WavesSimdLevel level, WavesCompactVertex* dst,
+	const float* heights, const float* normals, int count)
+{
+#if WAVES_SIMD_X86
+	static const bool f16c = QueryF16C();
+	if (level >= WavesSimdLevel::AVX2 && f16c)
+		StreamCompactRowAVX2(dst, heights, normals, count);
+	else
+		StreamCompactRowScalar(dst, heights, normals, count);
+
+	_mm_sfence();
+#else
+	StreamCompactRowScalar(dst, heights, normals, count);
+#endif
+}
+
+std::uint16_t WavesSimd::FloatToHalf(float f)
+{
+	std::uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	const std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+	const std::uint32_t magnitude = bits & 0x7fffffff;
+
+	// NaN stays NaN (quieted, as F16C does), infinity stays infinity, and
+	// anything that rounds past 65504 becomes infinity.
+	if (magnitude > 0x7f800000)
+		return sign | 0x7e00 | static_cast<std::uint16_t>((magnitude >> 13) & 0x3ff);
+	if (magnitude >= 0x477ff000)
+		return sign | 0x7c00;
+
+	// Below 2^-14 the half is subnormal: a multiple of 2^-24.  Scaling by
+	// 2^24 is exact, and rounding picks the nearest multiple (ties to even).
+	if (magnitude < 0x38800000)
+	{
+		float scaled;
+		memcpy(&scaled, &magnitude, sizeof(scaled));
+		return sign | static_cast<std::uint16_t>(lrintf(scaled * 16777216.0f));
+	}
+
+	// Rebias the exponent and round the mantissa to 10 bits, ties to even; a
+	// carry ripples into the exponent as it should.
+	std::uint32_t h = magnitude - 0x38000000;
+	h += 0xfff + ((h >> 13) & 1);
+	return sign | static_cast<std::uint16_t>(h >> 13);
+}
+
+float WavesSimd::HalfToFloat(std::uint16_t h)
+{
+	const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000) << 16;
+	const std::uint32_t exponent = (h >> 10) & 0x1f;
+	const std::uint32_t mantissa = h & 0x3ff;
+
+	if (exponent == 0)
+	{
+		const float f = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+
+	const std::uint32_t bits = exponent == 31 ?
+		sign | 0x7f800000 | (mantissa << 13) :
+		sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+void WavesSimd::EncodeOctahedral(const float* normal, std::int16_t* encoded)
+{
+	EncodeOctahedralScalar(normal[0], normal[1], normal[2], encoded);
+}
+
+void WavesSimd::DecodeOctahedral(const std::int16_t* encoded, float* normal)
+{
+	// What the shader does with the R16G16_SNORM pair.
+	const float u = std::max(encoded[0] / 32767.0f, -1.0f);
+	const float v = std::max(encoded[1] / 32767.0f, -1.0f);
+
+	float x = u;
+	float y = 1.0f - fabsf(u) - fabsf(v);
+	float z = v;
+
+	const float t = std::max(-y, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	z += z >= 0.0f ? -t : t;
+
+	const float length = sqrtf(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+bool WavesSimd::SelfCheck(WavesSimdLevel level, float tolerance, float* maxAbsError)
+{
+	// Constants of a typical pond (dx = 1, dt = 0.03, speed = 4, damping = 0.2).
+	const float k1 = -0.994017f;
+	const float k2 = 1.520478f;
+	const float k3 = 0.119641f;
+
+	float maxError = 0.0f;
+	bool exact = true;
+
+	// Small LCG so the check is reproducible and independent of rand().
+	std::uint32_t seed = 0x9E3779B9u;
+	auto next = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+	};
+
+	const int widths[] = { 3, 5, 18, 37, 130 };
+	const int strides[] = { 1, 3 };
+	for (int n : widths)
+	{
+		for (int stride : strides)
+		{
+			const int rows = 3;
+			std::vector<float> curr(rows * n * stride);
+			std::vector<float> prevRef(rows * n * stride);
+			for (size_t k = 0; k < curr.size(); ++k)
+			{
+				curr[k] = next();
+				prevRef[k] = next();
+			}
+			std::vector<float> prevTest = prevRef;
+
+			const int row = n * stride;
+			const int o = row + stride;
+			UpdateRowScalar(&prevRef[o], &curr[o], &curr[o - row], &curr[o + row], n - 2, stride, k1, k2, k3);
+			UpdateRow(level, &prevTest[o], &curr[o], &curr[o - row], &curr[o + row], n - 2, stride, k1, k2, k3);
+
+			for (size_t k = 0; k < prevRef.size(); ++k)
+			{
+				const float err = std::fabs(prevRef[k] - prevTest[k]);
+				if (err > maxError)
+					maxError = err;
+				if (prevRef[k] != prevTest[k])
+					exact = false;
+			}
+		}
+	}
+
+	if (maxAbsError != nullptr)
+		*maxAbsError = maxError;
+
+	return tolerance > 0.0f ? maxError <= tolerance : exact;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set used by the Waves height-update kernel.  The best level the
+// CPU (and OS) supports is picked at runtime; lower levels can be forced for
+// comparison.
+enum class WavesSimdLevel : int
+{
+	Scalar = 0,
+	SSE41,
+	AVX2,
+	AVX512
+};
+
+// Where Waves::WriteVertices puts each attribute inside a destination vertex.
+// Offsets and stride are in bytes.
+struct WavesVertexLayout
+{
+	static const std::size_t NoAttribute = ~static_cast<std::size_t>(0);
+
+	std::size_t Stride = 0;
+	std::size_t PositionOffset = 0;			// float3
+	std::size_t NormalOffset = NoAttribute;	// float3
+	std::size_t TexCOffset = NoAttribute;	// float2, grid UVs in [0, 1]
+};
+
+// Per-frame part of the compact wave vertex, 8 bytes instead of the 32 of
+// a full position/normal/UV vertex: the height as an IEEE half
+// (DXGI_FORMAT_R16_FLOAT) and the unit normal octahedral-encoded into two
+// snorm16s (DXGI_FORMAT_R16G16_SNORM).  x and z never change, so they live in
+// a separate static stream; see Waves::WriteGridPositions.
+struct WavesCompactVertex
+{
+	std::uint16_t Height;
+	std::uint16_t Pad;
+	std::int16_t Normal[2];
+};
+
+class WavesSimd
+{
+public:
+	// Highest level supported by this CPU/OS.  Cached after the first call.
+	static WavesSimdLevel DetectLevel();
+	static const char* LevelName(WavesSimdLevel level);
+
+	// Integrates 'count' interior heights of one grid row:
+	//
+	//   prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1])
+	//
+	// 'up'/'down' point at the same column in rows i-1/i+1, and curr[-1] and
+	// curr[count] must be readable (the boundary columns).  Consecutive heights
+	// are 'stride' floats apart; stride 1 is the contiguous fast path.
+	//
+	// Every level evaluates the expression with the same IEEE operations in the
+	// same order and without FMA contraction, so all levels produce results
+	// bit-identical to the scalar loop.
+	static void UpdateRow(WavesSimdLevel level, float* prev, const float* curr,
+		const float* up, const float* down, int count, int stride,
+		float k1, float k2, float k3);
+
+	// Writes the 'count' vertices of one grid row into dst, one vertex every
+	// layout.Stride bytes.  Vertex j gets position (x0 + j*dx, heights[j], z),
+	// normal normals[3j..3j+2] and texture coordinate (j*du, v).
+	//
+	// The destination is usually a mapped upload heap (write-combined memory
+	// the CPU never reads back), so the stores are non-temporal.  The
+	// { float3 Pos; float3 Normal; float2 TexC; } layout with a 16-byte
+	// aligned row is written as two full 16-byte streaming stores per vertex;
+	// any other layout streams each float on its own.  Ends with a store
+	// fence, so the data is visible once the call returns.
+	static void StreamVertexRow(void* dst, const WavesVertexLayout& layout,
+		const float* heights, const float* normals, int count,
+		float x0, float dx, float z, float du, float v);
+
+	// Writes 'count' compact vertices from heights and normals (xyz triples)
+	// with non-temporal stores, ending with a store fence.  AVX2 with F16C
+	// converts eight vertices at a time; every level produces the same bits.
+	static void StreamCompactRow(WavesSimdLevel level, WavesCompactVertex* dst,
+		const float* heights, const float* normals, int count);
+
+	// The conversions StreamCompactRow uses, one value at a time.  Halves are
+	// rounded to nearest even like F16C; octahedral components are rounded to
+	// the nearest snorm16 step, with the octahedron's axis along +y.
+	static std::uint16_t FloatToHalf(float f);
+	static float HalfToFloat(std::uint16_t h);
+	static void EncodeOctahedral(const float* normal, std::int16_t* encoded);
+	static void DecodeOctahedral(const std::int16_t* encoded, float* normal);
+
+	// Bilinear heights of a row-major rows x cols grid at 'count' points.
+	// points holds (x, z) pairs; column j sits at x = x0 + j/invDx and row i at
+	// z = z0 - i/invDx.  Points off the grid are clamped to its edge.  AVX2
+	// (and AVX-512) gathers eight points at a time with the same operations as
+	// the scalar loop, so every level returns identical results.
+	static void SampleBilinear(WavesSimdLevel level, const float* heights, int rows, int cols,
+		float x0, float z0, float invDx, const float* points, int count, float* out);
+
+	// Runs 'level' and the scalar reference on a randomized grid (odd widths to
+	// exercise the remainder loops, strides 1 and 3) and compares the outputs.
+	// The kernels are bit-exact by construction, so the default tolerance is 0;
+	// pass a small tolerance when building with /fp:fast or -ffp-contract=fast,
+	// where the compiler is allowed to fuse the multiply-adds (~1 ulp per term).
+	static bool SelfCheck(WavesSimdLevel level, float tolerance = 0.0f, float* maxAbsError = nullptr);
+};
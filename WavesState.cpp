@@ -0,0 +1,641 @@
+#include "WavesState.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const char Magic[4] = { 'W', 'V', 'S', 'T' };
+	const std::uint32_t Version = 1;
+
+	const std::uint32_t QuantizedFlag = 1;
+	const std::uint32_t CompressedFlag = 2;
+
+	struct FileHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint32_t Flags;
+		std::uint32_t Integrator;
+
+		std::int32_t Rows;
+		std::int32_t Columns;
+		std::int32_t BlockRows;
+		std::int32_t BlockCount;
+
+		float SpatialStep;
+		float TimeStep;
+		float WaveSpeed;
+		float Damping;
+		float K1;
+		float K2;
+		float K3;
+		float Accumulator;
+		float Alpha;
+
+		// Quantized only: height = (q - Zero) * Step, for the current heights
+		// and for current minus previous.
+		std::int32_t CurrZero;
+		float CurrStep;
+		std::int32_t DeltaZero;
+		float DeltaStep;
+
+		std::uint32_t Reserved;
+		std::uint64_t StepCount;
+	};
+
+	// Block b holds rows [b * BlockRows, (b + 1) * BlockRows): the current
+	// heights, then the previous ones.
+	struct BlockEntry
+	{
+		std::uint64_t Offset;
+		std::uint32_t CurrSize;
+		std::uint32_t PrevSize;
+	};
+
+	struct Quantizer
+	{
+		std::int32_t Zero = 0;
+		float Step = 1.0f;
+
+		// Covers [min, max] and 0, with 0 on an exact step so calm water
+		// stays exactly 0.
+		void Fit(float min, float max)
+		{
+			min = std::min(min, 0.0f);
+			max = std::max(max, 0.0f);
+			Step = max > min ? (max - min) / 65535.0f : 1.0f;
+			Zero = static_cast<std::int32_t>(std::lround(-min / Step));
+		}
+
+		std::uint16_t Encode(float h) const
+		{
+			const long q = std::lround(h / Step) + Zero;
+			return static_cast<std::uint16_t>(std::min(std::max(q, 0L), 65535L));
+		}
+
+		float Decode(std::uint16_t q) const
+		{
+			return static_cast<float>(static_cast<std::int32_t>(q) - Zero) * Step;
+		}
+	};
+
+	// --- LZ77 block codec ----------------------------------------------------
+	//
+	// LZ4-style sequences: a token with the literal count in the high nibble
+	// and the match length - 4 in the low one (15 means more follows in
+	// 255-continued bytes), the literals, and a 16-bit match offset.  The last
+	// sequence has literals only.
+
+	const int MinMatch = 4;
+	const int HashBits = 14;
+
+	inline std::uint32_t Read32(const unsigned char* p)
+	{
+		std::uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	void PutLength(std::vector<unsigned char>& out, std::size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back(static_cast<unsigned char>(length));
+	}
+
+	void PutSequence(std::vector<unsigned char>& out, const unsigned char* literals, std::size_t literalCount,
+		std::size_t offset, std::size_t matchLength)
+	{
+		const std::size_t matchCode = matchLength >= MinMatch ? matchLength - MinMatch : 0;
+		out.push_back(static_cast<unsigned char>(
+			(std::min<std::size_t>(literalCount, 15) << 4) | std::min<std::size_t>(matchCode, 15)));
+
+		if (literalCount >= 15)
+			PutLength(out, literalCount - 15);
+		out.insert(out.end(), literals, literals + literalCount);
+
+		if (matchLength == 0)
+			return;
+
+		out.push_back(static_cast<unsigned char>(offset));
+		out.push_back(static_cast<unsigned char>(offset >> 8));
+		if (matchCode >= 15)
+			PutLength(out, matchCode - 15);
+	}
+
+	void LzCompress(const unsigned char* src, std::size_t size, std::vector<unsigned char>& out)
+	{
+		std::vector<std::int32_t> table(std::size_t(1) << HashBits, -1);
+
+		std::size_t anchor = 0;
+		std::size_t ip = 0;
+		while (ip + MinMatch <= size)
+		{
+			const std::uint32_t sequence = Read32(src + ip);
+			const std::uint32_t hash = (sequence * 2654435761u) >> (32 - HashBits);
+			const std::int32_t ref = table[hash];
+			table[hash] = static_cast<std::int32_t>(ip);
+
+			if (ref < 0 || ip - ref > 65535 || Read32(src + ref) != sequence)
+			{
+				++ip;
+				continue;
+			}
+
+			std::size_t length = MinMatch;
+			while (ip + length < size && src[ref + length] == src[ip + length])
+				++length;
+
+			PutSequence(out, src + anchor, ip - anchor, ip - ref, length);
+			ip += length;
+			anchor = ip;
+		}
+
+		PutSequence(out, src + anchor, size - anchor, 0, 0);
+	}
+
+	bool GetLength(const unsigned char*& ip, const unsigned char* end, std::size_t& length)
+	{
+		for (;;)
+		{
+			if (ip == end)
+				return false;
+
+			const unsigned char byte = *ip++;
+			length += byte;
+			if (byte != 255)
+				return true;
+		}
+	}
+
+	// Fails unless exactly 'size' bytes come out.
+	bool LzDecompress(const unsigned char* src, std::size_t srcSize, unsigned char* dst, std::size_t size)
+	{
+		const unsigned char* ip = src;
+		const unsigned char* end = src + srcSize;
+		std::size_t op = 0;
+
+		while (ip < end)
+		{
+			const unsigned char token = *ip++;
+
+			std::size_t literals = token >> 4;
+			if (literals == 15 && !GetLength(ip, end, literals))
+				return false;
+			if (literals > static_cast<std::size_t>(end - ip) || literals > size - op)
+				return false;
+
+			std::memcpy(dst + op, ip, literals);
+			ip += literals;
+			op += literals;
+
+			if (ip == end)
+				break;
+
+			if (end - ip < 2)
+				return false;
+			const std::size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+
+			std::size_t length = token & 15;
+			if (length == 15 && !GetLength(ip, end, length))
+				return false;
+			length += MinMatch;
+
+			if (offset == 0 || offset > op || length > size - op)
+				return false;
+
+			// A match closer than its length overlaps what it produces; a run
+			// of one repeated byte is the common case.
+			if (offset >= length)
+				std::memcpy(dst + op, dst + op - offset, length);
+			else if (offset == 1)
+				std::memset(dst + op, dst[op - 1], length);
+			else
+			{
+				for (std::size_t k = 0; k < length; ++k)
+					dst[op + k] = dst[op + k - offset];
+			}
+			op += length;
+		}
+
+		return op == size;
+	}
+
+	// --- Block encoding ------------------------------------------------------
+	//
+	// Before compression the values are split into byte planes (all first
+	// bytes, then all second bytes, ...), which puts the slowly varying sign
+	// and exponent bytes of neighboring heights next to each other.  Quantized
+	// heights are first replaced by their difference from the previous one.
+
+	void EncodeSection(const void* values, std::size_t count, std::size_t width, bool compress,
+		std::vector<unsigned char>& out)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(values);
+		const std::size_t size = count * width;
+
+		if (!compress)
+		{
+			out.insert(out.end(), bytes, bytes + size);
+			return;
+		}
+
+		std::vector<unsigned char> planes(size);
+		for (std::size_t k = 0; k < count; ++k)
+		{
+			for (std::size_t b = 0; b < width; ++b)
+				planes[b * count + k] = bytes[k * width + b];
+		}
+
+		LzCompress(planes.data(), size, out);
+	}
+
+	bool DecodeSection(const unsigned char* src, std::size_t srcSize, std::size_t count, std::size_t width,
+		bool compress, void* values, std::vector<unsigned char>& scratch)
+	{
+		unsigned char* bytes = static_cast<unsigned char*>(values);
+		const std::size_t size = count * width;
+
+		if (!compress)
+		{
+			if (srcSize != size)
+				return false;
+			std::memcpy(bytes, src, size);
+			return true;
+		}
+
+		scratch.resize(size);
+		if (!LzDecompress(src, srcSize, scratch.data(), size))
+			return false;
+
+		for (std::size_t k = 0; k < count; ++k)
+		{
+			for (std::size_t b = 0; b < width; ++b)
+				bytes[k * width + b] = scratch[b * count + k];
+		}
+		return true;
+	}
+
+	void DeltaEncode(std::vector<std::uint16_t>& q)
+	{
+		for (std::size_t k = q.size(); k-- > 1;)
+			q[k] = static_cast<std::uint16_t>(q[k] - q[k - 1]);
+	}
+
+	void DeltaDecode(std::vector<std::uint16_t>& q)
+	{
+		for (std::size_t k = 1; k < q.size(); ++k)
+			q[k] = static_cast<std::uint16_t>(q[k] + q[k - 1]);
+	}
+
+	// --- Read-only file mapping ----------------------------------------------
+
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if (mData != nullptr)
+				UnmapViewOfFile(mData);
+			if (mMapping != nullptr)
+				CloseHandle(mMapping);
+			if (mFile != INVALID_HANDLE_VALUE)
+				CloseHandle(mFile);
+#else
+			if (mData != nullptr)
+				munmap(const_cast<unsigned char*>(mData), mSize);
+#endif
+		}
+
+		bool Open(const std::string& filename)
+		{
+#if defined(_WIN32)
+			mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (mFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+				return false;
+
+			mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mMapping == nullptr)
+				return false;
+
+			mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+			mSize = static_cast<std::size_t>(size.QuadPart);
+#else
+			const int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size == 0)
+			{
+				close(fd);
+				return false;
+			}
+
+			void* data = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (data == MAP_FAILED)
+				return false;
+
+			mData = static_cast<const unsigned char*>(data);
+			mSize = static_cast<std::size_t>(info.st_size);
+#endif
+			return mData != nullptr;
+		}
+
+		const unsigned char* Data() const { return mData; }
+		std::size_t Size() const { return mSize; }
+
+	private:
+		const unsigned char* mData = nullptr;
+		std::size_t mSize = 0;
+#if defined(_WIN32)
+		HANDLE mFile = INVALID_HANDLE_VALUE;
+		HANDLE mMapping = nullptr;
+#endif
+	};
+}
+
+bool WavesState::Save(const Waves& waves, const std::string& filename, const WavesStateOptions& options)
+{
+	const int m = waves.mNumRows;
+	const int n = waves.mNumCols;
+	const float* curr = waves.mCurrSolution.data();
+	const float* prev = waves.mPrevSolution.data();
+
+	FileHeader header = {};
+	std::memcpy(header.Magic, Magic, sizeof(Magic));
+	header.Version = Version;
+	header.Flags = (options.Quantize ? QuantizedFlag : 0) | (options.Compress ? CompressedFlag : 0);
+	header.Integrator = static_cast<std::uint32_t>(waves.mIntegrator);
+	header.Rows = m;
+	header.Columns = n;
+	header.BlockRows = std::max(1, (64 * 1024) / n);
+	header.BlockCount = (m + header.BlockRows - 1) / header.BlockRows;
+	header.SpatialStep = waves.mSpatialStep;
+	header.TimeStep = waves.mTimeStep;
+	header.WaveSpeed = waves.mWaveSpeed;
+	header.Damping = waves.mDamping;
+	header.K1 = waves.mK1;
+	header.K2 = waves.mK2;
+	header.K3 = waves.mK3;
+	header.Accumulator = waves.mAccumulator;
+	header.Alpha = waves.mAlpha;
+	header.StepCount = waves.mStepCount;
+
+	Quantizer currQuantizer;
+	Quantizer deltaQuantizer;
+	if (options.Quantize)
+	{
+		float currMin = 0.0f, currMax = 0.0f, deltaMin = 0.0f, deltaMax = 0.0f;
+		for (int k = 0; k < m * n; ++k)
+		{
+			currMin = std::min(currMin, curr[k]);
+			currMax = std::max(currMax, curr[k]);
+			deltaMin = std::min(deltaMin, curr[k] - prev[k]);
+			deltaMax = std::max(deltaMax, curr[k] - prev[k]);
+		}
+
+		currQuantizer.Fit(currMin, currMax);
+		deltaQuantizer.Fit(deltaMin, deltaMax);
+		header.CurrZero = currQuantizer.Zero;
+		header.CurrStep = currQuantizer.Step;
+		header.DeltaZero = deltaQuantizer.Zero;
+		header.DeltaStep = deltaQuantizer.Step;
+	}
+
+	// Blocks are encoded independently, in parallel.
+	std::vector<std::vector<unsigned char>> blocks(header.BlockCount);
+	std::vector<BlockEntry> entries(header.BlockCount);
+
+	waves.mPool->ParallelFor(0, header.BlockCount, 1, [&](int first, int last)
+		{
+			std::vector<std::uint16_t> q;
+
+			for (int b = first; b < last; ++b)
+			{
+				const int r0 = b * header.BlockRows;
+				const int r1 = std::min(r0 + header.BlockRows, m);
+				const std::size_t begin = static_cast<std::size_t>(r0) * n;
+				const std::size_t count = static_cast<std::size_t>(r1 - r0) * n;
+
+				std::vector<unsigned char>& out = blocks[b];
+
+				if (!options.Quantize)
+				{
+					EncodeSection(curr + begin, count, sizeof(float), options.Compress, out);
+					entries[b].CurrSize = static_cast<std::uint32_t>(out.size());
+					EncodeSection(prev + begin, count, sizeof(float), options.Compress, out);
+				}
+				else
+				{
+					q.resize(count);
+					for (std::size_t k = 0; k < count; ++k)
+						q[k] = currQuantizer.Encode(curr[begin + k]);
+					DeltaEncode(q);
+					EncodeSection(q.data(), count, sizeof(std::uint16_t), options.Compress, out);
+					entries[b].CurrSize = static_cast<std::uint32_t>(out.size());
+
+					for (std::size_t k = 0; k < count; ++k)
+						q[k] = deltaQuantizer.Encode(curr[begin + k] - prev[begin + k]);
+					DeltaEncode(q);
+					EncodeSection(q.data(), count, sizeof(std::uint16_t), options.Compress, out);
+				}
+
+				entries[b].PrevSize = static_cast<std::uint32_t>(out.size()) - entries[b].CurrSize;
+			}
+		});
+
+	std::uint64_t offset = sizeof(FileHeader) + sizeof(BlockEntry) * entries.size();
+	for (int b = 0; b < header.BlockCount; ++b)
+	{
+		entries[b].Offset = offset;
+		offset += blocks[b].size();
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), sizeof(BlockEntry) * entries.size());
+	for (const std::vector<unsigned char>& block : blocks)
+		file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+
+	return static_cast<bool>(file);
+}
+
+std::unique_ptr<Waves> WavesState::Load(const std::string& filename)
+{
+	FileHeader header;
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0 || header.Version != Version ||
+		header.Rows < 3 || header.Columns < 3 || !(header.SpatialStep > 0.0f) || !(header.TimeStep > 0.0f))
+	{
+		return nullptr;
+	}
+	file.close();
+
+	// The speed and damping only seed the constants, which Load overwrites.
+	auto waves = std::make_unique<Waves>(header.Rows, header.Columns,
+		header.SpatialStep, header.TimeStep, header.WaveSpeed, header.Damping);
+
+	if (!Load(filename, *waves))
+		return nullptr;
+
+	return waves;
+}
+
+bool WavesState::Load(const std::string& filename, Waves& waves)
+{
+	MappedFile file;
+	if (!file.Open(filename) || file.Size() < sizeof(FileHeader))
+		return false;
+
+	FileHeader header;
+	std::memcpy(&header, file.Data(), sizeof(header));
+	if (std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0 || header.Version != Version)
+		return false;
+
+	const int m = waves.mNumRows;
+	const int n = waves.mNumCols;
+	if (header.Rows != m || header.Columns != n || header.SpatialStep != waves.mSpatialStep ||
+		!(header.TimeStep > 0.0f) || header.Integrator > static_cast<std::uint32_t>(WavesIntegrator::ImplicitAdi) ||
+		header.BlockRows < 1 ||
+		header.BlockCount != (m + header.BlockRows - 1) / header.BlockRows ||
+		file.Size() < sizeof(FileHeader) + sizeof(BlockEntry) * static_cast<std::size_t>(header.BlockCount))
+	{
+		return false;
+	}
+
+	std::vector<BlockEntry> entries(header.BlockCount);
+	std::memcpy(entries.data(), file.Data() + sizeof(FileHeader), sizeof(BlockEntry) * entries.size());
+	for (const BlockEntry& entry : entries)
+	{
+		if (entry.Offset > file.Size() ||
+			static_cast<std::uint64_t>(entry.CurrSize) + entry.PrevSize > file.Size() - entry.Offset)
+			return false;
+	}
+
+	const bool quantized = (header.Flags & QuantizedFlag) != 0;
+	const bool compressed = (header.Flags & CompressedFlag) != 0;
+
+	Quantizer currQuantizer;
+	currQuantizer.Zero = header.CurrZero;
+	currQuantizer.Step = header.CurrStep;
+	Quantizer deltaQuantizer;
+	deltaQuantizer.Zero = header.DeltaZero;
+	deltaQuantizer.Step = header.DeltaStep;
+
+	// Decode into fresh buffers, so a corrupt block leaves the simulation as
+	// it was.
+	WavesVector<float> curr(waves.mCurrSolution.get_allocator());
+	WavesVector<float> prev(waves.mPrevSolution.get_allocator());
+	curr.resize(static_cast<std::size_t>(m) * n);
+	prev.resize(static_cast<std::size_t>(m) * n);
+	std::vector<unsigned char> failed(header.BlockCount, 0);
+
+	waves.mPool->ParallelFor(0, header.BlockCount, 1, [&](int first, int last)
+		{
+			std::vector<unsigned char> scratch;
+			std::vector<std::uint16_t> q;
+
+			for (int b = first; b < last; ++b)
+			{
+				const int r0 = b * header.BlockRows;
+				const int r1 = std::min(r0 + header.BlockRows, m);
+				const std::size_t begin = static_cast<std::size_t>(r0) * n;
+				const std::size_t count = static_cast<std::size_t>(r1 - r0) * n;
+
+				const unsigned char* currData = file.Data() + entries[b].Offset;
+				const unsigned char* prevData = currData + entries[b].CurrSize;
+
+				if (!quantized)
+				{
+					failed[b] =
+						!DecodeSection(currData, entries[b].CurrSize, count, sizeof(float), compressed, &curr[begin], scratch) ||
+						!DecodeSection(prevData, entries[b].PrevSize, count, sizeof(float), compressed, &prev[begin], scratch);
+					continue;
+				}
+
+				q.resize(count);
+				if (!DecodeSection(currData, entries[b].CurrSize, count, sizeof(std::uint16_t), compressed, q.data(), scratch))
+				{
+					failed[b] = 1;
+					continue;
+				}
+				DeltaDecode(q);
+				for (std::size_t k = 0; k < count; ++k)
+					curr[begin + k] = currQuantizer.Decode(q[k]);
+
+				if (!DecodeSection(prevData, entries[b].PrevSize, count, sizeof(std::uint16_t), compressed, q.data(), scratch))
+				{
+					failed[b] = 1;
+					continue;
+				}
+				DeltaDecode(q);
+				for (std::size_t k = 0; k < count; ++k)
+					prev[begin + k] = curr[begin + k] - deltaQuantizer.Decode(q[k]);
+			}
+		});
+
+	if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+		return false;
+
+	waves.mCurrSolution.swap(curr);
+	waves.mPrevSolution.swap(prev);
+
+	waves.mTimeStep = header.TimeStep;
+	waves.mWaveSpeed = header.WaveSpeed;
+	waves.mDamping = header.Damping;
+	waves.mIntegrator = static_cast<WavesIntegrator>(header.Integrator);
+	waves.UpdateConstants();
+
+	// Stored rather than recomputed, so an unquantized state continues bit
+	// for bit.
+	waves.mK1 = header.K1;
+	waves.mK2 = header.K2;
+	waves.mK3 = header.K3;
+
+	waves.mAccumulator = header.Accumulator;
+	waves.mAlpha = header.Alpha;
+	waves.mStepCount = header.StepCount;
+
+	waves.mImpulses.clear();
+	waves.mHeightsTouched = true;
+	if (waves.ActiveTilesEnabled())
+		waves.EnableActiveTiles(true, waves.mTileSize, waves.mSleepThreshold);
+
+	waves.mPool->ParallelFor(1, m - 1, waves.mRowGrain, [&waves](int first, int last)
+		{
+			waves.UpdateNormalRows(waves.mCurrSolution.data(), first, last);
+		});
+
+	return true;
+}
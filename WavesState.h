@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "Waves.h"
+
+// How WavesState::Save stores the heights.
+struct WavesStateOptions
+{
+	// Store heights as 16-bit steps of (max - min) / 65535 instead of floats:
+	// half the size before compression, and lossy.  The previous step is
+	// stored as its difference from the current one with its own range, so
+	// the wave velocities keep their precision.  Zero stays exactly zero.
+	bool Quantize = false;
+
+	// LZ-compress the heights after a filter that lines up similar bytes.
+	// Calm water all but disappears; busy water still shrinks a little.
+	bool Compress = true;
+};
+
+// Saves and restores the complete state of a Waves simulation: both time
+// levels of heights, the integration constants, the accumulator and the step
+// count.  An unquantized state continues bit for bit where it was saved.
+// Runtime settings (SIMD level, update mode, pool, memory options, dirty
+// tracking, active tiles) are not part of the state.
+//
+// The file is written in independent blocks of rows.  Loading maps the file
+// into memory and decodes the blocks in parallel into fresh buffers, which
+// are swapped into the simulation only once every block has decoded.  Even a
+// 1024 x 1024 grid restores in a few milliseconds.
+class WavesState
+{
+public:
+	// Return false on I/O errors.
+	static bool Save(const Waves& waves, const std::string& filename,
+		const WavesStateOptions& options = WavesStateOptions());
+
+	// New simulation from a saved state; null if the file cannot be read or
+	// is not a Waves state.
+	static std::unique_ptr<Waves> Load(const std::string& filename);
+
+	// Restores into an existing simulation of the same size and spacing,
+	// keeping its runtime settings.  Queued impulses are dropped.  Returns
+	// false, leaving the simulation untouched, if the file cannot be read, is
+	// not a Waves state or has another grid.
+	static bool Load(const std::string& filename, Waves& waves);
+};